@@ -0,0 +1,668 @@
+#include "host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define HOST_MAX_SEMAPHORES     16
+#define HOST_SCE_ETIMEDOUT      0x8002003C
+#define HOST_SCE_NET_ERROR      0x80410100
+
+static __thread int host_errno_value;
+static const char *host_root;
+static uint64_t host_start;
+
+static sem_t host_semaphores[HOST_MAX_SEMAPHORES];
+static int host_semaphore_count;
+static pthread_mutex_t host_semaphore_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int ps4__main(void);
+
+int *host_error() {
+    return &host_errno_value;
+}
+
+// linux and freebsd agree on errno values below 35 except for EAGAIN, the socket ones moved around
+int host_errno_bsd(int err) {
+    switch (err) {
+        case EAGAIN:        return BSD_EAGAIN;
+        case EDEADLK:       return 11;
+        case ENAMETOOLONG:  return 63;
+        case ENOSYS:        return BSD_ENOSYS;
+        case ENOTEMPTY:     return BSD_ENOTEMPTY;
+        case ENOTSOCK:      return BSD_ENOTSOCK;
+        case EOPNOTSUPP:    return BSD_EOPNOTSUPP;
+        case EAFNOSUPPORT:  return BSD_EAFNOSUPPORT;
+        case EADDRINUSE:    return BSD_EADDRINUSE;
+        case EADDRNOTAVAIL: return BSD_EADDRNOTAVAIL;
+        case ENETUNREACH:   return BSD_ENETUNREACH;
+        case ECONNABORTED:  return BSD_ECONNABORTED;
+        case ECONNRESET:    return BSD_ECONNRESET;
+        case ENOBUFS:       return BSD_ENOBUFS;
+        case ENOTCONN:      return BSD_ENOTCONN;
+        case ETIMEDOUT:     return BSD_ETIMEDOUT;
+        case ECONNREFUSED:  return BSD_ECONNREFUSED;
+        case EHOSTUNREACH:  return BSD_EHOSTUNREACH;
+        case EALREADY:      return 37;
+        case EINPROGRESS:   return BSD_EINPROGRESS;
+    }
+
+    return err;
+}
+
+int host_fail(int err) {
+    host_errno_value = host_errno_bsd(err);
+    return -1;
+}
+
+// sce network calls hand back the errno inside an error code as well
+static int host_net_fail(int err) {
+    host_errno_value = host_errno_bsd(err);
+    return (int)(HOST_SCE_NET_ERROR | host_errno_value);
+}
+
+const char *host_path(const char *path, char *buffer) {
+    if (!path || path[0] != '/') {
+        return path;
+    }
+
+    snprintf(buffer, HOST_PATH_MAX, "%s%s", host_root, path);
+    return buffer;
+}
+
+// libc, the debugger calls all of these through pointers
+void *(*ps4_malloc)(size_t size) = malloc;
+void (*ps4_free)(void *ptr) = free;
+void *(*ps4_realloc)(void *ptr, size_t size) = realloc;
+void *(*ps4_memset)(void *destination, int value, size_t num) = memset;
+void *(*ps4_memcpy)(void *destination, const void *source, size_t num) = memcpy;
+int (*ps4_memcmp)(const void *s1, const void *s2, size_t n) = memcmp;
+char *(*ps4_strcpy)(char *destination, const char *source) = strcpy;
+char *(*ps4_strncpy)(char *destination, const char *source, size_t num) = strncpy;
+char *(*ps4_strcat)(char *dest, const char *src) = strcat;
+unsigned long long (*ps4_strtoull)(const char *str, char **endptr, int base) = strtoull;
+size_t (*ps4_strlen)(const char *s) = strlen;
+int (*ps4_strcmp)(const char *s1, const char *s2) = strcmp;
+int (*ps4_strncmp)(const char *s1, const char *s2, size_t n) = strncmp;
+int (*ps4_snprintf)(char *str, size_t size, const char *format, ...) = snprintf;
+char *(*ps4_strstr)(const char *str1, const char *str2) = strstr;
+int *(*ps4___error)() = host_error;
+
+void ps4_initKernel(void) {
+}
+
+void ps4_initLibc(void) {
+}
+
+void ps4_initPthread(void) {
+}
+
+void ps4_initNetwork(void) {
+}
+
+void ps4_initSysUtil(void) {
+}
+
+// files, absolute paths live below the host root
+static int host_open_flags(int flags) {
+    int r = flags & O_ACCMODE;
+
+    if (flags & BSD_O_NONBLOCK) {
+        r |= O_NONBLOCK;
+    }
+
+    if (flags & BSD_O_APPEND) {
+        r |= O_APPEND;
+    }
+
+    if (flags & BSD_O_CREAT) {
+        r |= O_CREAT;
+    }
+
+    if (flags & BSD_O_TRUNC) {
+        r |= O_TRUNC;
+    }
+
+    if (flags & BSD_O_EXCL) {
+        r |= O_EXCL;
+    }
+
+    return r;
+}
+
+int ps4_open(const char *path, int flags, int mode) {
+    char buffer[HOST_PATH_MAX];
+    int fd;
+
+    fd = open(host_path(path, buffer), host_open_flags(flags), mode);
+    if (fd < 0) {
+        return host_fail(errno);
+    }
+
+    return fd;
+}
+
+ssize_t ps4_read(int fd, void *buf, size_t nbyte) {
+    ssize_t r = read(fd, buf, nbyte);
+    if (r < 0) {
+        return host_fail(errno);
+    }
+
+    return r;
+}
+
+ssize_t ps4_write(int fd, const void *buf, size_t count) {
+    ssize_t r = write(fd, buf, count);
+    if (r < 0) {
+        return host_fail(errno);
+    }
+
+    return r;
+}
+
+int ps4_close(int fd) {
+    if (close(fd)) {
+        return host_fail(errno);
+    }
+
+    return 0;
+}
+
+off_t ps4_lseek(int fildes, off_t offset, int whence) {
+    off_t r = lseek(fildes, offset, whence);
+    if (r < 0) {
+        return host_fail(errno);
+    }
+
+    return r;
+}
+
+int ps4_unlink(const char *pathname) {
+    char buffer[HOST_PATH_MAX];
+
+    if (unlink(host_path(pathname, buffer))) {
+        return host_fail(errno);
+    }
+
+    return 0;
+}
+
+int ps4_rename(const char *oldpath, const char *newpath) {
+    char oldbuffer[HOST_PATH_MAX];
+    char newbuffer[HOST_PATH_MAX];
+
+    if (rename(host_path(oldpath, oldbuffer), host_path(newpath, newbuffer))) {
+        return host_fail(errno);
+    }
+
+    return 0;
+}
+
+int ps4_mkdir(const char *pathname, mode_t mode) {
+    char buffer[HOST_PATH_MAX];
+
+    if (mkdir(host_path(pathname, buffer), mode)) {
+        return host_fail(errno);
+    }
+
+    return 0;
+}
+
+int ps4_rmdir(const char *path) {
+    char buffer[HOST_PATH_MAX];
+
+    if (rmdir(host_path(path, buffer))) {
+        return host_fail(errno);
+    }
+
+    return 0;
+}
+
+// console devices like the fan controller do not exist here
+int ps4_ioctl(int fd, unsigned long com, void *data) {
+    return host_fail(ENOTTY);
+}
+
+// kernel
+static uint64_t host_process_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - host_start;
+}
+
+static int host_load_start_module(const char *name, size_t argc, const void *argv, unsigned int flags, int a, int b) {
+    return 1;
+}
+
+static int host_kernel_read(int fd, void *buf, size_t nbyte) {
+    ssize_t r = read(fd, buf, nbyte);
+    if (r < 0) {
+        int err = errno;
+
+        // the klog reader loops on this without sleeping, there is no klog to wait for
+        if (err == EBADF) {
+            sleep(1);
+        }
+
+        return host_fail(err);
+    }
+
+    return r;
+}
+
+static unsigned int host_sleep(unsigned int seconds) {
+    return sleep(seconds);
+}
+
+static int host_usleep(unsigned int microseconds) {
+    return usleep(microseconds);
+}
+
+int (*ps4_sceKernelLoadStartModule)(const char *name, size_t argc, const void *argv, unsigned int flags, int, int) = host_load_start_module;
+int (*ps4_sceKernelOpen)(const char *path, int flags, int mode) = ps4_open;
+int (*ps4_sceKernelRead)(int fd, void *buf, size_t nbyte) = host_kernel_read;
+unsigned int (*ps4_sceKernelSleep)(unsigned int seconds) = host_sleep;
+int (*ps4_sceKernelUsleep)(unsigned int microseconds) = host_usleep;
+uint64_t (*ps4_sceKernelGetProcessTime)(void) = host_process_time;
+
+static int host_notify(int messageType, char *message) {
+    fprintf(stderr, "[notify] %s\n", message);
+    return 0;
+}
+
+int (*ps4_sceSysUtilSendSystemNotificationWithText)(int messageType, char *message) = host_notify;
+
+// threads
+static int host_pthread_create(void **thread, const void *attr, void *entry, void *arg, const char *name) {
+    pthread_attr_t a;
+    pthread_t t;
+    char shortname[16];
+    int r;
+
+    // nobody joins the debugger threads
+    pthread_attr_init(&a);
+    pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
+    r = pthread_create(&t, &a, (void *(*)(void *))entry, arg);
+    pthread_attr_destroy(&a);
+
+    if (r) {
+        return host_fail(r);
+    }
+
+    if (name) {
+        snprintf(shortname, sizeof(shortname), "%s", name);
+        pthread_setname_np(t, shortname);
+    }
+
+    if (thread) {
+        *thread = (void *)t;
+    }
+
+    return 0;
+}
+
+static void host_pthread_yield(void) {
+    sched_yield();
+}
+
+static void *host_pthread_self(void) {
+    return (void *)pthread_self();
+}
+
+// error checking like the sce default, a relock reports instead of hanging
+static int host_mutex_init(void **mutex, const void *attr, const char *name) {
+    pthread_mutexattr_t a;
+    pthread_mutex_t *m;
+
+    m = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+    if (!m) {
+        return host_fail(ENOMEM);
+    }
+
+    pthread_mutexattr_init(&a);
+    pthread_mutexattr_settype(&a, PTHREAD_MUTEX_ERRORCHECK);
+    pthread_mutex_init(m, &a);
+    pthread_mutexattr_destroy(&a);
+
+    *mutex = m;
+    return 0;
+}
+
+static int host_mutex_lock(void **mutex) {
+    return pthread_mutex_lock((pthread_mutex_t *)*mutex);
+}
+
+static int host_mutex_unlock(void **mutex) {
+    return pthread_mutex_unlock((pthread_mutex_t *)*mutex);
+}
+
+int (*ps4_scePthreadCreate)(void **thread, const void *attr, void *entry, void *arg, const char *name) = host_pthread_create;
+void (*ps4_scePthreadYield)(void) = host_pthread_yield;
+void *(*ps4_scePthreadSelf)(void) = host_pthread_self;
+int (*ps4_scePthreadMutexInit)(void **mutex, const void *attr, const char *name) = host_mutex_init;
+int (*ps4_scePthreadMutexLock)(void **mutex) = host_mutex_lock;
+int (*ps4_scePthreadMutexUnlock)(void **mutex) = host_mutex_unlock;
+
+// semaphores
+int ps4_createSemaphore(const char *name, int attributes, int startingCount, int maxCount) {
+    int id;
+
+    pthread_mutex_lock(&host_semaphore_mutex);
+    id = host_semaphore_count < HOST_MAX_SEMAPHORES ? host_semaphore_count++ : -1;
+    pthread_mutex_unlock(&host_semaphore_mutex);
+
+    if (id < 0) {
+        return host_fail(ENOMEM);
+    }
+
+    sem_init(&host_semaphores[id], 0, startingCount);
+    return id;
+}
+
+int ps4_waitSemaphore(int semaphore, int requiredCount, int *microsecondTimeout) {
+    struct timespec deadline;
+    int r;
+
+    if (semaphore < 0 || semaphore >= host_semaphore_count) {
+        return host_fail(EINVAL);
+    }
+
+    if (microsecondTimeout) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += *microsecondTimeout / 1000000;
+        deadline.tv_nsec += (*microsecondTimeout % 1000000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    for (int i = 0; i < requiredCount; i++) {
+        do {
+            r = microsecondTimeout ? sem_timedwait(&host_semaphores[semaphore], &deadline) : sem_wait(&host_semaphores[semaphore]);
+        } while (r && errno == EINTR);
+
+        if (r) {
+            // give back what was taken so far, the wait counts as not having happened
+            while (i--) {
+                sem_post(&host_semaphores[semaphore]);
+            }
+
+            return HOST_SCE_ETIMEDOUT;
+        }
+    }
+
+    return 0;
+}
+
+int ps4_signalSemaphore(int semaphore, int count) {
+    if (semaphore < 0 || semaphore >= host_semaphore_count) {
+        return host_fail(EINVAL);
+    }
+
+    for (int i = 0; i < count; i++) {
+        sem_post(&host_semaphores[semaphore]);
+    }
+
+    return 0;
+}
+
+// network, the debugger speaks the freebsd socket abi
+static void host_sockaddr_linux(const struct bsd_sockaddr_in *in, struct sockaddr_in *out) {
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = in->sin_port;
+    out->sin_addr.s_addr = in->sin_addr;
+}
+
+static void host_sockaddr_bsd(const struct sockaddr_in *in, struct bsd_sockaddr_in *out) {
+    memset(out, 0, sizeof(*out));
+    out->sin_len = sizeof(*out);
+    out->sin_family = BSD_AF_INET;
+    out->sin_port = in->sin_port;
+    out->sin_addr = in->sin_addr.s_addr;
+}
+
+static int host_msg_flags(int flags) {
+    int r = 0;
+
+    if (flags & BSD_MSG_DONTWAIT) {
+        r |= MSG_DONTWAIT;
+    }
+
+    if (flags & BSD_MSG_WAITALL) {
+        r |= MSG_WAITALL;
+    }
+
+    return r;
+}
+
+static int host_socket(const char *name, int domain, int type, int protocol) {
+    int fd;
+
+    if (domain != BSD_AF_INET) {
+        return host_net_fail(EAFNOSUPPORT);
+    }
+
+    fd = socket(AF_INET, type, protocol);
+    if (fd < 0) {
+        return host_net_fail(errno);
+    }
+
+    return fd;
+}
+
+static int host_socket_close(int fd) {
+    if (close(fd)) {
+        return host_net_fail(errno);
+    }
+
+    return 0;
+}
+
+// shutting the socket down wakes whoever is blocked on it, like the sce abort does
+static int host_socket_abort(int fd, int flags) {
+    shutdown(fd, SHUT_RDWR);
+    return 0;
+}
+
+static int host_bind(int fd, struct bsd_sockaddr_in *addr, int len) {
+    struct sockaddr_in in;
+
+    host_sockaddr_linux(addr, &in);
+    if (bind(fd, (struct sockaddr *)&in, sizeof(in))) {
+        return host_net_fail(errno);
+    }
+
+    return 0;
+}
+
+static int host_connect(int fd, struct bsd_sockaddr_in *addr, int len) {
+    struct sockaddr_in in;
+
+    host_sockaddr_linux(addr, &in);
+    if (connect(fd, (struct sockaddr *)&in, sizeof(in))) {
+        return host_net_fail(errno);
+    }
+
+    return 0;
+}
+
+static int host_listen(int fd, int backlog) {
+    if (listen(fd, backlog)) {
+        return host_net_fail(errno);
+    }
+
+    return 0;
+}
+
+static int host_accept(int fd, struct bsd_sockaddr_in *addr, unsigned int *len) {
+    struct sockaddr_in in;
+    socklen_t inlen;
+    int r;
+
+    inlen = sizeof(in);
+    r = accept(fd, (struct sockaddr *)&in, &inlen);
+    if (r < 0) {
+        return host_net_fail(errno);
+    }
+
+    if (addr && len && *len >= sizeof(*addr)) {
+        host_sockaddr_bsd(&in, addr);
+        *len = sizeof(*addr);
+    }
+
+    return r;
+}
+
+static int host_recvfrom(int fd, void *buf, unsigned int len, int flags, struct bsd_sockaddr_in *from, unsigned int *fromlen) {
+    struct sockaddr_in in;
+    socklen_t inlen;
+    ssize_t r;
+
+    inlen = sizeof(in);
+    r = recvfrom(fd, buf, len, host_msg_flags(flags), (struct sockaddr *)&in, &inlen);
+    if (r < 0) {
+        return host_net_fail(errno);
+    }
+
+    if (from && fromlen && *fromlen >= sizeof(*from)) {
+        host_sockaddr_bsd(&in, from);
+        *fromlen = sizeof(*from);
+    }
+
+    return r;
+}
+
+static int host_sendto(int fd, void *msg, unsigned int len, int flags, struct bsd_sockaddr_in *to, unsigned int tolen) {
+    struct sockaddr_in in;
+    ssize_t r;
+
+    host_sockaddr_linux(to, &in);
+    r = sendto(fd, msg, len, host_msg_flags(flags) | MSG_NOSIGNAL, (struct sockaddr *)&in, sizeof(in));
+    if (r < 0) {
+        return host_net_fail(errno);
+    }
+
+    return r;
+}
+
+static int host_setsockopt(int fd, int level, int optname, const void *optval, unsigned int optlen) {
+    int flags;
+
+    if (level == BSD_SOL_SOCKET) {
+        level = SOL_SOCKET;
+
+        switch (optname) {
+            case BSD_SO_NBIO:
+                flags = fcntl(fd, F_GETFL);
+                if (flags < 0 || fcntl(fd, F_SETFL, *(const int *)optval ? flags | O_NONBLOCK : flags & ~O_NONBLOCK)) {
+                    return host_net_fail(errno);
+                }
+                return 0;
+            case BSD_SO_NOSIGPIPE:
+                // SIGPIPE is ignored for the whole process
+                return 0;
+            case BSD_SO_REUSEADDR:  optname = SO_REUSEADDR; break;
+            case BSD_SO_KEEPALIVE:  optname = SO_KEEPALIVE; break;
+            case BSD_SO_BROADCAST:  optname = SO_BROADCAST; break;
+            case BSD_SO_LINGER:     optname = SO_LINGER; break;
+            case BSD_SO_SNDBUF:     optname = SO_SNDBUF; break;
+            case BSD_SO_RCVBUF:     optname = SO_RCVBUF; break;
+            case BSD_SO_SNDTIMEO:   optname = SO_SNDTIMEO; break;
+            case BSD_SO_RCVTIMEO:   optname = SO_RCVTIMEO; break;
+            default:
+                return host_net_fail(ENOPROTOOPT);
+        }
+    }
+
+    if (setsockopt(fd, level, optname, optval, optlen)) {
+        return host_net_fail(errno);
+    }
+
+    return 0;
+}
+
+static uint16_t host_htons(uint16_t host16) {
+    return htons(host16);
+}
+
+int (*ps4_sceNetSocket)(const char *, int, int, int) = host_socket;
+int (*ps4_sceNetSocketClose)(int) = host_socket_close;
+int (*ps4_sceNetSocketAbort)(int, int) = host_socket_abort;
+int (*ps4_sceNetConnect)(int, struct bsd_sockaddr_in *, int) = host_connect;
+int (*ps4_sceNetBind)(int, struct bsd_sockaddr_in *, int) = host_bind;
+int (*ps4_sceNetListen)(int, int) = host_listen;
+int (*ps4_sceNetAccept)(int, struct bsd_sockaddr_in *, unsigned int *) = host_accept;
+int (*ps4_sceNetSetsockopt)(int, int, int, const void *, unsigned int) = host_setsockopt;
+uint16_t (*ps4_sceNetHtons)(uint16_t) = host_htons;
+
+// the few functions the debugger resolves from modules at runtime
+static int host_sysctlbyname(const char *name, void *oldp, size_t *oldlenp, const void *newp, size_t newlen) {
+    return host_fail(ENOENT);
+}
+
+static const struct {
+    const char *name;
+    void *address;
+} host_functions[] = {
+    { "sceNetRecvfrom", host_recvfrom },
+    { "sceNetSendto", host_sendto },
+    { "sysctlbyname", host_sysctlbyname }
+};
+
+int ps4_getFunctionAddressByName(int loadedModuleID, char *name, void *destination) {
+    for (size_t i = 0; i < sizeof(host_functions) / sizeof(host_functions[0]); i++) {
+        if (!strcmp(host_functions[i].name, name)) {
+            *(void **)destination = host_functions[i].address;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "[host] %s is not available\n", name);
+    return -1;
+}
+
+static void host_mkdir(const char *path) {
+    char buffer[HOST_PATH_MAX];
+
+    mkdir(host_path(path, buffer), 0777);
+}
+
+int main(int argc, char **argv) {
+    struct timespec ts;
+
+    host_root = getenv("FRAME4_ROOT");
+    if (!host_root || !host_root[0]) {
+        host_root = HOST_ROOT_DEFAULT;
+    }
+
+    // the directories the console always has, the debugger creates its own below them
+    mkdir(host_root, 0777);
+    host_mkdir("/data");
+    host_mkdir("/update");
+
+    // broken connections show up as EPIPE like they do with SO_NOSIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    host_start = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    fprintf(stderr, "[host] files below %s\n", host_root);
+
+    return ps4__main();
+}
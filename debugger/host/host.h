@@ -0,0 +1,124 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+// the host build links the unchanged debugger sources against this runtime
+// every symbol in those objects carries a ps4_ prefix, so libPS4 names can be defined here next to glibc
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define HOST_ROOT_DEFAULT       "frame4-root"   // stands in for / when FRAME4_ROOT is not set
+#define HOST_PATH_MAX           1024
+
+// FreeBSD values the debugger is compiled with
+#define BSD_EAGAIN              35
+#define BSD_EINPROGRESS         36
+#define BSD_ENOTSOCK            38
+#define BSD_EOPNOTSUPP          45
+#define BSD_EAFNOSUPPORT        47
+#define BSD_EADDRINUSE          48
+#define BSD_EADDRNOTAVAIL       49
+#define BSD_ENETUNREACH         51
+#define BSD_ECONNABORTED        53
+#define BSD_ECONNRESET          54
+#define BSD_ENOBUFS             55
+#define BSD_ENOTCONN            57
+#define BSD_ETIMEDOUT           60
+#define BSD_ECONNREFUSED        61
+#define BSD_EHOSTUNREACH        65
+#define BSD_ENOTEMPTY           66
+#define BSD_ENOSYS              78
+
+#define BSD_AF_INET             2
+#define BSD_SOL_SOCKET          0xffff
+#define BSD_SO_REUSEADDR        0x0004
+#define BSD_SO_KEEPALIVE        0x0008
+#define BSD_SO_BROADCAST        0x0020
+#define BSD_SO_LINGER           0x0080
+#define BSD_SO_NOSIGPIPE        0x0800
+#define BSD_SO_SNDBUF           0x1001
+#define BSD_SO_RCVBUF           0x1002
+#define BSD_SO_SNDTIMEO         0x1005
+#define BSD_SO_RCVTIMEO         0x1006
+#define BSD_SO_NBIO             0x1200
+#define BSD_MSG_WAITALL         0x40
+#define BSD_MSG_DONTWAIT        0x80
+
+#define BSD_O_NONBLOCK          0x0004
+#define BSD_O_APPEND            0x0008
+#define BSD_O_CREAT             0x0200
+#define BSD_O_TRUNC             0x0400
+#define BSD_O_EXCL              0x0800
+
+struct bsd_sockaddr_in {
+    uint8_t sin_len;
+    uint8_t sin_family;
+    uint16_t sin_port;
+    uint32_t sin_addr;
+    uint16_t sin_vport;
+    char sin_zero[6];
+};
+
+// the kdebugger structures linux.c fills, mirrored from kdbg.h and proc.h
+struct host_proc_list_entry {
+    char p_comm[32];
+    int pid;
+} __attribute__((packed));
+
+struct host_vm_map_entry {
+    char name[32];
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint16_t prot;
+} __attribute__((packed));
+
+struct host_vm_map_args {
+    struct host_vm_map_entry *maps;
+    uint64_t num;
+} __attribute__((packed));
+
+struct host_proc_info_args {
+    int pid;
+    char name[40];
+    char path[64];
+    char titleid[16];
+    char contentid[64];
+} __attribute__((packed));
+
+struct host_thrinfo_args {
+    uint32_t lwpid;
+    uint32_t priority;
+    char name[32];
+} __attribute__((packed));
+
+struct host_prx_list_args {
+    void *entries;
+    uint64_t num;
+} __attribute__((packed));
+
+struct host_readv_entry {
+    uint64_t address;
+    void *data;
+    uint64_t length;
+    uint64_t n;
+} __attribute__((packed));
+
+struct host_readv_args {
+    struct host_readv_entry *entries;
+    uint64_t num;
+} __attribute__((packed));
+
+// host.c
+int *host_error();
+int host_fail(int err);
+int host_errno_bsd(int err);
+const char *host_path(const char *path, char *buffer);
+
+// linux.c
+int host_signal_linux(int sig);
+int host_signal_bsd(int sig);
+
+#endif
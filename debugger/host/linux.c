@@ -0,0 +1,606 @@
+#include "host.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#define HOST_IOV_MAX            1024
+#define HOST_KINFO_SIZE         1088    // sizeof(struct kinfo_proc) on FreeBSD 9 amd64
+#define HOST_KINFO_STAT         388     // ki_stat
+#define HOST_SRUN               2
+#define HOST_SSTOP              4
+
+// the kdebugger syscalls and commands the debugger issues, see kdbg.h
+#define SYS_WAIT4               7
+#define SYS_PTRACE              26
+#define SYS_KILL                37
+#define SYS_SELECT              93
+#define SYS_PROC_LIST           107
+#define SYS_PROC_RW             108
+#define SYS_PROC_CMD            109
+#define SYS_KERN_BASE           110
+#define SYS_KERN_RW             111
+#define SYS_CONSOLE_CMD         112
+#define SYS_KERN_CMD            115
+#define SYS_WRITEV              121
+#define SYS_SYSCTL              202
+#define SYS_POLL                209
+#define SYS_SDK_CMD             500
+
+#define SYS_PROC_VM_MAP         4
+#define SYS_PROC_INFO           8
+#define SYS_PROC_THRINFO        9
+#define SYS_PROC_PRX_LIST       10
+#define SYS_PROC_READV          11
+
+#define SYS_CONSOLE_CMD_PRINT       2
+#define SYS_CONSOLE_CMD_JAILBREAK   3
+
+// freebsd numbers the signals past the first few differently
+int host_signal_linux(int sig) {
+    switch (sig) {
+        case 10: return SIGBUS;
+        case 12: return SIGSYS;
+        case 16: return SIGURG;
+        case 17: return SIGSTOP;
+        case 18: return SIGTSTP;
+        case 19: return SIGCONT;
+        case 20: return SIGCHLD;
+        case 23: return SIGIO;
+        case 30: return SIGUSR1;
+        case 31: return SIGUSR2;
+        case 7:
+        case 29:
+            return -1;
+    }
+
+    return sig;
+}
+
+int host_signal_bsd(int sig) {
+    switch (sig) {
+        case SIGBUS:  return 10;
+        case SIGSYS:  return 12;
+        case SIGURG:  return 16;
+        case SIGSTOP: return 17;
+        case SIGTSTP: return 18;
+        case SIGCONT: return 19;
+        case SIGCHLD: return 20;
+        case SIGIO:   return 23;
+        case SIGUSR1: return 30;
+        case SIGUSR2: return 31;
+    }
+
+    return sig;
+}
+
+static int host_read_line(const char *path, char *buffer, size_t size) {
+    ssize_t r;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    r = read(fd, buffer, size - 1);
+    close(fd);
+
+    if (r < 0) {
+        return -1;
+    }
+
+    buffer[r] = 0;
+    buffer[strcspn(buffer, "\n")] = 0;
+
+    return 0;
+}
+
+static int host_pid_exists(int pid) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%i", pid);
+    return !access(path, F_OK);
+}
+
+// processes
+static int host_proc_list(struct host_proc_list_entry *procs, uint64_t *num) {
+    struct dirent *entry;
+    char path[64];
+    uint64_t count;
+    DIR *dir;
+
+    dir = opendir("/proc");
+    if (!dir) {
+        return host_fail(errno);
+    }
+
+    count = 0;
+    while ((entry = readdir(dir))) {
+        if (!isdigit((unsigned char)entry->d_name[0])) {
+            continue;
+        }
+
+        if (procs) {
+            // the caller sized its buffer with the first call, processes that came since are left out
+            if (count >= *num) {
+                break;
+            }
+
+            memset(&procs[count], 0, sizeof(struct host_proc_list_entry));
+            procs[count].pid = atoi(entry->d_name);
+
+            snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+            host_read_line(path, procs[count].p_comm, sizeof(procs[count].p_comm));
+        }
+
+        count++;
+    }
+
+    closedir(dir);
+
+    if (procs) {
+        // and the ones that ended leave empty entries, the reply length is already fixed
+        if (count < *num) {
+            memset(&procs[count], 0, (*num - count) * sizeof(struct host_proc_list_entry));
+        }
+    }
+    else {
+        *num = count;
+    }
+
+    return 0;
+}
+
+static ssize_t host_vm_rw(int pid, uint64_t address, void *data, uint64_t length, int write) {
+    struct iovec local;
+    struct iovec remote;
+
+    local.iov_base = data;
+    local.iov_len = length;
+    remote.iov_base = (void *)address;
+    remote.iov_len = length;
+
+    if (write) {
+        return process_vm_writev(pid, &local, 1, &remote, 1, 0);
+    }
+
+    return process_vm_readv(pid, &local, 1, &remote, 1, 0);
+}
+
+// process_vm_writev honours page protection, /proc/pid/mem writes through it like the kernel payload does
+static ssize_t host_mem_write(int pid, uint64_t address, void *data, uint64_t length) {
+    char path[64];
+    ssize_t r;
+    int fd;
+
+    snprintf(path, sizeof(path), "/proc/%i/mem", pid);
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+
+    r = pwrite(fd, data, length, (off_t)address);
+    close(fd);
+
+    return r;
+}
+
+// a fault ends the transfer where it happened, n tells how far it got
+static int host_proc_rw(int pid, uint64_t address, void *data, uint64_t length, uint64_t write, uint64_t *n) {
+    uint64_t done;
+    ssize_t r;
+
+    done = 0;
+    r = length ? host_vm_rw(pid, address, data, length, write) : 0;
+    if (r > 0) {
+        done = r;
+    }
+
+    if (done < length && write && (r >= 0 || errno == EFAULT)) {
+        r = host_mem_write(pid, address + done, (uint8_t *)data + done, length - done);
+        if (r > 0) {
+            done += r;
+        }
+    }
+
+    if (n) {
+        *n = done;
+    }
+
+    if (done < length) {
+        return host_fail(r < 0 ? errno : EFAULT);
+    }
+
+    return 0;
+}
+
+// one process_vm_readv for as many entries as fit, after a fault it picks up with the next entry
+static int host_proc_readv(int pid, struct host_readv_args *args) {
+    struct iovec local[HOST_IOV_MAX];
+    struct iovec remote[HOST_IOV_MAX];
+    uint64_t index[HOST_IOV_MAX];
+    uint64_t i;
+    ssize_t r;
+    int count;
+
+    i = 0;
+    while (i < args->num) {
+        count = 0;
+        for (; i < args->num && count < HOST_IOV_MAX; i++) {
+            struct host_readv_entry *e = &args->entries[i];
+
+            e->n = 0;
+            if (!e->length) {
+                continue;
+            }
+
+            local[count].iov_base = e->data;
+            local[count].iov_len = e->length;
+            remote[count].iov_base = (void *)e->address;
+            remote[count].iov_len = e->length;
+            index[count] = i;
+            count++;
+        }
+
+        if (!count) {
+            break;
+        }
+
+        r = process_vm_readv(pid, local, count, remote, count, 0);
+        if (r < 0) {
+            if (errno == ESRCH || errno == EPERM) {
+                return host_fail(errno);
+            }
+
+            r = 0;
+        }
+
+        for (int k = 0; k < count; k++) {
+            struct host_readv_entry *e = &args->entries[index[k]];
+
+            if ((uint64_t)r >= e->length) {
+                e->n = e->length;
+                r -= e->length;
+                continue;
+            }
+
+            // the transfer stopped inside this entry
+            e->n = r;
+            i = index[k] + 1;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// vm map entries are named after the file they map, the last path component fits the 32 bytes
+static int host_proc_vm_map(int pid, struct host_vm_map_args *args) {
+    char path[64];
+    char *line;
+    size_t size;
+    uint64_t count;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%i/maps", pid);
+
+    f = fopen(path, "r");
+    if (!f) {
+        return host_fail(errno == ENOENT ? ESRCH : errno);
+    }
+
+    line = NULL;
+    size = 0;
+    count = 0;
+    while (getline(&line, &size, f) > 0) {
+        struct host_vm_map_entry *e;
+        unsigned long start, end, offset;
+        char perms[8];
+        int name;
+
+        if (!args->maps) {
+            count++;
+            continue;
+        }
+
+        if (count >= args->num) {
+            break;
+        }
+
+        name = 0;
+        if (sscanf(line, "%lx-%lx %7s %lx %*s %*s %n", &start, &end, perms, &offset, &name) < 4) {
+            continue;
+        }
+
+        e = &args->maps[count++];
+        memset(e, 0, sizeof(*e));
+        e->start = start;
+        e->end = end;
+        e->offset = offset;
+        e->prot = (perms[0] == 'r' ? 1 : 0) | (perms[1] == 'w' ? 2 : 0) | (perms[2] == 'x' ? 4 : 0);
+
+        if (name) {
+            char *s = line + name;
+            char *slash;
+
+            s[strcspn(s, "\n")] = 0;
+            slash = strrchr(s, '/');
+            strncpy(e->name, slash ? slash + 1 : s, sizeof(e->name) - 1);
+        }
+    }
+
+    free(line);
+    fclose(f);
+
+    if (args->maps) {
+        if (count < args->num) {
+            memset(&args->maps[count], 0, (args->num - count) * sizeof(struct host_vm_map_entry));
+        }
+    }
+    else {
+        args->num = count;
+    }
+
+    return 0;
+}
+
+static int host_proc_info(int pid, struct host_proc_info_args *args) {
+    char path[64];
+    ssize_t r;
+
+    memset(args, 0, sizeof(*args));
+    args->pid = pid;
+
+    snprintf(path, sizeof(path), "/proc/%i/comm", pid);
+    if (host_read_line(path, args->name, sizeof(args->name))) {
+        return host_fail(ESRCH);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%i/exe", pid);
+    r = readlink(path, args->path, sizeof(args->path) - 1);
+    if (r > 0) {
+        args->path[r] = 0;
+    }
+
+    return 0;
+}
+
+static int host_proc_thrinfo(int pid, struct host_thrinfo_args *args) {
+    char path[96];
+    char stat[512];
+    char *s;
+    int priority;
+
+    snprintf(path, sizeof(path), "/proc/%i/task/%u/comm", pid, args->lwpid);
+    memset(args->name, 0, sizeof(args->name));
+    if (host_read_line(path, args->name, sizeof(args->name))) {
+        return host_fail(ESRCH);
+    }
+
+    // the priority is the 18th field, counted from after the parenthesised name
+    snprintf(path, sizeof(path), "/proc/%i/task/%u/stat", pid, args->lwpid);
+    args->priority = 0;
+    if (!host_read_line(path, stat, sizeof(stat)) && (s = strrchr(stat, ')'))) {
+        if (sscanf(s + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %d", &priority) == 1) {
+            args->priority = priority;
+        }
+    }
+
+    return 0;
+}
+
+static int host_proc_cmd(int pid, uint64_t cmd, void *data) {
+    if (!host_pid_exists(pid)) {
+        return host_fail(ESRCH);
+    }
+
+    switch (cmd) {
+        case SYS_PROC_VM_MAP:
+            return host_proc_vm_map(pid, (struct host_vm_map_args *)data);
+        case SYS_PROC_INFO:
+            return host_proc_info(pid, (struct host_proc_info_args *)data);
+        case SYS_PROC_THRINFO:
+            return host_proc_thrinfo(pid, (struct host_thrinfo_args *)data);
+        case SYS_PROC_PRX_LIST:
+            // no sce modules here, shared objects are in the vm map
+            ((struct host_prx_list_args *)data)->num = 0;
+            return 0;
+        case SYS_PROC_READV:
+            return host_proc_readv(pid, (struct host_readv_args *)data);
+    }
+
+    // allocating, protecting and calling inside the target needs code running in it
+    return host_fail(ENOSYS);
+}
+
+// kern.proc.pid as state.c reads it, only ki_stat of the kinfo_proc is filled in
+static int host_sysctl_proc(int pid, void *oldp, size_t *oldlenp) {
+    char path[64];
+    char line[512];
+    char *state;
+
+    snprintf(path, sizeof(path), "/proc/%i/stat", pid);
+    if (host_read_line(path, line, sizeof(line)) || !(state = strrchr(line, ')'))) {
+        return host_fail(ESRCH);
+    }
+
+    if (oldp) {
+        if (*oldlenp < HOST_KINFO_SIZE) {
+            return host_fail(ENOMEM);
+        }
+
+        memset(oldp, 0, HOST_KINFO_SIZE);
+        ((uint8_t *)oldp)[HOST_KINFO_STAT] = state[2] == 'T' || state[2] == 't' ? HOST_SSTOP : HOST_SRUN;
+    }
+
+    *oldlenp = HOST_KINFO_SIZE;
+    return 0;
+}
+
+// only the names console.c asks for, truncated to the smallest field it reads them into
+static int host_sysctl(int *mib, uint32_t miblen, void *oldp, size_t *oldlenp) {
+    struct utsname u;
+    const char *s;
+    int value;
+
+    if (miblen == 4 && oldlenp && mib[0] == 1 && mib[1] == 14 && mib[2] == 1) {
+        return host_sysctl_proc(mib[3], oldp, oldlenp);
+    }
+
+    if (miblen != 2 || !oldlenp || uname(&u)) {
+        return host_fail(ENOENT);
+    }
+
+    s = NULL;
+    if (mib[0] == 1 && mib[1] == 1) {
+        s = u.sysname;
+    }
+    else if (mib[0] == 1 && mib[1] == 2) {
+        s = u.release;
+    }
+    else if (mib[0] == 1 && mib[1] == 3) {
+        value = 0;
+    }
+    else if (mib[0] == 1 && mib[1] == 4) {
+        s = u.version;
+    }
+    else if (mib[0] == 6 && mib[1] == 2) {
+        s = u.machine;
+    }
+    else if (mib[0] == 6 && mib[1] == 3) {
+        value = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    else {
+        return host_fail(ENOENT);
+    }
+
+    if (s) {
+        size_t len = strnlen(s, 49) + 1;
+
+        if (oldp) {
+            if (*oldlenp < len) {
+                len = *oldlenp;
+            }
+
+            memcpy(oldp, s, len);
+            ((char *)oldp)[len - 1] = 0;
+        }
+
+        *oldlenp = len;
+        return 0;
+    }
+
+    if (oldp) {
+        if (*oldlenp < sizeof(int)) {
+            return host_fail(ENOMEM);
+        }
+
+        memcpy(oldp, &value, sizeof(int));
+    }
+
+    *oldlenp = sizeof(int);
+    return 0;
+}
+
+static int host_wait4(int pid, int *status, int options, struct rusage *rusage) {
+    int s;
+    int r;
+
+    r = wait4(pid, &s, options, rusage);
+    if (r < 0) {
+        return host_fail(errno);
+    }
+
+    // the layout matches, only the signal inside needs renumbering
+    if (status) {
+        if (r && WIFSTOPPED(s)) {
+            s = (host_signal_bsd(WSTOPSIG(s)) << 8) | 0x7F;
+        }
+        else if (r && WIFSIGNALED(s)) {
+            s = (s & ~0x7F) | host_signal_bsd(WTERMSIG(s));
+        }
+
+        *status = s;
+    }
+
+    return r;
+}
+
+unsigned long ps4_syscall(unsigned long n, ...) {
+    uint64_t a[6];
+    va_list args;
+    long r;
+
+    va_start(args, n);
+    for (int i = 0; i < 6; i++) {
+        a[i] = va_arg(args, uint64_t);
+    }
+    va_end(args);
+
+    switch (n) {
+        case SYS_WAIT4:
+            return host_wait4(a[0], (int *)a[1], a[2], (struct rusage *)a[3]);
+        case SYS_KILL: {
+            int sig = host_signal_linux(a[1]);
+            if (sig < 0) {
+                return host_fail(EINVAL);
+            }
+
+            return kill(a[0], sig) ? host_fail(errno) : 0;
+        }
+        case SYS_SELECT:
+            r = select(a[0], (fd_set *)a[1], (fd_set *)a[2], (fd_set *)a[3], (struct timeval *)a[4]);
+            return r < 0 ? host_fail(errno) : r;
+        case SYS_WRITEV:
+            r = writev(a[0], (struct iovec *)a[1], a[2]);
+            return r < 0 ? host_fail(errno) : r;
+        case SYS_POLL:
+            r = poll((struct pollfd *)a[0], a[1], a[2]);
+            return r < 0 ? host_fail(errno) : r;
+        case SYS_SYSCTL:
+            return host_sysctl((int *)a[0], a[1], (void *)a[2], (size_t *)a[3]);
+        case SYS_PROC_LIST:
+            return host_proc_list((struct host_proc_list_entry *)a[0], (uint64_t *)a[1]);
+        case SYS_PROC_RW:
+            return host_proc_rw(a[0], a[1], (void *)a[2], a[3], a[4], (uint64_t *)a[5]);
+        case SYS_PROC_CMD:
+            return host_proc_cmd(a[0], a[1], (void *)a[2]);
+        case SYS_CONSOLE_CMD:
+            if (a[0] == SYS_CONSOLE_CMD_PRINT) {
+                fprintf(stderr, "%s\n", (char *)a[1]);
+                return 0;
+            }
+
+            // already as jailbroken as we get
+            if (a[0] == SYS_CONSOLE_CMD_JAILBREAK) {
+                return 0;
+            }
+
+            return host_fail(ENOSYS);
+        case SYS_PTRACE:
+            // freebsd and linux ptrace differ in threads, register layouts and requests, the debugger stays console only
+        case SYS_KERN_BASE:
+        case SYS_KERN_RW:
+        case SYS_KERN_CMD:
+        case SYS_SDK_CMD:
+            return host_fail(ENOSYS);
+    }
+
+    fprintf(stderr, "[host] syscall %lu is not supported\n", n);
+    return host_fail(ENOSYS);
+}
@@ -0,0 +1,55 @@
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "pool.h"
+
+// methods a client can ask for with CMD_COMPRESS
+#define COMPRESS_LZ4            (1 << 0) // memory chunks
+#define COMPRESS_DELTA          (1 << 1) // sorted address lists
+#define COMPRESS_SUPPORTED      (COMPRESS_LZ4 | COMPRESS_DELTA)
+
+// method of a single frame
+#define COMPRESS_METHOD_NONE    0
+#define COMPRESS_METHOD_LZ4     1
+#define COMPRESS_METHOD_DELTA   2
+
+#define COMPRESS_HASH_LOG       12
+// room for lz4 on incompressible input and for 10 byte varints of 8 byte addresses
+#define COMPRESS_BOUND(length)  ((length) + (length) / 4 + 64)
+
+struct cmd_compress_packet {
+    uint32_t methods;
+} __attribute__((packed));
+
+struct cmd_compress_response {
+    uint32_t methods; // what the server agreed to use
+} __attribute__((packed));
+#define CMD_COMPRESS_RESPONSE_SIZE 4
+
+// once negotiated, every chunk of a bulk read is sent as a frame header and size bytes
+struct compress_frame_header {
+    uint32_t length; // decoded length
+    uint32_t size;
+    uint8_t method;
+} __attribute__((packed));
+#define COMPRESS_FRAME_HEADER_SIZE 9
+
+struct compress_ctx {
+    struct buffer_pool *pool;
+    uint32_t methods;
+    uint8_t *out;
+    uint32_t *table;
+};
+
+uint32_t lz4_compress(const uint8_t *src, uint32_t length, uint8_t *dst, uint32_t capacity, uint32_t *table);
+uint32_t delta_compress(const uint64_t *src, uint32_t count, uint8_t *dst, uint32_t capacity);
+
+struct compress_ctx *compress_alloc(int fd);
+void compress_free(struct compress_ctx *ctx);
+int compress_send_chunk(int fd, struct compress_ctx *ctx, void *data, uint32_t length, int method);
+int compress_handle(int fd, struct cmd_packet *packet);
+
+#endif
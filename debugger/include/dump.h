@@ -0,0 +1,55 @@
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#include <ps4.h>
+#include <elf64.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+#include "debug.h"
+
+#define DUMP_NOTE_NAME          "FreeBSD"
+#define DUMP_NOTE_FRAME4        "Frame4"
+#define DUMP_NT_MAPS            0x4601  // proc_vm_map_entry for every PT_LOAD, in the same order
+#define DUMP_NT_PRXLIST         0x4602  // prx_list_entry array
+#define DUMP_PAGE               0x1000
+
+struct cmd_proc_dump_packet {
+    uint32_t pid;
+    uint64_t offset; // resume the image from here
+} __attribute__((packed));
+
+// followed by the image from offset to size, in chunks of at most NET_MAX_LENGTH
+// (compressed frames if the client asked for them)
+struct cmd_proc_dump_response {
+    uint64_t size;
+    uint64_t layout; // hash of the elf headers and notes, a resume is only valid if it did not change
+} __attribute__((packed));
+#define CMD_PROC_DUMP_RESPONSE_SIZE 16
+
+// same layout as the FreeBSD prstatus_t core note
+struct dump_prstatus {
+    int32_t pr_version;
+    uint64_t pr_statussz;
+    uint64_t pr_gregsetsz;
+    uint64_t pr_fpregsetsz;
+    int32_t pr_osreldate;
+    int32_t pr_cursig;
+    int32_t pr_pid;
+    struct __reg64 pr_reg;
+};
+
+struct dump_image {
+    uint32_t pid;
+    struct proc_vm_map_entry *maps;
+    uint64_t num;
+    uint8_t *header;    // elf header, program headers and notes
+    uint64_t headersize;
+    uint64_t dataoffset;
+    uint64_t size;
+    struct proc_vm_map_cache cache;
+};
+
+int proc_dump_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+#define HASH_DEFAULT_BLOCK  0x1000
+#define HASH_MIN_BLOCK      0x100
+
+// length 0 hashes every readable map entry of the process
+struct cmd_proc_hash_packet {
+    uint32_t pid;
+    uint64_t address;
+    uint64_t length;
+    uint32_t block;  // power of two, 0 for a page
+} __attribute__((packed));
+
+// every region is sent as this header followed by count xxh64 (seed 0) hashes, one per block
+// a region with length 0 ends the reply
+struct proc_hash_region {
+    uint64_t address;
+    uint64_t length;
+    uint32_t count;
+} __attribute__((packed));
+#define PROC_HASH_REGION_SIZE 20
+
+uint64_t xxh64(const uint8_t *data, uint64_t length, uint64_t seed);
+int proc_hash_handle(int fd, struct cmd_packet *packet);
+
+#endif
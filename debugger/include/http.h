@@ -0,0 +1,72 @@
+#ifndef _HTTP_H
+#define _HTTP_H
+
+#include <ps4.h>
+#include <stdbool.h>
+#include "protocol.h"
+#include "net.h"
+
+#define HTTP_SERVER_PORT        2812
+#define HTTP_MAX_CONNS          32
+#define HTTP_WORKERS            4
+#define HTTP_BUFFER_SIZE        0x10000     // request head and any body that fits
+#define HTTP_MAX_BODY           0x4000000   // 64MB, larger bodies are read by the handler as it goes
+#define HTTP_MAX_HEAD           0x2000
+#define HTTP_IDLE_TIMEOUT       15000       // ms a keep-alive connection may sit idle
+#define HTTP_READ_TIMEOUT       5000        // ms to finish a request that started arriving
+#define HTTP_BATCH_MAX          4096
+#define HTTP_BATCH_MAX_LENGTH   0x4000000   // 64MB in one batched read
+
+#define HTTP_CONN_FREE          0
+#define HTTP_CONN_IDLE          1           // watched by the accept loop
+#define HTTP_CONN_QUEUED        2
+#define HTTP_CONN_BUSY          3           // a worker serves it
+
+struct http_conn {
+    int fd;
+    int state;
+    uint64_t last;  // process time of the last request
+    char *buffer;
+    uint32_t used;
+};
+
+struct ws_client;
+
+struct http_request {
+    int fd;
+    struct http_conn *conn;
+    char *method;
+    char *path;
+    char *query;     // without the '?', empty if there is none
+    char *range;     // value of the Range header, NULL without one
+    char *body;      // the part of the body in the connection buffer
+    uint64_t length; // of the body
+    uint32_t buffered;
+    uint64_t consumed;
+    int keepalive;
+    int http10;      // no chunked responses
+    int upgrade;     // Upgrade: websocket
+    char *wskey;     // Sec-WebSocket-Key
+    struct ws_client *ws; // set once the connection was handed to the WebSocket thread
+};
+
+// body of POST /memory/batch, answered with the bytes of every range one after the other
+struct http_batch_range {
+    uint64_t address;
+    uint32_t length;
+} __attribute__((packed));
+#define HTTP_BATCH_RANGE_SIZE 12
+
+void http_init();
+const char *http_reason(int status);
+int http_hex(char c);
+int http_query(struct http_request *req, const char *key, char *value, uint32_t size);
+uint64_t http_query_u64(struct http_request *req, const char *key, int base, uint64_t def);
+void http_send_head(struct http_request *req, int status, const char *type, uint64_t length, const char *extra);
+void http_send(struct http_request *req, int status, const char *type, const void *data, uint32_t length);
+int http_read_body(struct http_request *req, void *data, uint32_t length);
+int http_range(struct http_request *req, uint64_t size, uint64_t *start, uint64_t *end);
+void handle_web_client(struct http_request *req);
+int start_http();
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef _JOB_H
+#define _JOB_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+
+#define JOB_MAX             NET_MAX_VFD
+#define JOB_MAX_PER_CLIENT  8
+#define JOB_WORKERS         2
+#define JOB_MAX_INPUT       0x1000000   // 16MB, large enough for an elf
+#define JOB_MAX_RESULT      0x4000000   // 64MB of captured output
+
+// queued jobs of a higher priority always start first
+#define JOB_PRIORITY_HIGH   0
+#define JOB_PRIORITY_NORMAL 1
+#define JOB_PRIORITY_LOW    2
+#define JOB_PRIORITIES      3
+
+#define JOB_STATE_FREE      0
+#define JOB_STATE_QUEUED    1
+#define JOB_STATE_RUNNING   2
+#define JOB_STATE_DONE      3
+#define JOB_STATE_FAILED    4   // the handler failed or the result did not fit
+#define JOB_STATE_CANCELLED 5   // still running, released as soon as its worker stops
+
+// followed by datalen bytes of the command's own packet data and then inputlen bytes
+// of whatever the command would receive after its first status
+struct cmd_job_submit_packet {
+    uint32_t cmd;
+    uint32_t priority;
+    uint32_t datalen;
+    uint32_t inputlen;
+} __attribute__((packed));
+#define CMD_JOB_SUBMIT_PACKET_SIZE 16
+
+struct cmd_job_submit_response {
+    uint32_t id;
+} __attribute__((packed));
+#define CMD_JOB_SUBMIT_RESPONSE_SIZE 4
+
+struct cmd_job_status_packet {
+    uint32_t id;
+} __attribute__((packed));
+
+struct cmd_job_status_response {
+    uint32_t state;
+    uint32_t cmd;
+    uint64_t length; // bytes of the result so far
+} __attribute__((packed));
+#define CMD_JOB_STATUS_RESPONSE_SIZE 16
+
+// stops and releases a queued or running job, a finished job is released with its result
+// a running job is released by its worker once it stops, no second cancel is needed
+struct cmd_job_cancel_packet {
+    uint32_t id;
+} __attribute__((packed));
+
+// the result is the exact byte stream the command would have sent on the connection
+// answered with a uint32_t length and that many bytes once the job has finished
+struct cmd_job_fetch_packet {
+    uint32_t id;
+    uint64_t offset;
+    uint32_t length;
+} __attribute__((packed));
+
+struct job {
+    uint32_t id;
+    int state;
+    uint32_t cmd;
+    uint32_t priority;
+    int serial;
+    struct server_client *svc;
+    uint64_t seq;
+    int fd;
+    uint8_t *input;
+    struct cmd_packet packet;
+    struct net_capture capture;
+};
+
+void job_init();
+void job_remove_client(struct server_client *svc);
+int job_submit_handle(int fd, struct cmd_packet *packet);
+int job_status_handle(int fd, struct cmd_packet *packet);
+int job_cancel_handle(int fd, struct cmd_packet *packet);
+int job_fetch_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <ps4.h>
+#include <stdbool.h>
+#include "protocol.h"
+#include "net.h"
+#include "http.h"
+
+#define JSON_BUFFER_SIZE    0x1000  // output is flushed as a chunk whenever this fills up
+#define JSON_MAX_DEPTH      16
+
+// streams a json response with chunked transfer encoding, http/1.0 clients get it unframed and the connection closes
+struct json_writer {
+    struct http_request *req;
+    int chunked;
+    int failed;                     // the socket failed, the rest is dropped
+    uint32_t depth;
+    uint8_t first[JSON_MAX_DEPTH];  // nothing written on this level yet
+    int key;                        // a key was written, its value follows without a comma
+    char head[256];
+    uint32_t headlength;            // response head not sent yet
+    uint32_t used;
+    char buffer[JSON_BUFFER_SIZE];
+};
+
+void json_begin_type(struct json_writer *w, struct http_request *req, int status, const char *type);
+void json_begin(struct json_writer *w, struct http_request *req, int status);
+void json_end(struct json_writer *w);
+void json_write(struct json_writer *w, const char *data, uint32_t length);
+void json_object_begin(struct json_writer *w);
+void json_object_end(struct json_writer *w);
+void json_array_begin(struct json_writer *w);
+void json_array_end(struct json_writer *w);
+void json_key(struct json_writer *w, const char *name);
+void json_string(struct json_writer *w, const char *s);
+void json_string_begin(struct json_writer *w);
+void json_string_end(struct json_writer *w);
+void json_int(struct json_writer *w, int64_t v);
+void json_hex(struct json_writer *w, uint64_t v);
+void json_bool(struct json_writer *w, bool v);
+
+void json_message(struct http_request *req, int status, const char *message);
+void json_success(struct http_request *req);
+
+#endif
@@ -17,6 +17,7 @@ int sys_proc_list(struct proc_list_entry *procs, uint64_t *num);
 
 // custom syscall 108
 int sys_proc_rw(uint64_t pid, uint64_t address, void *data, uint64_t length, uint64_t write);
+int sys_proc_rw_n(uint64_t pid, uint64_t address, void *data, uint64_t length, uint64_t write, uint64_t *n);
 
 // custom syscall 109
 #define SYS_PROC_ALLOC      1
@@ -29,6 +30,7 @@ int sys_proc_rw(uint64_t pid, uint64_t address, void *data, uint64_t length, uin
 #define SYS_PROC_INFO       8
 #define SYS_PROC_THRINFO    9
 #define SYS_PROC_PRX_LIST   10
+#define SYS_PROC_READV      11
 struct sys_proc_alloc_args {
     uint64_t address;
     uint64_t length;
@@ -89,6 +91,16 @@ struct sys_proc_prx_list_args {
     struct prx_list_entry *entries;
     uint64_t num;
 } __attribute__((packed));
+struct proc_readv_entry {
+    uint64_t address;
+    void *data;
+    uint64_t length;
+    uint64_t n; // bytes actually read
+} __attribute__((packed));
+struct sys_proc_readv_args {
+    struct proc_readv_entry *entries;
+    uint64_t num;
+} __attribute__((packed));
 int sys_proc_cmd(uint64_t pid, uint64_t cmd, void *data);
 
 // custom syscall 110
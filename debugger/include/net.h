@@ -5,6 +5,13 @@
 #include "errno.h"
 
 #define NET_MAX_LENGTH  0x20000     // 128KB buffer
+#define NET_MAX_IOV     16
+#define NET_POLL_WAIT   100         // ms a single wait for the socket may take
+#define NET_DEADLINE    30000       // ms a transfer may go without progress before it is dropped
+#define NET_CORK_SIZE   0x1000      // small replies are gathered into one segment
+#define NET_VFD_BASE    0x10000     // virtual sockets, above every real descriptor
+#define NET_MAX_VFD     32
+#define NET_CAPTURE_MIN 0x10000
 
 #define SO_USELOOPBACK  0x0040      // bypass hardware when possible
 #define SO_LINGER       0x0080      // linger on close if data present
@@ -36,11 +43,64 @@ typedef struct {
 #define FD_CLR(d, s)    ((s)->fds_bits[(d)/(8*sizeof(long))] &= ~(1UL<<((d)%(8*sizeof(long)))))
 #define FD_ISSET(d, s)  !!((s)->fds_bits[(d)/(8*sizeof(long))] & (1UL<<((d)%(8*sizeof(long)))))
 
+struct pollfd {
+    int fd;
+    short events;
+    short revents;
+};
+
+#define POLLIN          0x0001
+#define POLLOUT         0x0004
+#define POLLERR         0x0008
+#define POLLHUP         0x0010
+
+// sends on a corked socket are buffered until net_flush, a receive or a send that does not fit
+struct net_cork {
+    uint8_t buffer[NET_CORK_SIZE];
+    uint32_t used;
+};
+
+// a virtual socket reads its input from memory and captures everything sent to it
+struct net_capture {
+    uint8_t *in;
+    uint32_t inlength;
+    uint32_t inpos;
+    uint8_t *out;
+    uint64_t outlength;
+    uint64_t outcap;
+    uint64_t outmax;
+    volatile int cancel;
+    int overflow;
+};
+
+// status and payload of a reply, sent with a single writev
+struct net_response {
+    uint32_t status;
+    struct iovec iov[NET_MAX_IOV];
+    int count;
+};
+
 int net_select(int fd, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+int net_poll(struct pollfd *fds, unsigned int nfds, int timeout);
 
+void net_set_deadline(int fd, uint32_t deadline);
+int net_wait(int fd, short events, uint64_t *stalled);
+void net_cork(int fd, struct net_cork *cork);
+int net_uncork(int fd);
+int net_flush(int fd);
+int net_capture_open(struct net_capture *cap);
+void net_capture_close(int fd);
+int net_cancelled(int fd);
 int net_send_data(int fd, void *data, int length);
+int net_send_datav(int fd, struct iovec *iov, int iovcnt);
 int net_recv_data(int fd, void *data, int length, int force);
 int net_send_status(int fd, uint32_t status);
+
+void net_response_init(struct net_response *resp, uint32_t status);
+int net_response_add(struct net_response *resp, void *data, uint32_t length);
+int net_response_send(int fd, struct net_response *resp);
+int net_send_response(int fd, uint32_t status, void *data, uint32_t length);
+
 int fd_printf(int fd, const char *format, ...);
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <ps4.h>
+#include "kdbg.h"
+
+// every client keeps a few prefaulted buffers of each size class around between commands
+#define POOL_CLASSES        6
+#define POOL_CACHE          2
+#define POOL_MAGIC          0x504F4F4C
+#define POOL_OVERSIZE       0xFFFFFFFF  // larger than every class or allocated without a pool
+
+// stored in front of every pool buffer
+struct pool_header {
+    uint32_t magic;
+    uint32_t cls;
+    uint64_t size;
+} __attribute__((packed));
+#define POOL_HEADER_SIZE 16
+
+struct buffer_pool {
+    void *cache[POOL_CLASSES][POOL_CACHE];
+    uint32_t count[POOL_CLASSES];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t oversize;
+};
+
+struct cmd_pool_stats_response {
+    uint64_t hits;     // served from a cached buffer
+    uint64_t misses;   // allocated and prefaulted
+    uint64_t oversize; // larger than the biggest class
+    uint32_t cached;   // bytes currently held by the pool
+} __attribute__((packed));
+#define CMD_POOL_STATS_RESPONSE_SIZE 28
+
+void *pool_get(struct buffer_pool *pool, size_t size);
+void pool_put(struct buffer_pool *pool, void *p);
+void pool_destroy(struct buffer_pool *pool);
+
+void *pool_alloc(int fd, size_t size);
+void pool_free(int fd, void *p);
+
+struct cmd_packet;
+int pool_stats_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -14,6 +14,57 @@ struct proc_vm_map_entry {
     uint16_t prot;
 } __attribute__((packed));
 
+// step used to skip over a faulting page inside a readable map entry
+#define PROC_READ_FAULT_STEP        0x1000
+// worst case number of readable ranges inside a read of length bytes
+#define PROC_READ_MAX_RANGES(length) ((length) / PROC_READ_FAULT_STEP + 2)
+
+// vm map of the target, only fetched once a read actually faults
+struct proc_vm_map_cache {
+    struct proc_vm_map_entry *maps;
+    uint64_t num;
+    int loaded;
+};
+
+int proc_get_vm_map(uint32_t pid, struct proc_vm_map_entry **maps, uint64_t *num);
+void proc_vm_map_cache_free(struct proc_vm_map_cache *cache);
+uint32_t proc_read_valid(uint32_t pid, uint64_t address, uint8_t *data, uint32_t length, struct proc_vm_map_cache *cache, struct cmd_proc_read_range *ranges, uint32_t *count);
+
+// a pointer path read by proc_read_paths, same semantics as CMD_PROC_PTR_GATHER
+#define PROC_PATHS_BATCH 64
+struct proc_path {
+    uint64_t address;
+    uint32_t length;
+    uint32_t depth;
+    int64_t offsets[PROC_PTR_MAX_DEPTH];
+    void *data;        // receives length bytes
+    uint64_t resolved; // final address
+    uint64_t pointer;
+    uint32_t failed;   // 0, or 1 + the level that failed (depth + 1 for the final read)
+};
+
+// sections the scanner keeps in /data/scan_temp/{init,cur,old}/<fileId>, start is 0 once nothing was found in it
+struct saved_section {
+    uint64_t start;
+    uint64_t end;
+    int fileId;
+};
+
+struct saved_section_list {
+    struct saved_section *sections;
+    uint64_t count;
+};
+
+extern struct saved_section_list savedSectionList;
+extern ScePthreadMutex scan_mutex;
+
+void proc_scan_init();
+
+size_t proc_scan_getSizeOfValueType(cmd_proc_scan_valuetype valType);
+bool proc_scan_compareValues(cmd_proc_scan_comparetype cmpType, cmd_proc_scan_valuetype valType, size_t valTypeLength, unsigned char *pScanValue, unsigned char *pMemoryValue, unsigned char *pExtraValue);
+void proc_read_paths(uint32_t pid, struct proc_path **paths, int count);
+void proc_view_free_all(struct proc_view *views);
+
 int proc_handle(int fd, struct cmd_packet *packet);
 
 #endif
@@ -4,11 +4,25 @@
 #include <ps4.h>
 #include "errno.h"
 #include "kdbg.h"
+#include "net.h"
+#include "pool.h"
 
 #define PACKET_VERSION              "0.2.14"
 #define PACKET_MAGIC                0xFFAABBCC
 
 #define CMD_VERSION                 0xBD000001
+#define CMD_COMPRESS                0xBD000002
+#define CMD_POOL_STATS              0xBD000003
+#define CMD_JOB_SUBMIT              0xBD000004
+#define CMD_JOB_STATUS              0xBD000005
+#define CMD_JOB_CANCEL              0xBD000006
+#define CMD_JOB_FETCH               0xBD000007
+#define CMD_QOS_STATS               0xBD000008
+#define CMD_SERVER_STATS            0xBD000009
+#define CMD_TRACE_START             0xBD00000A
+#define CMD_TRACE_STOP              0xBD00000B
+#define CMD_TRACE_DUMP              0xBD00000C
+#define CMD_QOS_WEIGHT              0xBD00000D
 #define CMD_UNLOAD                  0xBD0000FF
 
 #define CMD_PROC_LIST               0xBDAA0001
@@ -29,9 +43,33 @@
 #define CMD_PROC_PRX_UNLOAD         0xBDAA0010
 #define CMD_PROC_PRX_LIST           0xBDAA0011
 #define CMD_PROC_AOB                0xBDAA0012
+#define CMD_PROC_READ_VALID         0xBDAA0013
+#define CMD_PROC_PTR_GATHER         0xBDAA0014
+#define CMD_PROC_VIEW_OPEN          0xBDAA0015
+#define CMD_PROC_VIEW_REFRESH       0xBDAA0016
+#define CMD_PROC_VIEW_CLOSE         0xBDAA0017
+#define CMD_PROC_SUB_ADD            0xBDAA0018
+#define CMD_PROC_SUB_REMOVE         0xBDAA0019
+#define CMD_PROC_RECORD_START       0xBDAA001A
+#define CMD_PROC_RECORD_STOP        0xBDAA001B
+#define CMD_PROC_RECORD_QUERY       0xBDAA001C
+#define CMD_PROC_TRANSFER           0xBDAA001D
+#define CMD_PROC_TRANSFER_ATTACH    0xBDAA001E
+#define CMD_PROC_DUMP               0xBDAA001F
+#define CMD_PROC_HASH               0xBDAA0020
+#define CMD_PROC_SNAP_TAKE          0xBDAA0021
+#define CMD_PROC_SNAP_DIFF          0xBDAA0022
+#define CMD_PROC_SNAP_DELETE        0xBDAA0023
+#define CMD_PROC_STATE_SAVE         0xBDAA0024
+#define CMD_PROC_STATE_RESTORE      0xBDAA0025
+#define CMD_PROC_STATE_DELETE       0xBDAA0026
 
 #define SCAN_MAX_LENGTH             0x80000 // 512KB
 #define PROC_AOB_SCAN_BUFFER_LEN    0x80000 // 512KB
+#define PROC_PTR_MAX_PATHS          1024
+#define PROC_PTR_MAX_DEPTH          16
+#define PROC_VIEW_MAX_LENGTH        0x10000 // 64KB
+#define PROC_VIEW_LINE              64
 
 #define CMD_DEBUG_ATTACH            0xBDBB0001
 #define CMD_DEBUG_DETACH            0xBDBB0002
@@ -247,6 +285,73 @@ struct cmd_proc_aob_packet {
 } __attribute__((packed));
 
 
+// proc - read valid
+struct cmd_proc_read_valid_packet {
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+} __attribute__((packed));
+struct cmd_proc_read_range {
+    uint64_t address;
+    uint32_t length;
+} __attribute__((packed));
+#define CMD_PROC_READ_RANGE_SIZE 12
+
+// proc - pointer gather
+// a path resolves [[[base + prx text] + offsets[0]] + offsets[1]] ... and then reads length bytes
+// e.g. [[[base+0x10]+0x48]+0x8] is base = base+0x10, offsets = { 0x48, 0x8 }
+struct cmd_proc_ptr_gather_packet {
+    uint32_t pid;
+    uint32_t count;  // number of paths
+    uint32_t length; // size of the path list sent after the first status
+} __attribute__((packed));
+struct cmd_proc_ptr_path {
+    uint32_t prx_handle; // 0 if base is an absolute address
+    uint64_t base;
+    uint32_t length;     // bytes read at the end of the path
+    uint32_t depth;      // number of int64_t offsets that follow
+} __attribute__((packed));
+#define CMD_PROC_PTR_PATH_SIZE 20
+// one per path, followed by length bytes of value (zeroed if the path failed)
+struct cmd_proc_ptr_result {
+    uint64_t address; // final address, or the address that could not be read
+    uint32_t failed;  // PROC_PTR_RESOLVED, or the level that failed (depth means the final read)
+} __attribute__((packed));
+#define CMD_PROC_PTR_RESULT_SIZE 12
+#define PROC_PTR_RESOLVED 0xFFFFFFFF
+
+// proc - view
+struct cmd_proc_view_open_packet {
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+} __attribute__((packed));
+// followed by the full image of the view
+struct cmd_proc_view_open_response {
+    uint32_t id;
+} __attribute__((packed));
+#define CMD_PROC_VIEW_OPEN_RESPONSE_SIZE 4
+
+struct cmd_proc_view_refresh_packet {
+    uint32_t id;
+} __attribute__((packed));
+// followed by length bytes of runs, each a cmd_proc_view_run and its new bytes
+struct cmd_proc_view_refresh_response {
+    uint32_t runs;
+    uint32_t length;
+} __attribute__((packed));
+#define CMD_PROC_VIEW_REFRESH_RESPONSE_SIZE 8
+struct cmd_proc_view_run {
+    uint32_t offset;
+    uint32_t length;
+} __attribute__((packed));
+#define CMD_PROC_VIEW_RUN_SIZE 8
+
+struct cmd_proc_view_close_packet {
+    uint32_t id;
+} __attribute__((packed));
+
+
 
 // debug
 struct cmd_debug_attach_packet {
@@ -324,12 +429,31 @@ struct debug_context {
     } watchdata;
 };
 
+#define MAX_VIEWS 8
+
+// last image sent to the client for a view, refreshes only send what changed since
+struct proc_view {
+    uint32_t id;
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+    uint8_t *image; // what the client has
+    uint8_t *next;  // fresh read, swapped with image after encoding
+    uint8_t *delta; // encoded runs
+};
+
 struct server_client {
     int id;
     int fd;
     int debugging;
     struct sockaddr_in client;
     struct debug_context dbgctx;
+    struct proc_view views[MAX_VIEWS];
+    uint32_t compress;
+    struct net_cork cork;
+    struct buffer_pool pool;
+    int qos;
+    uint32_t weight; // bulk quanta per turn, 0 until CMD_QOS_WEIGHT
 };
 
 struct uart_server_client {
@@ -0,0 +1,61 @@
+#ifndef _QOS_H
+#define _QOS_H
+
+#include <ps4.h>
+#include "protocol.h"
+
+#define QOS_CLASS_INTERACTIVE   0
+#define QOS_CLASS_BULK          1
+#define QOS_CLASSES             2
+
+#define QOS_INTERACTIVE_LENGTH  0x1000  // reads and writes up to a page are latency sensitive
+#define QOS_WAIT_SLEEP          100     // us between two looks at the bulk slot
+#define QOS_MAX_DEFER           8000    // us a bulk quantum may be held back, so bulk keeps a share
+#define QOS_MAX_HOLD            50000   // us a stream may keep the bulk slot before the next one takes it over
+#define QOS_MAX_STREAMS         48      // a bulk stream for every client and every job
+#define QOS_DEFAULT_WEIGHT      1
+#define QOS_MAX_WEIGHT          16
+#define QOS_BUCKETS             24      // bucket n counts latencies below 2^(n+1) us
+
+struct qos_class_stats {
+    uint64_t count;
+    uint64_t total;   // us
+    uint64_t max;     // us
+    uint32_t buckets[QOS_BUCKETS];
+} __attribute__((packed));
+#define QOS_CLASS_STATS_SIZE 120
+
+// bulk quanta the client's streams get per turn, QOS_DEFAULT_WEIGHT until set
+struct cmd_qos_weight_packet {
+    uint32_t weight;
+} __attribute__((packed));
+
+/*
+ * Bulk streams send one quantum (a chunk of at most NET_MAX_LENGTH) at a time.
+ * The stream holding the bulk slot gives it back with its next qos_quantum or when its
+ * command ends, and the slot goes round the waiting streams by deficit round robin, so a
+ * stream sends as many quanta in a row as its weight.
+ */
+struct qos_stream {
+    int used;
+    int fd;
+    int waiting;
+    uint32_t weight;
+    uint32_t deficit;
+    uint64_t since; // us, when it started waiting
+};
+
+struct cmd_qos_stats_response {
+    struct qos_class_stats classes[QOS_CLASSES];
+} __attribute__((packed));
+#define CMD_QOS_STATS_RESPONSE_SIZE (QOS_CLASS_STATS_SIZE * QOS_CLASSES)
+
+void qos_init();
+int qos_classify(int fd, struct cmd_packet *packet);
+void qos_begin(int fd, int cls);
+void qos_end(int fd, int cls, uint64_t start);
+void qos_quantum(int fd);
+int qos_weight_handle(int fd, struct cmd_packet *packet);
+int qos_stats_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+#define RECORD_MAX_CHANNELS     16
+#define RECORD_MIN_PERIOD       1000        // 1ms, 1kHz
+#define RECORD_BLOCK_SAMPLES    512
+#ifndef RECORD_RING_SIZE
+#define RECORD_RING_SIZE        0x400000    // 4MB, has to hold the largest block
+#endif
+#define RECORD_MAX_BLOCKS       1024
+#define RECORD_MAX_ENCODED      10          // longest varint, also covers a xor encoded value
+
+struct cmd_proc_record_start_packet {
+    uint32_t pid;
+    uint32_t period; // microseconds
+    uint32_t count;  // number of channels
+    uint32_t length; // size of the channel list sent after the first status
+} __attribute__((packed));
+
+// followed by depth int64_t offsets, same as CMD_PROC_PTR_GATHER
+struct cmd_proc_record_channel {
+    uint64_t address;
+    uint8_t type;    // cmd_proc_scan_valuetype, scalar types only
+    uint32_t depth;
+} __attribute__((packed));
+#define CMD_PROC_RECORD_CHANNEL_SIZE 13
+
+struct cmd_proc_record_stop_response {
+    uint64_t samples;
+    uint64_t failed; // channel reads that failed and repeated the last value
+} __attribute__((packed));
+#define CMD_PROC_RECORD_STOP_RESPONSE_SIZE 16
+
+// answered with a uint32_t length and a block for every block in the range, ended by a length of 0
+struct cmd_proc_record_query_packet {
+    uint64_t start;
+    uint64_t end;
+} __attribute__((packed));
+
+/*
+ * Every block is self contained and stored columnar:
+ *   record_block_header
+ *   uint32_t lengths[channels + 1]   (timestamps first, then every channel)
+ *   the column streams
+ *
+ * Timestamps and integers are delta-of-delta values as zigzag varints.
+ * Floats and doubles are xor'd with the previous value: 0x00 means unchanged,
+ * otherwise 0x40 | (leading zero bytes << 3) | trailing zero bytes followed
+ * by the remaining bytes, least significant first.
+ */
+struct record_block_header {
+    uint64_t first; // process time of the first sample in microseconds
+    uint64_t last;
+    uint32_t samples;
+    uint32_t channels;
+} __attribute__((packed));
+#define RECORD_BLOCK_HEADER_SIZE 24
+
+struct record_column {
+    uint64_t prev;
+    int64_t prevdelta;
+    uint8_t *stream;
+    uint32_t used;
+};
+
+struct record_channel {
+    uint8_t type;
+    uint8_t value[8];
+    struct proc_path path;
+    struct record_column column;
+};
+
+struct record_block_entry {
+    uint64_t seq;
+    uint64_t first;
+    uint64_t last;
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct recorder {
+    int running;
+    uint32_t generation;
+    uint32_t pid;
+    uint32_t period;
+    uint32_t count;
+    struct record_channel channels[RECORD_MAX_CHANNELS];
+    struct record_column time;
+    uint8_t *staging;
+    uint32_t samples;
+    uint64_t first;
+    uint64_t last;
+    uint8_t *ring;
+    uint32_t writepos;
+    struct record_block_entry blocks[RECORD_MAX_BLOCKS];
+    uint32_t head;
+    uint32_t num;
+    uint64_t seq;
+    uint64_t total;
+    uint64_t failed;
+};
+
+void record_init();
+int record_start_handle(int fd, struct cmd_packet *packet);
+int record_stop_handle(int fd, struct cmd_packet *packet);
+int record_query_handle(int fd, struct cmd_packet *packet);
+
+#endif
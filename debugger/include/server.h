@@ -9,21 +9,38 @@
 #include "debug.h"
 #include "kern.h"
 #include "console.h"
+#include "sub.h"
+#include "record.h"
+#include "compress.h"
+#include "pool.h"
+#include "job.h"
+#include "qos.h"
+#include "transfer.h"
+#include "dump.h"
+#include "hash.h"
+#include "snap.h"
+#include "state.h"
+#include "http.h"
+#include "json.h"
+#include "ws.h"
+#include "stats.h"
+#include "trace.h"
 
 #define SOCK_SERVER_PORT        2811
 #define UART_SERVER_PORT        3321
-#define HTTP_SERVER_PORT        2812
-#define SERVER_MAXCLIENTS       8
+#define SERVER_MAXCLIENTS       16  // room for the data streams of a transfer
 #define UART_SERVER_MAXCLIENTS  1
 
 #define BROADCAST_SERVER_PORT   2813
 #define BROADCAST_MAGIC         0xFFFFAAAA
 
+extern bool unload_cmd_sent;
 extern struct server_client servclients[SERVER_MAXCLIENTS];
 extern struct uart_server_client uartservclients[UART_SERVER_MAXCLIENTS];
 
 struct server_client *alloc_client();
 void free_client(struct server_client *svc);
+struct server_client *find_client(int fd);
 
 struct uart_server_client *alloc_uart_client();
 void free_uart_client(struct uart_server_client *svc);
@@ -32,12 +49,10 @@ int handle_version(int fd, struct cmd_packet *packet);
 int cmd_handler(int fd, struct cmd_packet *packet);
 int check_debug_interrupt();
 int handle_socket_client(struct server_client *svc);
-void handle_web_client(int fd);
 
 void configure_socket(int fd);
 void *broadcast_thread(void *arg);
 int start_server();
-int start_http();
 int start_uart_server();
 
 #endif
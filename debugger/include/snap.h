@@ -0,0 +1,99 @@
+#ifndef _SNAP_H
+#define _SNAP_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+#define SNAP_MAX            8
+#define SNAP_NAME_LENGTH    32
+#define SNAP_MAX_REGIONS    4096
+#define SNAP_MAX_MEMORY     0x4000000   // 64MB for a snapshot kept in memory
+#define SNAP_DIR            "/data/scan_temp/snap"
+#define SNAP_SCAN_PREFIX    '@'         // @init, @cur and @old are the scanner's own snapshot files
+#define SNAP_CHUNK          0x10000
+#define SNAP_BATCH          0x4000
+
+#define SNAP_FLAG_MEMORY    (1 << 0)
+
+#define SNAP_DIFF_RAW       0xFF        // value type for plain changed byte ranges
+
+// followed after the first status by count cmd_proc_snap_range, a count of 0 takes every readable map entry
+struct cmd_proc_snap_take_packet {
+    uint32_t pid;
+    char name[SNAP_NAME_LENGTH];
+    uint32_t flags;
+    uint32_t count;
+} __attribute__((packed));
+
+struct cmd_proc_snap_range {
+    uint64_t address;
+    uint64_t length;
+} __attribute__((packed));
+#define CMD_PROC_SNAP_RANGE_SIZE 16
+
+struct cmd_proc_snap_take_response {
+    uint32_t regions;
+    uint64_t size;
+} __attribute__((packed));
+#define CMD_PROC_SNAP_TAKE_RESPONSE_SIZE 12
+
+// b is compared against a over the regions of a, an empty b means live memory
+// typed diffs report every aligned value of valueType for which compareType holds, with a as the
+// previous value, so cmpTypeIncreasedValueBy with extra 1 finds every int that went up by one
+struct cmd_proc_snap_diff_packet {
+    uint32_t pid;
+    char a[SNAP_NAME_LENGTH];
+    char b[SNAP_NAME_LENGTH];
+    uint8_t valueType;
+    uint8_t compareType;
+    uint8_t extra[8];
+} __attribute__((packed));
+
+// answered with batches of a uint32_t count followed by count records, a count of 0 ends the reply
+struct snap_diff_range {
+    uint64_t address;
+    uint32_t length;
+} __attribute__((packed));
+#define SNAP_DIFF_RANGE_SIZE 12
+
+struct snap_diff_value {
+    uint64_t address;
+    uint8_t old[8];
+    uint8_t new[8];
+} __attribute__((packed));
+#define SNAP_DIFF_VALUE_SIZE 24
+
+struct cmd_proc_snap_delete_packet {
+    char name[SNAP_NAME_LENGTH];
+} __attribute__((packed));
+
+struct snap_region {
+    uint64_t address;
+    uint64_t length;
+    uint64_t offset; // into data for snapshots in memory
+    int fileId;
+};
+
+struct snapshot {
+    char name[SNAP_NAME_LENGTH];
+    uint32_t pid;
+    char dir[64];      // one file per region like the scanner, empty for snapshots in memory
+    struct snap_region *regions;
+    uint32_t count;
+    uint8_t *data;
+    uint64_t size;
+    uint32_t refs;     // diffs reading it, a pinned snapshot is neither replaced nor deleted
+    int taking;        // the name is reserved while the capture runs without snap_mutex
+};
+
+void snap_init();
+int snap_valid_name(const char *name, int scan);
+struct snapshot *snap_get(const char *name);
+void snap_put(struct snapshot *snap);
+int snap_take_handle(int fd, struct cmd_packet *packet);
+int snap_diff_handle(int fd, struct cmd_packet *packet);
+int snap_delete_handle(int fd, struct cmd_packet *packet);
+
+#endif
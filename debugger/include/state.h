@@ -0,0 +1,94 @@
+#ifndef _STATE_H
+#define _STATE_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+#define STATE_DIR           "/data/frame4/state"
+#define STATE_MAGIC         0x54533446  // F4ST
+#define STATE_VERSION       1
+#define STATE_NAME_LENGTH   32
+#define STATE_MAX_REGIONS   4096
+#define STATE_PAGE          0x1000
+#define STATE_CHUNK         0x40000     // 64 pages per read, hash and write round
+
+#define STATE_STOP_WAIT     1000000     // us for an attached process to reach its stop
+#define STATE_KINFO_SIZE    0x800       // room for a kinfo_proc
+#define STATE_KINFO_STAT    388         // offset of ki_stat
+#define STATE_SSTOP         4
+
+#define STATE_SUSPEND_NONE      0       // running with STATE_FLAG_RUNNING or already stopped
+#define STATE_SUSPEND_SIGNAL    1       // SIGSTOP, resumed with SIGCONT
+#define STATE_SUSPEND_TRACE     2       // attached, stopped in the debugger and resumed with PT_CONTINUE
+
+#define STATE_FLAG_FORCE    (1 << 0)    // write every page instead of the ones whose hash differs
+#define STATE_FLAG_RUNNING  (1 << 1)    // do not suspend the process while restoring
+
+// captures every readable and writable map entry
+struct cmd_proc_state_save_packet {
+    uint32_t pid;
+    char name[STATE_NAME_LENGTH];
+} __attribute__((packed));
+
+struct cmd_proc_state_save_response {
+    uint32_t regions;
+    uint64_t size;
+} __attribute__((packed));
+#define CMD_PROC_STATE_SAVE_RESPONSE_SIZE 12
+
+// only regions whose map name contains filter and that lie inside start to end are restored,
+// an empty filter and an end of 0 match everything
+struct cmd_proc_state_restore_packet {
+    uint32_t pid;
+    char name[STATE_NAME_LENGTH];
+    uint32_t flags;
+    char filter[32];
+    uint64_t start;
+    uint64_t end;
+} __attribute__((packed));
+
+struct cmd_proc_state_restore_response {
+    uint32_t regions;
+    uint32_t skipped;  // regions that are no longer mapped writable in the process
+    uint64_t pages;
+    uint64_t written;
+    uint64_t time;     // microseconds the process was suspended
+} __attribute__((packed));
+#define CMD_PROC_STATE_RESTORE_RESPONSE_SIZE 32
+
+struct cmd_proc_state_delete_packet {
+    char name[STATE_NAME_LENGTH];
+} __attribute__((packed));
+
+/*
+ * A save-state is a single file:
+ *   state_header
+ *   state_region regions[count]
+ *   uint64_t hashes[]         (xxh64 of every page, region after region)
+ *   region data               (region after region)
+ * The header is written last, so an interrupted save never restores.
+ */
+struct state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t pid;
+    uint64_t size;
+} __attribute__((packed));
+
+struct state_region {
+    char name[32];
+    uint64_t address;
+    uint64_t length;
+    uint64_t hashes; // file offset of the page hashes
+    uint64_t data;   // file offset of the data
+} __attribute__((packed));
+
+void state_init();
+int state_save_handle(int fd, struct cmd_packet *packet);
+int state_restore_handle(int fd, struct cmd_packet *packet);
+int state_delete_handle(int fd, struct cmd_packet *packet);
+
+#endif
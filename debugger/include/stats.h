@@ -0,0 +1,61 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <ps4.h>
+#include "protocol.h"
+
+#define STATS_MAX_COMMANDS      128
+#define STATS_SUB_BITS          2       // four buckets per power of two keep every bucket within 25%
+#define STATS_SUB_BUCKETS       (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS           100     // up to 2^26 us, anything slower lands in the last bucket
+
+// counters only ever grow, the ones marked gauge go up and down
+#define STATS_BYTES_IN          0
+#define STATS_BYTES_OUT         1
+#define STATS_PROC_RW_CALLS     2
+#define STATS_PROC_RW_BYTES     3
+#define STATS_SCANS             4
+#define STATS_SCAN_BYTES        5
+#define STATS_SCAN_TIME         6       // us
+#define STATS_POOL_HITS         7
+#define STATS_POOL_MISSES       8
+#define STATS_POOL_OVERSIZE     9
+#define STATS_POOL_BYTES        10      // gauge, held by the buffer pools whether in use or cached
+#define STATS_CLIENTS           11      // gauge, binary protocol clients
+#define STATS_HTTP_CONNS        12      // gauge
+#define STATS_WS_CLIENTS        13      // gauge
+#define STATS_COUNTERS          14
+
+// latencies of one command as seen by cmd_handler
+// bucket b below STATS_SUB_BUCKETS holds b us, every other one [stats_bucket_low(b), stats_bucket_low(b + 1))
+struct stats_command {
+    uint32_t cmd;
+    uint64_t count;
+    uint64_t total; // us
+    uint64_t max;   // us
+    uint32_t buckets[STATS_BUCKETS];
+} __attribute__((packed));
+#define STATS_COMMAND_SIZE (28 + STATS_BUCKETS * 4)
+
+// followed by commands stats_command records
+struct cmd_server_stats_response {
+    uint64_t uptime; // us
+    uint64_t counters[STATS_COUNTERS];
+    uint32_t buckets;
+    uint32_t commands;
+} __attribute__((packed));
+#define CMD_SERVER_STATS_RESPONSE_SIZE (16 + STATS_COUNTERS * 8)
+
+extern uint64_t stats_counters[STATS_COUNTERS];
+
+#define stats_add(counter, n) __sync_fetch_and_add(&stats_counters[counter], (uint64_t)(n))
+#define stats_sub(counter, n) __sync_fetch_and_sub(&stats_counters[counter], (uint64_t)(n))
+
+void stats_init();
+uint64_t stats_bucket_low(uint32_t bucket);
+void stats_command(uint32_t cmd, uint64_t elapsed);
+uint64_t stats_uptime();
+uint32_t stats_commands(struct stats_command *out, uint32_t max);
+int stats_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _SUB_H
+#define _SUB_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+// the client listens here for pushed samples, like DEBUG_PORT for interrupts
+#define SUB_PORT            42070
+#define SUB_MAX             64
+#define SUB_MAX_LENGTH      256
+#define SUB_MIN_PERIOD      1000    // 1ms
+#define SUB_IDLE_SLEEP      10000   // 10ms
+#define SUB_DEADLINE        1000    // ms, a stalled client must not hold up the sampler
+#define SUB_QUEUE_SIZE      0x2000  // pushes waiting for one client, a change that does not fit waits for the next sample
+
+// what was last pushed for a subscription
+#define SUB_STATE_NONE      0
+#define SUB_STATE_VALUE     1
+#define SUB_STATE_FAILED    2
+
+struct cmd_proc_sub_add_packet {
+    uint32_t pid;
+    uint64_t address; // base of the path if depth is not 0
+    uint32_t length;
+    uint32_t period;  // microseconds
+    uint32_t depth;   // int64_t offsets sent after the first status, same as CMD_PROC_PTR_GATHER
+} __attribute__((packed));
+
+struct cmd_proc_sub_add_response {
+    uint32_t id;
+} __attribute__((packed));
+#define CMD_PROC_SUB_ADD_RESPONSE_SIZE 4
+
+struct cmd_proc_sub_remove_packet {
+    uint32_t id;
+} __attribute__((packed));
+
+// sent on the push socket whenever a value changes, followed by length bytes
+// length is 0 when the value became unreadable
+struct sub_push_packet {
+    uint32_t id;
+    uint32_t length;
+    uint64_t timestamp; // process time in microseconds when the batch was sampled
+    uint64_t address;
+} __attribute__((packed));
+#define SUB_PUSH_PACKET_SIZE 24
+
+struct subscription {
+    uint32_t id;
+    struct server_client *svc;
+    uint32_t pid;
+    uint32_t period;
+    uint64_t due;
+    struct proc_path path;
+    int state;
+    uint8_t value[SUB_MAX_LENGTH];
+    uint8_t last[SUB_MAX_LENGTH];
+};
+
+// push socket of a client and what the sampler still has to send on it
+struct sub_queue {
+    int fd;
+    uint32_t used;
+    uint8_t data[SUB_QUEUE_SIZE];
+};
+
+void sub_init();
+void sub_remove_client(struct server_client *svc);
+int sub_add_handle(int fd, struct cmd_packet *packet);
+int sub_remove_handle(int fd, struct cmd_packet *packet);
+
+#endif
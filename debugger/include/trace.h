@@ -0,0 +1,71 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <ps4.h>
+#include "protocol.h"
+
+#define TRACE_MAX_THREADS       32
+#define TRACE_RING_EVENTS       2048    // per thread, the oldest events are overwritten
+#define TRACE_CHUNK             0x4000  // text sent per length prefixed chunk of a chrome dump
+
+#define TRACE_BEGIN             'B'
+#define TRACE_END               'E'
+
+// what an event measures, arg is given with the begin event
+#define TRACE_COMMAND           0       // cmd_handler, arg is the command
+#define TRACE_PROC_RW           1       // sys_proc_rw, arg is the length
+#define TRACE_NET_SEND          2       // a socket write, arg is the length
+#define TRACE_NET_WAIT          3       // blocked on a socket, arg is the poll events
+#define TRACE_DISK_READ         4       // scanner temp files, arg is the length
+#define TRACE_DISK_WRITE        5
+#define TRACE_SCAN_SECTION      6       // arg is the section start
+#define TRACE_DUMP_FILL         7       // arg is the offset in the core image
+#define TRACE_COMPRESS          8       // arg is the length
+#define TRACE_NAMES             9
+
+#define TRACE_FORMAT_BINARY     0
+#define TRACE_FORMAT_CHROME     1
+
+struct trace_event {
+    uint64_t timestamp; // process time in microseconds
+    uint64_t arg;
+    uint16_t name;
+    uint8_t phase;
+    uint8_t reserved[5];
+} __attribute__((packed));
+#define TRACE_EVENT_SIZE 24
+
+// a ring is written only by the thread that owns it, readers copy it and drop what was lapped meanwhile
+struct trace_ring {
+    ScePthread owner;
+    volatile uint64_t head; // events ever written
+    struct trace_event *events;
+};
+
+struct cmd_trace_dump_packet {
+    uint32_t format;
+} __attribute__((packed));
+
+// TRACE_FORMAT_BINARY: one of these per thread followed by count trace_event, ended by a count of 0
+// TRACE_FORMAT_CHROME: uint32_t length prefixed pieces of a chrome://tracing JSON document, ended by a length of 0
+struct trace_thread_header {
+    uint32_t tid;
+    uint32_t count;
+} __attribute__((packed));
+#define TRACE_THREAD_HEADER_SIZE 8
+
+extern volatile int trace_enabled;
+
+void trace_event(uint16_t name, uint8_t phase, uint64_t arg);
+
+#define trace_begin(name, arg) do { if (trace_enabled) trace_event(name, TRACE_BEGIN, arg); } while (0)
+#define trace_end(name) do { if (trace_enabled) trace_event(name, TRACE_END, 0); } while (0)
+
+void trace_init();
+void trace_thread_exit();
+void trace_chrome(void *ctx, void (*write)(void *ctx, const char *data, uint32_t length), struct trace_event *buffer);
+int trace_start_handle(int fd, struct cmd_packet *packet);
+int trace_stop_handle(int fd, struct cmd_packet *packet);
+int trace_dump_handle(int fd, struct cmd_packet *packet);
+
+#endif
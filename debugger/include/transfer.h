@@ -0,0 +1,58 @@
+#ifndef _TRANSFER_H
+#define _TRANSFER_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+
+#define TRANSFER_MAX            4
+#define TRANSFER_MAX_STREAMS    8
+#define TRANSFER_CHUNK          NET_MAX_LENGTH
+#define TRANSFER_END            0xFFFFFFFFFFFFFFFF
+#define TRANSFER_CANCELLED      0xFFFFFFFFFFFFFFFE
+
+struct cmd_proc_transfer_packet {
+    uint32_t pid;
+    uint64_t address;
+    uint64_t length;
+} __attribute__((packed));
+
+// the client then opens up to TRANSFER_MAX_STREAMS more connections and attaches each one
+struct cmd_proc_transfer_response {
+    uint32_t id;
+    uint64_t chunks;
+} __attribute__((packed));
+#define CMD_PROC_TRANSFER_RESPONSE_SIZE 12
+
+struct cmd_proc_transfer_attach_packet {
+    uint32_t id;
+} __attribute__((packed));
+
+// every attached stream gets chunks in no particular order, each one followed by its data
+// (as a compressed frame if the stream asked for it), a seq of TRANSFER_END ends the stream
+// and TRANSFER_CANCELLED ends it when the transfer was cancelled or another stream lost a chunk
+struct proc_transfer_chunk {
+    uint64_t seq;     // chunk n covers address + n * TRANSFER_CHUNK
+    uint32_t length;
+} __attribute__((packed));
+#define PROC_TRANSFER_CHUNK_SIZE 12
+
+struct transfer {
+    uint32_t id;
+    struct server_client *svc;
+    uint32_t pid;
+    uint64_t address;
+    uint64_t length;
+    uint64_t chunks;
+    uint64_t next;
+    int streams;
+    int cancel;
+};
+
+void transfer_init();
+void transfer_remove_client(struct server_client *svc);
+int transfer_handle(int fd, struct cmd_packet *packet);
+int transfer_attach_handle(int fd, struct cmd_packet *packet);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef _WS_H
+#define _WS_H
+
+#include <ps4.h>
+#include "protocol.h"
+#include "net.h"
+#include "proc.h"
+#include "debug.h"
+#include "http.h"
+#include "sub.h"
+
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_CLIENTS      8
+#define WS_MAX_WATCHES      32
+#define WS_MAX_MESSAGE      0x1000      // largest frame a client may send
+#define WS_BUFFER_SIZE      (WS_MAX_MESSAGE + 14)
+#define WS_DEADLINE         1000        // ms, a stalled browser must not hold up the sampler or the debugger
+#define WS_PROGRESS_PERIOD  50000       // us between two scan progress events
+#define WS_EVENT_QUEUE      8           // interrupts waiting for ws_thread, the oldest is dropped when full
+
+#define WS_OP_CONTINUATION  0x0
+#define WS_OP_TEXT          0x1
+#define WS_OP_BINARY        0x2
+#define WS_OP_CLOSE         0x8
+#define WS_OP_PING          0x9
+#define WS_OP_PONG          0xA
+
+/*
+ * Every message is a binary frame starting with a uint8_t type.
+ *
+ * Client to server:
+ *   WS_MSG_WATCH_ADD     ws_watch_add_message followed by depth int64_t offsets
+ *   WS_MSG_WATCH_REMOVE  uint32_t id
+ *   WS_MSG_EVENTS        uint32_t mask of WS_EVENT_ bits, none are sent before this
+ *
+ * Server to client:
+ *   WS_MSG_WATCH         sub_push_packet followed by length bytes, whenever the value changed
+ *   WS_MSG_SCAN          ws_scan_message
+ *   WS_MSG_INTERRUPT     debug_interrupt_packet, the same bytes the debug socket gets
+ *   WS_MSG_ERROR         uint32_t status of a message the server could not take
+ *
+ * Scan and interrupt events are queued by the scanner and the debugger and sent by ws_thread,
+ * up to NET_POLL_WAIT ms later. Only the latest scan progress is kept.
+ */
+#define WS_MSG_WATCH_ADD    1
+#define WS_MSG_WATCH_REMOVE 2
+#define WS_MSG_EVENTS       3
+#define WS_MSG_WATCH        0x81
+#define WS_MSG_SCAN         0x82
+#define WS_MSG_INTERRUPT    0x83
+#define WS_MSG_ERROR        0xFF
+
+#define WS_CLIENT_FREE      0
+#define WS_CLIENT_RESERVED  1       // handshake sent, the HTTP worker still owns the socket
+#define WS_CLIENT_OPEN      2
+
+#define WS_EVENT_SCAN       (1 << 0)
+#define WS_EVENT_INTERRUPT  (1 << 1)
+
+// same fields as cmd_proc_sub_add_packet, with the id picked by the client
+struct ws_watch_add_message {
+    uint32_t id;
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+    uint32_t period;
+    uint32_t depth;
+} __attribute__((packed));
+#define WS_WATCH_ADD_MESSAGE_SIZE 28
+
+struct ws_scan_message {
+    uint32_t done;  // sections
+    uint32_t total;
+    uint64_t results;
+} __attribute__((packed));
+#define WS_SCAN_MESSAGE_SIZE 16
+
+struct ws_watch {
+    uint32_t id;
+    uint32_t pid;
+    uint32_t period;
+    uint64_t due;
+    struct proc_path path;
+    int state;
+    uint8_t value[SUB_MAX_LENGTH];
+    uint8_t last[SUB_MAX_LENGTH];
+};
+
+struct ws_client {
+    int fd;
+    int state;
+    uint32_t events;
+    uint8_t buffer[WS_BUFFER_SIZE];
+    uint32_t used;
+    struct ws_watch watches[WS_MAX_WATCHES];
+};
+
+// filled by the scanner and the debugger under ws_event_mutex, drained by ws_thread
+struct ws_events {
+    struct ws_scan_message scan;
+    int scanPending;
+    struct debug_interrupt_packet interrupts[WS_EVENT_QUEUE];
+    uint32_t head;
+    uint32_t count;
+};
+
+void ws_init();
+int ws_handshake(struct http_request *req);
+void ws_attach(struct ws_client *ws, void *data, uint32_t length);
+void ws_scan_progress(uint32_t done, uint32_t total, uint64_t results);
+void ws_debug_interrupt(struct debug_interrupt_packet *resp);
+
+#endif
@@ -0,0 +1,251 @@
+#include "compress.h"
+#include "server.h"
+
+#define LZ4_MIN_MATCH   4
+#define LZ4_MF_LIMIT    12  // a match can not start in the last 12 bytes
+#define LZ4_LAST_LIT    5   // and the last 5 bytes are always literals
+#define LZ4_MAX_OFFSET  65535
+
+uint32_t lz4_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+uint8_t *lz4_put_length(uint8_t *op, uint32_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// greedy lz4 block compressor, returns 0 if the output does not fit in capacity
+uint32_t lz4_compress(const uint8_t *src, uint32_t length, uint8_t *dst, uint32_t capacity, uint32_t *table) {
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + length;
+    const uint8_t *mflimit = end - LZ4_MF_LIMIT;
+    const uint8_t *matchlimit = end - LZ4_LAST_LIT;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + capacity;
+    uint8_t *token;
+    uint32_t literals;
+    uint32_t matchlen;
+    uint32_t offset;
+    uint32_t seq;
+    uint32_t h;
+
+    memset(table, NULL, sizeof(uint32_t) << COMPRESS_HASH_LOG);
+
+    if (length > LZ4_MF_LIMIT) {
+        ip++;
+
+        while (ip < mflimit) {
+            const uint8_t *ref;
+
+            seq = lz4_read32(ip);
+            h = (seq * 2654435761U) >> (32 - COMPRESS_HASH_LOG);
+            ref = src + table[h];
+            table[h] = ip - src;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != seq) {
+                // skip faster through data that does not compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            const uint8_t *mp = ip + LZ4_MIN_MATCH;
+            const uint8_t *rp = ref + LZ4_MIN_MATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            literals = ip - anchor;
+            matchlen = mp - ip - LZ4_MIN_MATCH;
+            offset = ip - ref;
+
+            if (op + 1 + literals / 255 + 1 + literals + 2 + matchlen / 255 + 1 > oend) {
+                return 0;
+            }
+
+            token = op++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = lz4_put_length(op, literals - 15);
+            }
+            else {
+                *token = literals << 4;
+            }
+
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            if (matchlen >= 15) {
+                *token |= 15;
+                op = lz4_put_length(op, matchlen - 15);
+            }
+            else {
+                *token |= matchlen;
+            }
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    literals = end - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > oend) {
+        return 0;
+    }
+
+    token = op++;
+    if (literals >= 15) {
+        *token = 15 << 4;
+        op = lz4_put_length(op, literals - 15);
+    }
+    else {
+        *token = literals << 4;
+    }
+
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - dst;
+}
+
+// zigzag varints of the difference to the previous address, returns 0 if the output does not fit
+uint32_t delta_compress(const uint64_t *src, uint32_t count, uint8_t *dst, uint32_t capacity) {
+    uint64_t prev = 0;
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t delta = (int64_t)(src[i] - prev);
+        uint64_t v = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        prev = src[i];
+
+        if (size + 10 > capacity) {
+            return 0;
+        }
+
+        while (v >= 0x80) {
+            dst[size++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+
+        dst[size++] = (uint8_t)v;
+    }
+
+    return size;
+}
+
+// returns NULL when the client did not ask for compression, chunks are then sent as they are
+struct compress_ctx *compress_alloc(int fd) {
+    struct server_client *svc;
+    struct compress_ctx *ctx;
+
+    svc = find_client(fd);
+    if (!svc || !svc->compress) {
+        return NULL;
+    }
+
+    ctx = (struct compress_ctx *)pool_get(&svc->pool, sizeof(struct compress_ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    ctx->pool = &svc->pool;
+    ctx->methods = svc->compress;
+    ctx->out = (uint8_t *)pool_get(ctx->pool, COMPRESS_BOUND(NET_MAX_LENGTH));
+    ctx->table = (uint32_t *)pool_get(ctx->pool, sizeof(uint32_t) << COMPRESS_HASH_LOG);
+    if (!ctx->out || !ctx->table) {
+        compress_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void compress_free(struct compress_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    pool_put(ctx->pool, ctx->out);
+    pool_put(ctx->pool, ctx->table);
+    pool_put(ctx->pool, ctx);
+}
+
+// the socket buffer drains the previous chunk while the next one is read and compressed
+int compress_send_chunk(int fd, struct compress_ctx *ctx, void *data, uint32_t length, int method) {
+    struct compress_frame_header header;
+    struct iovec iov[2];
+    uint32_t size;
+
+    if (!ctx) {
+        return net_send_data(fd, data, length);
+    }
+
+    size = 0;
+    trace_begin(TRACE_COMPRESS, length);
+    if (method == COMPRESS_METHOD_LZ4 && (ctx->methods & COMPRESS_LZ4)) {
+        size = lz4_compress((uint8_t *)data, length, ctx->out, length, ctx->table);
+    }
+    else if (method == COMPRESS_METHOD_DELTA && (ctx->methods & COMPRESS_DELTA)) {
+        size = delta_compress((uint64_t *)data, length / sizeof(uint64_t), ctx->out, length);
+    }
+    trace_end(TRACE_COMPRESS);
+
+    header.length = length;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = COMPRESS_FRAME_HEADER_SIZE;
+
+    // store chunks that did not get smaller
+    if (!size || size >= length) {
+        header.size = length;
+        header.method = COMPRESS_METHOD_NONE;
+        iov[1].iov_base = data;
+        iov[1].iov_len = length;
+    }
+    else {
+        header.size = size;
+        header.method = method;
+        iov[1].iov_base = ctx->out;
+        iov[1].iov_len = size;
+    }
+
+    return net_send_datav(fd, iov, 2);
+}
+
+int compress_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_compress_packet *cp;
+    struct cmd_compress_response resp;
+    struct server_client *svc;
+
+    cp = (struct cmd_compress_packet *)packet->data;
+
+    if (!cp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    svc = find_client(fd);
+    if (!svc) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    svc->compress = cp->methods & COMPRESS_SUPPORTED;
+    resp.methods = svc->compress;
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_COMPRESS_RESPONSE_SIZE);
+
+    return 0;
+}
@@ -128,8 +128,7 @@ int console_info_handle(int fd, struct cmd_packet *packet) {
     mib[1] = 3; // HW_NCPU
     syscall(202, mib, 2, &resp.hw_ncpu, &len, NULL, 0);
     
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &resp, CMD_CONSOLE_INFO_RESPONSE_SIZE);
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_CONSOLE_INFO_RESPONSE_SIZE);
 
     return 0;
 }
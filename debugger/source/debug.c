@@ -247,8 +247,7 @@ int debug_threads_handle(int fd, struct cmd_packet *packet) {
         return 0;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &nlwps, sizeof(nlwps));
+    net_send_response(fd, CMD_SUCCESS, &nlwps, sizeof(nlwps));
     net_send_data(fd, lwpids, size);
 
     free(lwpids);
@@ -333,8 +332,7 @@ int debug_getregs_handle(int fd, struct cmd_packet *packet) {
         return 1;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &reg64, sizeof(struct __reg64));
+    net_send_response(fd, CMD_SUCCESS, &reg64, sizeof(struct __reg64));
 
     return 0;
 }
@@ -362,8 +360,7 @@ int debug_getfpregs_handle(int fd, struct cmd_packet *packet) {
         return 1;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &savefpu, sizeof(struct savefpu_ymm));
+    net_send_response(fd, CMD_SUCCESS, &savefpu, sizeof(struct savefpu_ymm));
 
     return 0;
 }
@@ -391,8 +388,7 @@ int debug_getdbregs_handle(int fd, struct cmd_packet *packet) {
         return 1;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &dbreg64, sizeof(struct __dbreg64));
+    net_send_response(fd, CMD_SUCCESS, &dbreg64, sizeof(struct __dbreg64));
 
     return 0;
 }
@@ -549,8 +545,7 @@ int debug_thrinfo_handle(int fd, struct cmd_packet *packet) {
     resp.priority = args.priority;
     memcpy(resp.name, args.name, sizeof(resp.name));
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &resp, CMD_DEBUG_THRINFO_RESPONSE_SIZE);
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_DEBUG_THRINFO_RESPONSE_SIZE);
 
     return 0;
 }
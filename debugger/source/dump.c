@@ -0,0 +1,308 @@
+#include "dump.h"
+#include "server.h"
+
+#define DUMP_ALIGN4(x) (((x) + 3) & ~3)
+
+uint64_t dump_note_size(const char *name, uint64_t descsz) {
+    return sizeof(Elf_Note) + DUMP_ALIGN4(strlen(name) + 1) + DUMP_ALIGN4(descsz);
+}
+
+uint8_t *dump_put_note(uint8_t *p, const char *name, uint32_t type, void *desc, uint32_t descsz) {
+    Elf_Note note;
+    uint32_t namesz;
+
+    namesz = strlen(name) + 1;
+
+    note.n_namesz = namesz;
+    note.n_descsz = descsz;
+    note.n_type = type;
+
+    memcpy(p, &note, sizeof(Elf_Note));
+    p += sizeof(Elf_Note);
+
+    memset(p, NULL, DUMP_ALIGN4(namesz));
+    memcpy(p, name, namesz);
+    p += DUMP_ALIGN4(namesz);
+
+    memset(p, NULL, DUMP_ALIGN4(descsz));
+    if (descsz) {
+        memcpy(p, desc, descsz);
+    }
+    p += DUMP_ALIGN4(descsz);
+
+    return p;
+}
+
+uint64_t dump_layout_hash(uint8_t *data, uint64_t length) {
+    uint64_t hash = 0xCBF29CE484222325;
+
+    for (uint64_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+uint32_t dump_segment_flags(uint16_t prot) {
+    uint32_t flags = 0;
+
+    if (prot & PROT_READ) {
+        flags |= PF_R;
+    }
+
+    if (prot & PROT_WRITE) {
+        flags |= PF_W;
+    }
+
+    if (prot & PROT_EXEC) {
+        flags |= PF_X;
+    }
+
+    return flags;
+}
+
+void dump_free(struct dump_image *image) {
+    if (image->maps) {
+        free(image->maps);
+    }
+
+    if (image->header) {
+        free(image->header);
+    }
+
+    proc_vm_map_cache_free(&image->cache);
+    memset(image, NULL, sizeof(struct dump_image));
+}
+
+// lays out the whole image, only the headers and notes are kept in memory
+int dump_build(struct dump_image *image, uint32_t pid) {
+    struct sys_proc_prx_list_args prxargs;
+    struct dump_prstatus prstatus;
+    Elf64_Ehdr *ehdr;
+    Elf64_Phdr *phdr;
+    uint32_t *lwpids;
+    uint64_t notesize;
+    uint64_t offset;
+    uint8_t *p;
+    int nlwps;
+
+    memset(image, NULL, sizeof(struct dump_image));
+    memset(&prxargs, NULL, sizeof(prxargs));
+    lwpids = NULL;
+    nlwps = 0;
+
+    image->pid = pid;
+
+    if (proc_get_vm_map(pid, &image->maps, &image->num)) {
+        return 1;
+    }
+
+    if (!sys_proc_cmd(pid, SYS_PROC_PRX_LIST, &prxargs) && prxargs.num) {
+        prxargs.entries = (struct prx_list_entry *)malloc(prxargs.num * sizeof(struct prx_list_entry));
+        if (!prxargs.entries || sys_proc_cmd(pid, SYS_PROC_PRX_LIST, &prxargs)) {
+            prxargs.num = 0;
+        }
+    }
+
+    // thread registers are only there while we have the process attached
+    if (g_debugging && curdbgctx && curdbgctx->pid == pid) {
+        nlwps = ptrace(PT_GETNUMLWPS, pid, NULL, 0);
+        if (nlwps > 0) {
+            lwpids = (uint32_t *)malloc(nlwps * sizeof(uint32_t));
+            if (!lwpids || ptrace(PT_GETLWPLIST, pid, lwpids, nlwps) == -1) {
+                nlwps = 0;
+            }
+        }
+        else {
+            nlwps = 0;
+        }
+    }
+
+    notesize = dump_note_size(DUMP_NOTE_FRAME4, image->num * sizeof(struct proc_vm_map_entry));
+    notesize += dump_note_size(DUMP_NOTE_FRAME4, prxargs.num * sizeof(struct prx_list_entry));
+    notesize += nlwps * dump_note_size(DUMP_NOTE_NAME, sizeof(struct dump_prstatus));
+
+    image->headersize = sizeof(Elf64_Ehdr) + (image->num + 1) * sizeof(Elf64_Phdr) + notesize;
+    image->dataoffset = (image->headersize + DUMP_PAGE - 1) & ~(uint64_t)(DUMP_PAGE - 1);
+
+    image->header = (uint8_t *)malloc(image->headersize);
+    if (!image->header) {
+        if (prxargs.entries) {
+            free(prxargs.entries);
+        }
+
+        if (lwpids) {
+            free(lwpids);
+        }
+
+        dump_free(image);
+        return 1;
+    }
+
+    memset(image->header, NULL, image->headersize);
+
+    ehdr = (Elf64_Ehdr *)image->header;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELFOSABI_FREEBSD;
+    ehdr->e_type = ET_CORE;
+    ehdr->e_machine = EM_X86_64;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = sizeof(Elf64_Ehdr);
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_phentsize = sizeof(Elf64_Phdr);
+    ehdr->e_phnum = image->num + 1;
+
+    phdr = (Elf64_Phdr *)(image->header + sizeof(Elf64_Ehdr));
+    phdr[0].p_type = PT_NOTE;
+    phdr[0].p_offset = sizeof(Elf64_Ehdr) + (image->num + 1) * sizeof(Elf64_Phdr);
+    phdr[0].p_filesz = notesize;
+    phdr[0].p_align = 4;
+
+    // unreadable entries are indexed with no file data
+    offset = image->dataoffset;
+    for (uint64_t i = 0; i < image->num; i++) {
+        struct proc_vm_map_entry *entry = &image->maps[i];
+
+        phdr[i + 1].p_type = PT_LOAD;
+        phdr[i + 1].p_flags = dump_segment_flags(entry->prot);
+        phdr[i + 1].p_offset = offset;
+        phdr[i + 1].p_vaddr = entry->start;
+        phdr[i + 1].p_memsz = entry->end - entry->start;
+        phdr[i + 1].p_filesz = (entry->prot & PROT_READ) ? entry->end - entry->start : 0;
+        phdr[i + 1].p_align = DUMP_PAGE;
+
+        offset += phdr[i + 1].p_filesz;
+    }
+
+    image->size = offset;
+
+    p = image->header + phdr[0].p_offset;
+    p = dump_put_note(p, DUMP_NOTE_FRAME4, DUMP_NT_MAPS, image->maps, image->num * sizeof(struct proc_vm_map_entry));
+    p = dump_put_note(p, DUMP_NOTE_FRAME4, DUMP_NT_PRXLIST, prxargs.entries, prxargs.num * sizeof(struct prx_list_entry));
+
+    for (int i = 0; i < nlwps; i++) {
+        memset(&prstatus, NULL, sizeof(prstatus));
+        prstatus.pr_version = 1;
+        prstatus.pr_statussz = sizeof(struct dump_prstatus);
+        prstatus.pr_gregsetsz = sizeof(struct __reg64);
+        prstatus.pr_pid = lwpids[i];
+        ptrace(PT_GETREGS, lwpids[i], &prstatus.pr_reg, NULL);
+
+        p = dump_put_note(p, DUMP_NOTE_NAME, NT_PRSTATUS, &prstatus, sizeof(struct dump_prstatus));
+    }
+
+    if (prxargs.entries) {
+        free(prxargs.entries);
+    }
+
+    if (lwpids) {
+        free(lwpids);
+    }
+
+    return 0;
+}
+
+// fills data with the image bytes at offset, unreadable pages come back as zeros
+void dump_fill(struct dump_image *image, uint64_t offset, uint8_t *data, uint32_t length) {
+    Elf64_Phdr *phdr;
+    uint64_t start;
+    uint64_t end;
+    uint64_t from;
+    uint64_t to;
+
+    memset(data, NULL, length);
+
+    if (offset < image->headersize) {
+        to = offset + length < image->headersize ? offset + length : image->headersize;
+        memcpy(data, image->header + offset, to - offset);
+    }
+
+    phdr = (Elf64_Phdr *)(image->header + sizeof(Elf64_Ehdr));
+
+    for (uint64_t i = 1; i <= image->num; i++) {
+        start = phdr[i].p_offset;
+        end = start + phdr[i].p_filesz;
+
+        if (end <= offset || !phdr[i].p_filesz) {
+            continue;
+        }
+
+        if (start >= offset + length) {
+            break;
+        }
+
+        from = start > offset ? start : offset;
+        to = end < offset + length ? end : offset + length;
+
+        proc_read_valid(image->pid, phdr[i].p_vaddr + (from - start), data + (from - offset), to - from, &image->cache, NULL, NULL);
+    }
+}
+
+int proc_dump_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_dump_packet *dp;
+    struct cmd_proc_dump_response resp;
+    struct compress_ctx *ctx;
+    struct dump_image image;
+    uint8_t *data;
+    uint64_t offset;
+    uint32_t length;
+
+    dp = (struct cmd_proc_dump_packet *)packet->data;
+
+    if (!dp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (dump_build(&image, dp->pid)) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    if (dp->offset > image.size) {
+        dump_free(&image);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    data = (uint8_t *)pool_alloc(fd, NET_MAX_LENGTH);
+    if (!data) {
+        dump_free(&image);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    resp.size = image.size;
+    // the notes are part of the image, a resume must not stitch registers of two dumps together
+    resp.layout = dump_layout_hash(image.header, image.headersize);
+
+    ctx = compress_alloc(fd);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_DUMP_RESPONSE_SIZE);
+
+    offset = dp->offset;
+    while (offset < image.size && !net_cancelled(fd)) {
+        qos_quantum(fd);
+
+        length = image.size - offset > NET_MAX_LENGTH ? NET_MAX_LENGTH : image.size - offset;
+
+        trace_begin(TRACE_DUMP_FILL, offset);
+        dump_fill(&image, offset, data, length);
+        trace_end(TRACE_DUMP_FILL);
+        if (compress_send_chunk(fd, ctx, data, length, COMPRESS_METHOD_LZ4) < 0) {
+            break;
+        }
+
+        offset += length;
+    }
+
+    compress_free(ctx);
+    pool_free(fd, data);
+    dump_free(&image);
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include "hash.h"
+#include "server.h"
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+uint64_t xxh_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    return v;
+}
+
+uint32_t xxh_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    acc = XXH_ROTL(acc, 31);
+    return acc * XXH_PRIME1;
+}
+
+uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// four independent lanes per 32 byte stripe keep the multipliers busy in parallel
+uint64_t xxh64(const uint8_t *data, uint64_t length, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        const uint8_t *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = XXH_ROTL(v1, 1) + XXH_ROTL(v2, 7) + XXH_ROTL(v3, 12) + XXH_ROTL(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    }
+    else {
+        h = seed + XXH_PRIME5;
+    }
+
+    h += length;
+
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = XXH_ROTL(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME1;
+        h = XXH_ROTL(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME5;
+        h = XXH_ROTL(h, 11) * XXH_PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+// hashes one region in NET_MAX_LENGTH reads, the last block may be short
+int proc_hash_region(int fd, uint32_t pid, uint64_t address, uint64_t length, uint32_t block, uint8_t *data, uint64_t *hashes, struct proc_vm_map_cache *cache) {
+    struct proc_hash_region region;
+    uint64_t left;
+    uint32_t chunk;
+    uint32_t count;
+
+    region.address = address;
+    region.length = length;
+    region.count = (length + block - 1) / block;
+    net_send_data(fd, &region, PROC_HASH_REGION_SIZE);
+
+    left = length;
+    while (left > 0) {
+        if (net_cancelled(fd)) {
+            return 1;
+        }
+
+        qos_quantum(fd);
+
+        chunk = left > NET_MAX_LENGTH ? NET_MAX_LENGTH : left;
+        proc_read_valid(pid, address, data, chunk, cache, NULL, NULL);
+
+        count = 0;
+        for (uint32_t offset = 0; offset < chunk; offset += block) {
+            hashes[count++] = xxh64(data + offset, chunk - offset < block ? chunk - offset : block, 0);
+        }
+
+        if (net_send_data(fd, hashes, count * sizeof(uint64_t)) < 0) {
+            return 1;
+        }
+
+        address += chunk;
+        left -= chunk;
+    }
+
+    return 0;
+}
+
+int proc_hash_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_hash_packet *hp;
+    struct proc_hash_region end;
+    struct proc_vm_map_cache cache;
+    uint64_t *hashes;
+    uint8_t *data;
+    uint32_t block;
+
+    hp = (struct cmd_proc_hash_packet *)packet->data;
+
+    if (!hp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    block = hp->block ? hp->block : HASH_DEFAULT_BLOCK;
+    if (block < HASH_MIN_BLOCK || block > NET_MAX_LENGTH || (block & (block - 1))) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(&cache, NULL, sizeof(cache));
+
+    // the same map list drives the regions and the reads
+    if (!hp->length) {
+        if (proc_get_vm_map(hp->pid, &cache.maps, &cache.num)) {
+            net_send_status(fd, CMD_ERROR);
+            return 0;
+        }
+
+        cache.loaded = 1;
+    }
+
+    data = (uint8_t *)pool_alloc(fd, NET_MAX_LENGTH);
+    hashes = (uint64_t *)pool_alloc(fd, NET_MAX_LENGTH / HASH_MIN_BLOCK * sizeof(uint64_t));
+    if (!data || !hashes) {
+        pool_free(fd, data);
+        pool_free(fd, hashes);
+        proc_vm_map_cache_free(&cache);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    if (hp->length) {
+        proc_hash_region(fd, hp->pid, hp->address, hp->length, block, data, hashes, &cache);
+    }
+    else {
+        for (uint64_t i = 0; i < cache.num; i++) {
+            if ((cache.maps[i].prot & PROT_READ) != PROT_READ) {
+                continue;
+            }
+
+            if (proc_hash_region(fd, hp->pid, cache.maps[i].start, cache.maps[i].end - cache.maps[i].start, block, data, hashes, &cache)) {
+                break;
+            }
+        }
+    }
+
+    memset(&end, NULL, sizeof(end));
+    net_send_data(fd, &end, PROC_HASH_REGION_SIZE);
+
+    pool_free(fd, data);
+    pool_free(fd, hashes);
+    proc_vm_map_cache_free(&cache);
+
+    return 0;
+}
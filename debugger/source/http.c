@@ -0,0 +1,1265 @@
+#include "http.h"
+#include "server.h"
+
+struct http_conn http_conns[HTTP_MAX_CONNS];
+struct http_conn *http_queue[HTTP_MAX_CONNS];
+uint32_t http_queue_head;
+uint32_t http_queue_count;
+ScePthreadMutex http_mutex;
+int http_sema;
+
+void http_init() {
+    memset(http_conns, NULL, sizeof(http_conns));
+    http_queue_head = 0;
+    http_queue_count = 0;
+    scePthreadMutexInit(&http_mutex, NULL, "httpmutex");
+    http_sema = createSemaphore("httpsema", 0x01, 0, HTTP_MAX_CONNS);
+}
+
+const char *http_reason(int status) {
+    switch (status) {
+    case 100:
+        return "Continue";
+    case 200:
+        return "OK";
+    case 206:
+        return "Partial Content";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 416:
+        return "Range Not Satisfiable";
+    case 413:
+        return "Payload Too Large";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 500:
+        return "Internal Server Error";
+    case 501:
+        return "Not Implemented";
+    case 503:
+        return "Service Unavailable";
+    }
+
+    return "Unknown";
+}
+
+// extra are additional header lines, each ended by \r\n
+int http_format_head(struct http_request *req, int status, const char *type, uint64_t length, const char *extra, char *header, uint32_t size) {
+    return snprintf(header, size,
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Connection: %s\r\n"
+        "%s"
+        "Content-Length: %llu\r\n\r\n",
+        status, http_reason(status), type, req->keepalive ? "keep-alive" : "close", extra ? extra : "", length);
+}
+
+// for bodies the handler streams itself
+void http_send_head(struct http_request *req, int status, const char *type, uint64_t length, const char *extra) {
+    char header[512];
+
+    net_send_data(req->fd, header, http_format_head(req, status, type, length, extra, header, sizeof(header)));
+}
+
+// the header and body leave in a single writev
+void http_send(struct http_request *req, int status, const char *type, const void *data, uint32_t length) {
+    char header[512];
+    struct iovec iov[2];
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = http_format_head(req, status, type, length, NULL, header, sizeof(header));
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = length;
+
+    net_send_datav(req->fd, iov, 2);
+}
+
+// the next part of the body, from the connection buffer first, returns 0 once it is used up
+int http_read_body(struct http_request *req, void *data, uint32_t length) {
+    int n;
+
+    if (length > req->length - req->consumed) {
+        length = req->length - req->consumed;
+    }
+
+    if (!length) {
+        return 0;
+    }
+
+    if (req->consumed < req->buffered) {
+        n = req->buffered - req->consumed < length ? req->buffered - req->consumed : length;
+        memcpy(data, req->body + req->consumed, n);
+    }
+    else {
+        n = net_recv_data(req->fd, data, length, 1);
+        if (n <= 0) {
+            return -1;
+        }
+    }
+
+    req->consumed += n;
+    return n;
+}
+
+// whatever the handler did not read, a long rest is not worth reading and closes the connection instead
+int http_discard_body(struct http_request *req) {
+    char data[0x1000];
+    int n;
+
+    if (req->length - req->consumed > HTTP_BUFFER_SIZE && req->length - req->buffered > HTTP_BUFFER_SIZE) {
+        return 1;
+    }
+
+    while (req->consumed < req->length) {
+        n = http_read_body(req, data, sizeof(data));
+        if (n <= 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// a single bytes range of a resource of size bytes, end is exclusive
+// returns 0 without a usable Range header and -1 if it can not be satisfied
+int http_range(struct http_request *req, uint64_t size, uint64_t *start, uint64_t *end) {
+    char *p;
+    char *e;
+
+    if (!req->range || strncmp(req->range, "bytes=", 6) || strstr(req->range, ",")) {
+        return 0;
+    }
+
+    p = req->range + 6;
+
+    if (*p == '-') {
+        uint64_t suffix = strtoull(p + 1, &e, 10);
+        if (!suffix) {
+            return -1;
+        }
+
+        *start = suffix > size ? 0 : size - suffix;
+        *end = size;
+        return 1;
+    }
+
+    *start = strtoull(p, &e, 10);
+    if (e == p || *e != '-') {
+        return 0;
+    }
+
+    p = e + 1;
+    *end = *p ? strtoull(p, &e, 10) + 1 : size;
+    if (*end > size) {
+        *end = size;
+    }
+
+    if (*start >= size || *start >= *end) {
+        return -1;
+    }
+
+    return 1;
+}
+
+int http_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+// copies the url decoded value of key, returns 0 if the query does not have it
+int http_query(struct http_request *req, const char *key, char *value, uint32_t size) {
+    char *p = req->query;
+    uint32_t keylength = strlen(key);
+    uint32_t n;
+
+    while (*p) {
+        if (!strncmp(p, key, keylength) && p[keylength] == '=') {
+            p += keylength + 1;
+
+            for (n = 0; *p && *p != '&' && n + 1 < size; p++) {
+                if (*p == '%' && http_hex(p[1]) >= 0 && http_hex(p[2]) >= 0) {
+                    value[n++] = (char)(http_hex(p[1]) << 4 | http_hex(p[2]));
+                    p += 2;
+                }
+                else {
+                    value[n++] = *p == '+' ? ' ' : *p;
+                }
+            }
+
+            value[n] = 0;
+            return 1;
+        }
+
+        while (*p && *p != '&') {
+            p++;
+        }
+
+        if (*p) {
+            p++;
+        }
+    }
+
+    return 0;
+}
+
+uint64_t http_query_u64(struct http_request *req, const char *key, int base, uint64_t def) {
+    char value[32];
+    char *end;
+
+    if (!http_query(req, key, value, sizeof(value))) {
+        return def;
+    }
+
+    return strtoull(value, &end, base);
+}
+
+void handle_web_allocate_memory(struct http_request *req) {
+    struct sys_proc_alloc_args args;
+    struct json_writer w;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+
+    args.length = http_query_u64(req, "length", 16, 0);
+    args.address = 0;
+    sys_proc_cmd(pid, SYS_PROC_ALLOC, &args);
+
+    json_begin(&w, req, 200);
+    json_object_begin(&w);
+    json_key(&w, "success");
+    json_bool(&w, true);
+    json_key(&w, "allocated_address");
+    json_hex(&w, args.address);
+    json_object_end(&w);
+    json_end(&w);
+}
+
+void handle_web_free_meory(struct http_request *req) {
+    struct sys_proc_free_args args;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+
+    args.address = http_query_u64(req, "address", 16, 0);
+    args.length = http_query_u64(req, "length", 16, 0);
+    sys_proc_cmd(pid, SYS_PROC_FREE, &args);
+
+    json_success(req);
+}
+
+void handle_web_get_process_info(struct http_request *req) {
+    struct sys_proc_info_args args;
+    struct json_writer w;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+
+    memset(&args, NULL, sizeof(args));
+    sys_proc_cmd(pid, SYS_PROC_INFO, &args);
+
+    json_begin(&w, req, 200);
+    json_object_begin(&w);
+    json_key(&w, "pid");
+    json_int(&w, args.pid);
+    json_key(&w, "name");
+    json_string(&w, args.name);
+    json_key(&w, "path");
+    json_string(&w, args.path);
+    json_key(&w, "title_id");
+    json_string(&w, args.titleid);
+    json_key(&w, "content_id");
+    json_string(&w, args.contentid);
+    json_object_end(&w);
+    json_end(&w);
+}
+
+// every entry goes straight into the writer, the size of the map does not matter
+void handle_web_process_maps(struct http_request *req) {
+    struct proc_vm_map_entry *maps;
+    struct json_writer w;
+    char name[sizeof(maps->name) + 1];
+    char prot[8];
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t num;
+
+    if (proc_get_vm_map(pid, &maps, &num)) {
+        json_message(req, 400, "SYS_PROC_VM_MAP returned error");
+        return;
+    }
+
+    json_begin(&w, req, 200);
+    json_array_begin(&w);
+    for (uint64_t i = 0; i < num; i++) {
+        memcpy(name, maps[i].name, sizeof(maps[i].name));
+        name[sizeof(maps[i].name)] = 0;
+
+        json_object_begin(&w);
+        json_key(&w, "name");
+        json_string(&w, name);
+        json_key(&w, "start");
+        json_hex(&w, maps[i].start);
+        json_key(&w, "end");
+        json_hex(&w, maps[i].end);
+        json_key(&w, "offset");
+        json_hex(&w, maps[i].offset);
+        // kept a string like it always was
+        snprintf(prot, sizeof(prot), "%i", maps[i].prot);
+        json_key(&w, "prot");
+        json_string(&w, prot);
+        json_object_end(&w);
+    }
+    json_array_end(&w);
+    json_end(&w);
+
+    if (maps) {
+        free(maps);
+    }
+}
+
+void handle_web_process_list(struct http_request *req) {
+    struct proc_list_entry *entries;
+    struct json_writer w;
+    uint64_t num;
+
+    num = 0;
+    sys_proc_list(NULL, &num);
+
+    if (!num) {
+        json_message(req, 400, "Could not get list of processes.");
+        return;
+    }
+
+    entries = (struct proc_list_entry *)pfmalloc(sizeof(struct proc_list_entry) * num);
+    if (!entries) {
+        json_message(req, 400, "pfmalloc returned error");
+        return;
+    }
+
+    sys_proc_list(entries, &num);
+
+    json_begin(&w, req, 200);
+    json_array_begin(&w);
+    for (uint64_t i = 0; i < num; i++) {
+        json_object_begin(&w);
+        json_key(&w, "name");
+        json_string(&w, entries[i].p_comm);
+        json_key(&w, "pid");
+        json_int(&w, entries[i].pid);
+        json_object_end(&w);
+    }
+    json_array_end(&w);
+    json_end(&w);
+
+    free(entries);
+}
+
+void handle_web_notify(struct http_request *req) {
+    char messageParam[HTTP_MAX_HEAD];
+    int messageType = (int)http_query_u64(req, "messageType", 10, 0);
+    size_t decodedMessageLength;
+
+    if (!http_query(req, "message", messageParam, sizeof(messageParam))) {
+        json_message(req, 400, "Invalid params.");
+        return;
+    }
+
+    unsigned char *message = base64_decode((const unsigned char *)messageParam, strlen(messageParam), &decodedMessageLength);
+    if (!message) {
+        json_message(req, 400, "Invalid params.");
+        return;
+    }
+
+    char *data = pfmalloc(decodedMessageLength + 1);
+    if (data) {
+        memcpy(data, message, decodedMessageLength);
+        data[decodedMessageLength] = 0;
+        sceSysUtilSendSystemNotificationWithText(messageType, data);
+        free(data);
+    }
+
+    free(message);
+    json_success(req);
+}
+
+void handle_web_write_memory(struct http_request *req) {
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t memoryAddress = http_query_u64(req, "address", 16, 0);
+    uint32_t size = strlen(req->query) + 1;
+    char *bytes = pfmalloc(size);
+    if (!bytes) {
+        json_message(req, 400, "pfmalloc returned error");
+        return;
+    }
+
+    if (!http_query(req, "bytes", bytes, size)) {
+        free(bytes);
+        json_message(req, 400, "Invalid params.");
+        return;
+    }
+
+    // decoded in place, every byte takes two characters
+    int bytesLength = strlen(bytes) / 2;
+    for (int i = 0; i < bytesLength; i++) {
+        int high = http_hex(bytes[i * 2]);
+        int low = http_hex(bytes[i * 2 + 1]);
+        bytes[i] = (char)((high < 0 ? 0 : high) << 4 | (low < 0 ? 0 : low));
+    }
+    sys_proc_rw(pid, memoryAddress, bytes, bytesLength, 1);
+
+    free(bytes);
+
+    json_success(req);
+}
+
+// the hex string is formatted page by page straight into the writer
+void handle_web_read_memory(struct http_request *req) {
+    const char *hex = "0123456789ABCDEF";
+    struct json_writer w;
+    uint8_t data[0x1000];
+    char text[sizeof(data) * 3];
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t address = http_query_u64(req, "address", 16, 0);
+    uint64_t length = http_query_u64(req, "length", 16, 0);
+    uint32_t chunk;
+    uint32_t n;
+
+    json_begin(&w, req, 200);
+    json_object_begin(&w);
+    json_key(&w, "bytes");
+    json_string_begin(&w);
+
+    for (uint64_t offset = 0; offset < length && !w.failed; offset += chunk) {
+        chunk = length - offset > sizeof(data) ? sizeof(data) : length - offset;
+
+        memset(data, NULL, chunk);
+        sys_proc_rw(pid, address + offset, data, chunk, 0);
+
+        n = 0;
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (offset || i) {
+                text[n++] = ' ';
+            }
+
+            text[n++] = hex[data[i] >> 4];
+            text[n++] = hex[data[i] & 15];
+        }
+
+        json_write(&w, text, n);
+    }
+
+    json_string_end(&w);
+    json_object_end(&w);
+    json_end(&w);
+}
+
+// GET /memory streams the bytes as they are read, unreadable pages read as zero like CMD_PROC_READ_VALID
+void handle_web_memory_read(struct http_request *req) {
+    struct proc_vm_map_cache cache;
+    char extra[128];
+    uint8_t *data;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t address = http_query_u64(req, "address", 16, 0);
+    uint64_t length = http_query_u64(req, "length", 16, 0);
+    uint64_t start;
+    uint64_t end;
+    uint32_t chunk;
+    int status;
+    int r;
+
+    if (!length) {
+        json_message(req, 400, "Invalid params.");
+        return;
+    }
+
+    start = 0;
+    end = length;
+    status = 200;
+    snprintf(extra, sizeof(extra), "Accept-Ranges: bytes\r\n");
+
+    r = http_range(req, length, &start, &end);
+    if (r < 0) {
+        snprintf(extra, sizeof(extra), "Content-Range: bytes */%llu\r\n", length);
+        http_send_head(req, 416, "application/octet-stream", 0, extra);
+        return;
+    }
+
+    if (r > 0) {
+        status = 206;
+        snprintf(extra, sizeof(extra), "Content-Range: bytes %llu-%llu/%llu\r\n", start, end - 1, length);
+    }
+
+    if (!strcmp(req->method, "HEAD")) {
+        http_send_head(req, status, "application/octet-stream", end - start, extra);
+        return;
+    }
+
+    data = (uint8_t *)pool_alloc(req->fd, NET_MAX_LENGTH);
+    if (!data) {
+        json_message(req, 500, "pfmalloc returned error");
+        return;
+    }
+
+    http_send_head(req, status, "application/octet-stream", end - start, extra);
+
+    memset(&cache, NULL, sizeof(cache));
+
+    for (uint64_t offset = start; offset < end; offset += chunk) {
+        chunk = end - offset > NET_MAX_LENGTH ? NET_MAX_LENGTH : end - offset;
+
+        proc_read_valid(pid, address + offset, data, chunk, &cache, NULL, NULL);
+        if (net_send_data(req->fd, data, chunk) < 0) {
+            req->keepalive = 0;
+            break;
+        }
+    }
+
+    proc_vm_map_cache_free(&cache);
+    pool_free(req->fd, data);
+}
+
+// PUT or POST /memory writes the body as it arrives
+void handle_web_memory_write(struct http_request *req) {
+    struct json_writer w;
+    uint8_t *data;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t address = http_query_u64(req, "address", 16, 0);
+    uint64_t written;
+    int n;
+
+    data = (uint8_t *)pool_alloc(req->fd, NET_MAX_LENGTH);
+    if (!data) {
+        json_message(req, 500, "pfmalloc returned error");
+        return;
+    }
+
+    written = 0;
+    while ((n = http_read_body(req, data, NET_MAX_LENGTH)) > 0) {
+        sys_proc_rw(pid, address + written, data, n, 1);
+        written += n;
+    }
+
+    pool_free(req->fd, data);
+
+    if (n < 0) {
+        req->keepalive = 0;
+        json_message(req, 400, "Body ended early.");
+        return;
+    }
+
+    json_begin(&w, req, 200);
+    json_object_begin(&w);
+    json_key(&w, "success");
+    json_bool(&w, true);
+    json_key(&w, "written");
+    json_int(&w, written);
+    json_object_end(&w);
+    json_end(&w);
+}
+
+void handle_web_memory(struct http_request *req) {
+    if (!strcmp(req->method, "GET") || !strcmp(req->method, "HEAD")) {
+        handle_web_memory_read(req);
+    }
+    else if (!strcmp(req->method, "PUT") || !strcmp(req->method, "POST")) {
+        handle_web_memory_write(req);
+    }
+    else {
+        json_message(req, 400, "Unsupported method.");
+    }
+}
+
+// POST /memory/batch with http_batch_range entries, one round trip for many small reads
+void handle_web_memory_batch(struct http_request *req) {
+    struct http_batch_range *ranges;
+    struct proc_vm_map_cache cache;
+    uint8_t *data;
+    uint64_t pid = http_query_u64(req, "pid", 10, 0);
+    uint64_t total;
+    uint32_t count;
+    uint32_t chunk;
+
+    count = req->length / HTTP_BATCH_RANGE_SIZE;
+    if (req->buffered != req->length || req->length % HTTP_BATCH_RANGE_SIZE || !count || count > HTTP_BATCH_MAX) {
+        json_message(req, 400, "Invalid ranges.");
+        return;
+    }
+
+    ranges = (struct http_batch_range *)req->body;
+    req->consumed = req->length;
+
+    total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        total += ranges[i].length;
+    }
+
+    if (total > HTTP_BATCH_MAX_LENGTH) {
+        json_message(req, 413, "Ranges too large.");
+        return;
+    }
+
+    data = (uint8_t *)pool_alloc(req->fd, NET_MAX_LENGTH);
+    if (!data) {
+        json_message(req, 500, "pfmalloc returned error");
+        return;
+    }
+
+    http_send_head(req, 200, "application/octet-stream", total, NULL);
+
+    memset(&cache, NULL, sizeof(cache));
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t offset = 0; offset < ranges[i].length; offset += chunk) {
+            chunk = ranges[i].length - offset > NET_MAX_LENGTH ? NET_MAX_LENGTH : ranges[i].length - offset;
+
+            proc_read_valid(pid, ranges[i].address + offset, data, chunk, &cache, NULL, NULL);
+            if (net_send_data(req->fd, data, chunk) < 0) {
+                req->keepalive = 0;
+                goto done;
+            }
+        }
+    }
+
+done:
+    proc_vm_map_cache_free(&cache);
+    pool_free(req->fd, data);
+}
+
+struct http_metric {
+    int counter;
+    const char *name;
+    const char *type;
+    const char *help;
+};
+
+const struct http_metric http_metrics[] = {
+    { STATS_BYTES_IN, "frame4_received_bytes_total", "counter", "Bytes read from client sockets." },
+    { STATS_BYTES_OUT, "frame4_sent_bytes_total", "counter", "Bytes written to client sockets." },
+    { STATS_PROC_RW_CALLS, "frame4_proc_rw_calls_total", "counter", "sys_proc_rw calls." },
+    { STATS_PROC_RW_BYTES, "frame4_proc_rw_bytes_total", "counter", "Bytes asked of sys_proc_rw." },
+    { STATS_SCANS, "frame4_scans_total", "counter", "Finished CMD_PROC_SCAN passes." },
+    { STATS_SCAN_BYTES, "frame4_scan_bytes_total", "counter", "Process memory read by the scanner." },
+    { STATS_POOL_HITS, "frame4_pool_hits_total", "counter", "Buffers served from a pool cache." },
+    { STATS_POOL_MISSES, "frame4_pool_misses_total", "counter", "Pool buffers that had to be allocated." },
+    { STATS_POOL_OVERSIZE, "frame4_pool_oversize_total", "counter", "Buffers too large for a pool class or without a pool." },
+    { STATS_POOL_BYTES, "frame4_pool_bytes", "gauge", "Bytes held by buffer pools, in use or cached." },
+    { STATS_CLIENTS, "frame4_clients", "gauge", "Connected binary protocol clients." },
+    { STATS_HTTP_CONNS, "frame4_http_connections", "gauge", "Open HTTP connections." },
+    { STATS_WS_CLIENTS, "frame4_websocket_clients", "gauge", "Open WebSocket clients." },
+};
+
+void http_metric_head(struct json_writer *w, const char *name, const char *type, const char *help) {
+    char line[256];
+
+    json_write(w, line, snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type));
+}
+
+// prometheus wants seconds, the us are printed as a fixed point number
+int http_seconds(char *s, uint32_t size, uint64_t us) {
+    return snprintf(s, size, "%llu.%06llu", us / 1000000, us % 1000000);
+}
+
+// GET /metrics, the counters and command latencies in the prometheus text format
+void handle_web_metrics(struct http_request *req) {
+    struct stats_command *commands;
+    struct json_writer w;
+    char line[256];
+    char seconds[32];
+    uint64_t cumulative;
+    uint32_t count;
+
+    commands = (struct stats_command *)pool_alloc(req->fd, STATS_MAX_COMMANDS * STATS_COMMAND_SIZE);
+    if (!commands) {
+        json_message(req, 500, "pfmalloc returned error");
+        return;
+    }
+
+    count = stats_commands(commands, STATS_MAX_COMMANDS);
+
+    json_begin_type(&w, req, 200, "text/plain; version=0.0.4");
+
+    http_metric_head(&w, "frame4_uptime_seconds", "gauge", "Time since the payload started.");
+    http_seconds(seconds, sizeof(seconds), stats_uptime());
+    json_write(&w, line, snprintf(line, sizeof(line), "frame4_uptime_seconds %s\n", seconds));
+
+    for (int i = 0; i < sizeof(http_metrics) / sizeof(http_metrics[0]); i++) {
+        http_metric_head(&w, http_metrics[i].name, http_metrics[i].type, http_metrics[i].help);
+        json_write(&w, line, snprintf(line, sizeof(line), "%s %llu\n", http_metrics[i].name, stats_counters[http_metrics[i].counter]));
+    }
+
+    http_metric_head(&w, "frame4_scan_seconds_total", "counter", "Time spent in CMD_PROC_SCAN passes.");
+    http_seconds(seconds, sizeof(seconds), stats_counters[STATS_SCAN_TIME]);
+    json_write(&w, line, snprintf(line, sizeof(line), "frame4_scan_seconds_total %s\n", seconds));
+
+    // the histogram only has an le bound at every power of two to keep the page short
+    http_metric_head(&w, "frame4_command_duration_seconds", "histogram", "Time cmd_handler spent on each command.");
+    for (uint32_t i = 0; i < count; i++) {
+        cumulative = 0;
+
+        for (uint32_t b = 0; b < STATS_BUCKETS - 1; b++) {
+            cumulative += commands[i].buckets[b];
+
+            if (b >= STATS_SUB_BUCKETS - 1 && (b + 1) % STATS_SUB_BUCKETS) {
+                continue;
+            }
+
+            http_seconds(seconds, sizeof(seconds), stats_bucket_low(b + 1) - 1);
+            json_write(&w, line, snprintf(line, sizeof(line), "frame4_command_duration_seconds_bucket{cmd=\"0x%X\",le=\"%s\"} %llu\n", commands[i].cmd, seconds, cumulative));
+        }
+
+        json_write(&w, line, snprintf(line, sizeof(line), "frame4_command_duration_seconds_bucket{cmd=\"0x%X\",le=\"+Inf\"} %llu\n", commands[i].cmd, commands[i].count));
+
+        http_seconds(seconds, sizeof(seconds), commands[i].total);
+        json_write(&w, line, snprintf(line, sizeof(line), "frame4_command_duration_seconds_sum{cmd=\"0x%X\"} %s\n", commands[i].cmd, seconds));
+        json_write(&w, line, snprintf(line, sizeof(line), "frame4_command_duration_seconds_count{cmd=\"0x%X\"} %llu\n", commands[i].cmd, commands[i].count));
+    }
+
+    json_end(&w);
+
+    pool_free(req->fd, commands);
+}
+
+void http_trace_write(void *ctx, const char *data, uint32_t length) {
+    json_write((struct json_writer *)ctx, data, length);
+}
+
+// GET /trace, what the trace rings hold as a document chrome://tracing opens
+void handle_web_trace(struct http_request *req) {
+    struct trace_event *buffer;
+    struct json_writer w;
+
+    buffer = (struct trace_event *)pool_alloc(req->fd, TRACE_RING_EVENTS * TRACE_EVENT_SIZE);
+    if (!buffer) {
+        json_message(req, 500, "pfmalloc returned error");
+        return;
+    }
+
+    json_begin(&w, req, 200);
+    trace_chrome(&w, http_trace_write, buffer);
+    json_end(&w);
+
+    pool_free(req->fd, buffer);
+}
+
+void handle_web_client(struct http_request *req) {
+    if (!strcmp(req->path, "/ws")) {
+        ws_handshake(req);
+        return;
+    }
+    if (!strcmp(req->path, "/metrics")) {
+        handle_web_metrics(req);
+        return;
+    }
+    if (!strcmp(req->path, "/trace")) {
+        handle_web_trace(req);
+        return;
+    }
+    if (!strcmp(req->path, "/memory")) {
+        handle_web_memory(req);
+        return;
+    }
+    if (!strcmp(req->path, "/memory/batch")) {
+        handle_web_memory_batch(req);
+        return;
+    }
+    if (!strcmp(req->path, "/write-memory")) {
+        handle_web_write_memory(req);
+        return;
+    }
+    if (!strcmp(req->path, "/read-memory")) {
+        handle_web_read_memory(req);
+        return;
+    }
+    if (!strcmp(req->path, "/allocate-memory")) {
+        handle_web_allocate_memory(req);
+        return;
+    }
+    if (!strcmp(req->path, "/free-memory")) {
+        handle_web_free_meory(req);
+        return;
+    }
+    if (!strcmp(req->path, "/notify")) {
+        handle_web_notify(req);
+        return;
+    }
+    if (!strcmp(req->path, "/process-list")) {
+        handle_web_process_list(req);
+        return;
+    }
+    if (!strcmp(req->path, "/process-info")) {
+        handle_web_get_process_info(req);
+        return;
+    }
+    if (!strcmp(req->path, "/process-maps")) {
+        handle_web_process_maps(req);
+        return;
+    }
+    json_message(req, 200, "Default Server");
+}
+
+// returns the length of the request head including the blank line, 0 while it is incomplete
+uint32_t http_head_length(char *buffer, uint32_t used) {
+    for (uint32_t i = 3; i < used; i++) {
+        if (buffer[i] == '\n' && buffer[i - 1] == '\r' && buffer[i - 2] == '\n' && buffer[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// case insensitive header name match, returns the value with leading spaces skipped
+char *http_header_value(char *line, const char *name) {
+    while (*name) {
+        char c = *line;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+
+        if (c != *name) {
+            return NULL;
+        }
+
+        line++;
+        name++;
+    }
+
+    if (*line++ != ':') {
+        return NULL;
+    }
+
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+
+    return line;
+}
+
+char *http_next_line(char **p) {
+    char *line = *p;
+    char *end = strstr(line, "\r\n");
+
+    if (!end) {
+        *p = line + strlen(line);
+        return line;
+    }
+
+    *end = 0;
+    *p = end + 2;
+    return line;
+}
+
+// parses the head in place, returns the status to fail the request with or 0
+int http_parse(struct http_request *req, char *head, uint64_t *contentLength, int *expect) {
+    char *p = head;
+    char *line;
+    char *version;
+    char *value;
+    char *end;
+
+    line = http_next_line(&p);
+
+    req->method = line;
+    req->path = strstr(line, " ");
+    if (!req->path) {
+        return 400;
+    }
+
+    *req->path++ = 0;
+
+    version = strstr(req->path, " ");
+    if (!version) {
+        return 400;
+    }
+
+    *version++ = 0;
+
+    if (strncmp(version, "HTTP/1.", 7)) {
+        return 400;
+    }
+
+    // persistent by default from 1.1 on
+    req->http10 = version[7] == '0';
+    req->keepalive = !req->http10;
+
+    req->query = strstr(req->path, "?");
+    if (req->query) {
+        *req->query++ = 0;
+    }
+    else {
+        req->query = req->path + strlen(req->path);
+    }
+
+    *contentLength = 0;
+    *expect = 0;
+
+    while (*p) {
+        line = http_next_line(&p);
+        if (!*line) {
+            break;
+        }
+
+        if ((value = http_header_value(line, "content-length"))) {
+            *contentLength = strtoull(value, &end, 10);
+        }
+        else if ((value = http_header_value(line, "connection"))) {
+            if (strstr(value, "close") || strstr(value, "Close")) {
+                req->keepalive = 0;
+            }
+            else if (strstr(value, "keep-alive") || strstr(value, "Keep-Alive")) {
+                req->keepalive = 1;
+            }
+        }
+        else if ((value = http_header_value(line, "transfer-encoding"))) {
+            return 501;
+        }
+        else if ((value = http_header_value(line, "expect"))) {
+            *expect = 1;
+        }
+        else if ((value = http_header_value(line, "range"))) {
+            req->range = value;
+        }
+        else if ((value = http_header_value(line, "upgrade"))) {
+            req->upgrade = strstr(value, "websocket") || strstr(value, "WebSocket");
+        }
+        else if ((value = http_header_value(line, "sec-websocket-key"))) {
+            req->wskey = value;
+        }
+    }
+
+    return 0;
+}
+
+// serves every complete request on the connection, returns 0 to hand it back idle, 1 to close it
+// or 2 once it belongs to the WebSocket thread
+int http_serve(struct http_conn *conn) {
+    struct http_request req;
+    uint64_t contentLength;
+    uint64_t stalled;
+    uint32_t head;
+    uint32_t total;
+    int continued;
+    int expect;
+    int status;
+    int n;
+
+    stalled = 0;
+    continued = 0;
+
+    while (!unload_cmd_sent) {
+        head = http_head_length(conn->buffer, conn->used);
+
+        if (head) {
+            memset(&req, NULL, sizeof(req));
+            req.fd = conn->fd;
+            req.conn = conn;
+
+            // the head is parsed in a copy, the buffer still has to tell where the body starts
+            char headCopy[HTTP_MAX_HEAD + 1];
+            if (head > HTTP_MAX_HEAD) {
+                req.keepalive = 0;
+                http_send(&req, 431, "text/plain", NULL, 0);
+                return 1;
+            }
+
+            memcpy(headCopy, conn->buffer, head);
+            headCopy[head] = 0;
+
+            status = http_parse(&req, headCopy, &contentLength, &expect);
+            if (!status && contentLength > HTTP_MAX_BODY) {
+                status = 413;
+            }
+
+            if (status) {
+                req.keepalive = 0;
+                http_send(&req, status, "text/plain", NULL, 0);
+                return 1;
+            }
+
+            if (conn->used - head < contentLength && expect && !continued) {
+                net_send_data(conn->fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+                continued = 1;
+            }
+
+            // bodies that fit are buffered whole, larger ones are read by the handler as it goes
+            if (contentLength <= HTTP_BUFFER_SIZE - head && conn->used - head < contentLength) {
+                goto read;
+            }
+
+            req.body = conn->buffer + head;
+            req.length = contentLength;
+            req.buffered = conn->used - head < contentLength ? conn->used - head : contentLength;
+
+            handle_web_client(&req);
+
+            if (http_discard_body(&req)) {
+                return 1;
+            }
+
+            // a body larger than the buffer never has anything behind it in the buffer
+            total = head + req.buffered;
+
+            if (req.ws) {
+                ws_attach(req.ws, conn->buffer + total, conn->used - total);
+                return 2;
+            }
+
+            // pipelined requests behind this one stay in the buffer
+            for (uint32_t i = total; i < conn->used; i++) {
+                conn->buffer[i - total] = conn->buffer[i];
+            }
+
+            conn->used -= total;
+            conn->last = sceKernelGetProcessTime();
+            continued = 0;
+            stalled = 0;
+
+            if (!req.keepalive) {
+                return 1;
+            }
+
+            continue;
+        }
+
+        if (conn->used >= HTTP_MAX_HEAD) {
+            memset(&req, NULL, sizeof(req));
+            req.fd = conn->fd;
+            http_send(&req, 431, "text/plain", NULL, 0);
+            return 1;
+        }
+
+read:
+        errno = NULL;
+        n = read(conn->fd, conn->buffer + conn->used, HTTP_BUFFER_SIZE - conn->used);
+        if (n > 0) {
+            stats_add(STATS_BYTES_IN, n);
+            conn->used += n;
+            stalled = 0;
+            continue;
+        }
+
+        if (!n || (errno && errno != EWOULDBLOCK && errno != EINTR)) {
+            return 1;
+        }
+
+        // nothing started arriving, the accept loop watches it until the next request
+        if (!conn->used) {
+            return 0;
+        }
+
+        if (net_wait(conn->fd, POLLIN, &stalled)) {
+            return 1;
+        }
+    }
+
+    return 1;
+}
+
+void http_close(struct http_conn *conn) {
+    net_set_deadline(conn->fd, 0);
+    sceNetSocketClose(conn->fd);
+    free(conn->buffer);
+    memset(conn, NULL, sizeof(struct http_conn));
+    stats_sub(STATS_HTTP_CONNS, 1);
+}
+
+void *http_worker(void *arg) {
+    struct http_conn *conn;
+    int timeout;
+    int status;
+
+    while (!unload_cmd_sent) {
+        timeout = NET_POLL_WAIT * 1000;
+        if (waitSemaphore(http_sema, 1, &timeout)) {
+            continue;
+        }
+
+        scePthreadMutexLock(&http_mutex);
+        conn = NULL;
+        if (http_queue_count) {
+            conn = http_queue[http_queue_head];
+            http_queue_head = (http_queue_head + 1) % HTTP_MAX_CONNS;
+            http_queue_count--;
+            conn->state = HTTP_CONN_BUSY;
+        }
+        scePthreadMutexUnlock(&http_mutex);
+
+        if (!conn) {
+            continue;
+        }
+
+        status = http_serve(conn);
+        if (status == 2) {
+            // the socket lives on in the WebSocket thread, only the slot is given back
+            scePthreadMutexLock(&http_mutex);
+            free(conn->buffer);
+            memset(conn, NULL, sizeof(struct http_conn));
+            stats_sub(STATS_HTTP_CONNS, 1);
+            scePthreadMutexUnlock(&http_mutex);
+        }
+        else if (status) {
+            scePthreadMutexLock(&http_mutex);
+            http_close(conn);
+            scePthreadMutexUnlock(&http_mutex);
+        }
+        else {
+            // the accept loop picks it up on its next poll
+            scePthreadMutexLock(&http_mutex);
+            conn->state = HTTP_CONN_IDLE;
+            scePthreadMutexUnlock(&http_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+// called with http_mutex held
+void http_queue_push(struct http_conn *conn) {
+    conn->state = HTTP_CONN_QUEUED;
+    http_queue[(http_queue_head + http_queue_count) % HTTP_MAX_CONNS] = conn;
+    http_queue_count++;
+    signalSemaphore(http_sema, 1);
+}
+
+struct http_conn *http_alloc_conn(int fd) {
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        if (http_conns[i].state == HTTP_CONN_FREE) {
+            http_conns[i].buffer = (char *)pfmalloc(HTTP_BUFFER_SIZE);
+            if (!http_conns[i].buffer) {
+                return NULL;
+            }
+
+            http_conns[i].fd = fd;
+            http_conns[i].used = 0;
+            http_conns[i].last = sceKernelGetProcessTime();
+            stats_add(STATS_HTTP_CONNS, 1);
+            return &http_conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+int start_http() {
+    struct sockaddr_in serverAddress;
+    struct sockaddr_in clientAddress;
+    unsigned int clientAddressLength = sizeof(clientAddress);
+    struct pollfd pfds[HTTP_MAX_CONNS + 1];
+    struct http_conn *watched[HTTP_MAX_CONNS + 1];
+    struct http_conn *conn;
+    ScePthread thread;
+    uint64_t now;
+    int server;
+    int clientSocket;
+    int count;
+
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = IN_ADDR_ANY;
+    serverAddress.sin_port = sceNetHtons(HTTP_SERVER_PORT);
+
+    server = sceNetSocket("httpserver", AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        return 1;
+    }
+
+    int flag = 1;
+    sceNetSetsockopt(server, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+    // the accept below only runs once poll saw a connection, this just keeps a vanished one from blocking
+    int nbFlag = 1;
+    sceNetSetsockopt(server, SOL_SOCKET, SCE_NET_SO_NBIO, &nbFlag, sizeof(nbFlag));
+
+    int bindResponse = sceNetBind(server, (struct sockaddr*)&serverAddress, sizeof(serverAddress));
+    if (bindResponse) {
+        return 1;
+    }
+
+    int listenResponse = sceNetListen(server, HTTP_MAX_CONNS);
+    if (listenResponse) {
+        return 1;
+    }
+
+    for (int i = 0; i < HTTP_WORKERS; i++) {
+        scePthreadCreate(&thread, NULL, (void *)http_worker, NULL, "http_worker");
+    }
+
+    while (!unload_cmd_sent) {
+        // the listen socket and every idle keep-alive connection in one poll
+        pfds[0].fd = server;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        count = 1;
+
+        now = sceKernelGetProcessTime();
+
+        scePthreadMutexLock(&http_mutex);
+        for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+            conn = &http_conns[i];
+            if (conn->state != HTTP_CONN_IDLE) {
+                continue;
+            }
+
+            if (now - conn->last > (uint64_t)HTTP_IDLE_TIMEOUT * 1000) {
+                http_close(conn);
+                continue;
+            }
+
+            pfds[count].fd = conn->fd;
+            pfds[count].events = POLLIN;
+            pfds[count].revents = 0;
+            watched[count++] = conn;
+        }
+        scePthreadMutexUnlock(&http_mutex);
+
+        if (net_poll(pfds, count, NET_POLL_WAIT) <= 0) {
+            continue;
+        }
+
+        scePthreadMutexLock(&http_mutex);
+
+        for (int i = 1; i < count; i++) {
+            if (pfds[i].revents && watched[i]->state == HTTP_CONN_IDLE) {
+                http_queue_push(watched[i]);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            clientSocket = sceNetAccept(server, (struct sockaddr*)&clientAddress, &clientAddressLength);
+            if (clientSocket > -1) {
+                conn = http_alloc_conn(clientSocket);
+                if (conn) {
+                    configure_socket(clientSocket);
+                    net_set_deadline(clientSocket, HTTP_READ_TIMEOUT);
+                    http_queue_push(conn);
+                }
+                else {
+                    sceNetSocketClose(clientSocket);
+                }
+            }
+        }
+
+        scePthreadMutexUnlock(&http_mutex);
+    }
+
+    scePthreadMutexLock(&http_mutex);
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        if (http_conns[i].state == HTTP_CONN_IDLE || http_conns[i].state == HTTP_CONN_QUEUED) {
+            http_close(&http_conns[i]);
+        }
+    }
+    scePthreadMutexUnlock(&http_mutex);
+
+    sceNetSocketAbort(0, server);
+    sceNetSocketClose(server);
+    sceKernelUsleep(10000);
+    uprintf("Http server thread has ended!");
+    return 0;
+}
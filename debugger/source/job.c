@@ -0,0 +1,414 @@
+#include "job.h"
+#include "server.h"
+
+// commands that can run as a job, serial ones share global state and never run side by side
+struct job_command {
+    uint32_t cmd;
+    int serial;
+};
+
+const struct job_command job_commands[] = {
+    { CMD_PROC_READ, 0 },
+    { CMD_PROC_READ_VALID, 0 },
+    { CMD_PROC_ELF, 0 },
+    { CMD_PROC_AOB, 0 },
+    { CMD_PROC_PTR_GATHER, 0 },
+    { CMD_PROC_DUMP, 0 },
+    { CMD_PROC_HASH, 0 },
+    { CMD_PROC_SNAP_DIFF, 0 },
+    { CMD_PROC_STATE_SAVE, 0 },
+    { CMD_PROC_STATE_RESTORE, 0 },
+    { CMD_PROC_SCAN, 1 },
+    { CMD_PROC_SCAN_GET_RESULTS, 1 },
+    { CMD_KERN_READ, 0 },
+    { CMD_KERN_PHYS_READ, 0 },
+};
+#define JOB_COMMANDS (sizeof(job_commands) / sizeof(job_commands[0]))
+
+struct job jobs[JOB_MAX];
+ScePthreadMutex job_mutex;
+uint32_t job_next_id;
+uint64_t job_seq;
+int job_workers;
+int job_last_client;
+
+void job_init() {
+    memset(jobs, NULL, sizeof(jobs));
+    scePthreadMutexInit(&job_mutex, NULL, "jobmutex");
+    job_next_id = 0;
+    job_seq = 0;
+    job_workers = 0;
+    job_last_client = 0;
+}
+
+// call with job_mutex held
+void job_release(struct job *job) {
+    net_capture_close(job->fd);
+
+    if (job->input) {
+        free(job->input);
+    }
+
+    if (job->capture.out) {
+        free(job->capture.out);
+    }
+
+    memset(job, NULL, sizeof(struct job));
+}
+
+// call with job_mutex held
+struct job *job_find(struct server_client *svc, uint32_t id) {
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_STATE_FREE && jobs[i].id == id && jobs[i].svc == svc) {
+            return &jobs[i];
+        }
+    }
+
+    return NULL;
+}
+
+// highest priority first, then round robin over the clients, then oldest first
+// call with job_mutex held
+struct job *job_next() {
+    struct job *best;
+    int serial;
+    int client;
+
+    serial = 0;
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state == JOB_STATE_RUNNING && jobs[i].serial) {
+            serial = 1;
+        }
+    }
+
+    for (uint32_t priority = 0; priority < JOB_PRIORITIES; priority++) {
+        for (int n = 1; n <= SERVER_MAXCLIENTS; n++) {
+            client = (job_last_client + n) % SERVER_MAXCLIENTS;
+            best = NULL;
+
+            for (int i = 0; i < JOB_MAX; i++) {
+                if (jobs[i].state != JOB_STATE_QUEUED || jobs[i].priority != priority) {
+                    continue;
+                }
+
+                if (!jobs[i].svc || jobs[i].svc - servclients != client) {
+                    continue;
+                }
+
+                if (jobs[i].serial && serial) {
+                    continue;
+                }
+
+                if (!best || jobs[i].seq < best->seq) {
+                    best = &jobs[i];
+                }
+            }
+
+            if (best) {
+                job_last_client = client;
+                return best;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void *job_worker(void *arg) {
+    struct job *job;
+    int r;
+
+    scePthreadMutexLock(&job_mutex);
+
+    while (!unload_cmd_sent) {
+        job = job_next();
+        if (!job) {
+            break;
+        }
+
+        job->state = JOB_STATE_RUNNING;
+        scePthreadMutexUnlock(&job_mutex);
+
+        r = cmd_handler(job->fd, &job->packet);
+
+        scePthreadMutexLock(&job_mutex);
+
+        net_capture_close(job->fd);
+        job->fd = -1;
+
+        // the job was cancelled or its client went away while it ran
+        if (job->capture.cancel || !job->svc) {
+            job_release(job);
+            continue;
+        }
+
+        job->state = r || job->capture.overflow ? JOB_STATE_FAILED : JOB_STATE_DONE;
+
+        free(job->input);
+        job->input = NULL;
+    }
+
+    job_workers--;
+    scePthreadMutexUnlock(&job_mutex);
+
+    trace_thread_exit();
+
+    return NULL;
+}
+
+void job_remove_client(struct server_client *svc) {
+    scePthreadMutexLock(&job_mutex);
+
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state == JOB_STATE_FREE || jobs[i].svc != svc) {
+            continue;
+        }
+
+        // a running job is released by its worker
+        if (jobs[i].state == JOB_STATE_RUNNING) {
+            jobs[i].capture.cancel = 1;
+            jobs[i].svc = NULL;
+        }
+        else {
+            job_release(&jobs[i]);
+        }
+    }
+
+    scePthreadMutexUnlock(&job_mutex);
+}
+
+int job_submit_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_job_submit_packet *sp;
+    struct cmd_job_submit_response resp;
+    struct server_client *svc;
+    struct job *job;
+    ScePthread thread;
+    uint64_t length;
+    int serial;
+    int count;
+
+    sp = (struct cmd_job_submit_packet *)packet->data;
+
+    if (!sp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    length = (uint64_t)sp->datalen + sp->inputlen;
+    if (packet->datalen != CMD_JOB_SUBMIT_PACKET_SIZE + length || length > JOB_MAX_INPUT || sp->priority >= JOB_PRIORITIES) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 0;
+    }
+
+    serial = -1;
+    for (uint32_t i = 0; i < JOB_COMMANDS; i++) {
+        if (job_commands[i].cmd == sp->cmd) {
+            serial = job_commands[i].serial;
+        }
+    }
+
+    svc = find_client(fd);
+    if (serial < 0 || !svc) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    scePthreadMutexLock(&job_mutex);
+
+    job = NULL;
+    count = 0;
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state == JOB_STATE_FREE) {
+            if (!job) {
+                job = &jobs[i];
+            }
+        }
+        else if (jobs[i].svc == svc) {
+            count++;
+        }
+    }
+
+    if (!job || count >= JOB_MAX_PER_CLIENT) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(job, NULL, sizeof(struct job));
+
+    job->input = (uint8_t *)malloc(length ? length : 1);
+    if (!job->input) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 0;
+    }
+
+    memcpy(job->input, (uint8_t *)packet->data + CMD_JOB_SUBMIT_PACKET_SIZE, length);
+
+    job->fd = net_capture_open(&job->capture);
+    if (job->fd < 0) {
+        job->fd = 0;
+        job_release(job);
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    job->id = ++job_next_id;
+    job->cmd = sp->cmd;
+    job->priority = sp->priority;
+    job->serial = serial;
+    job->svc = svc;
+    job->seq = ++job_seq;
+
+    job->packet.magic = PACKET_MAGIC;
+    job->packet.cmd = sp->cmd;
+    job->packet.datalen = sp->datalen;
+    job->packet.data = sp->datalen ? job->input : NULL;
+
+    job->capture.in = job->input + sp->datalen;
+    job->capture.inlength = sp->inputlen;
+    job->capture.outmax = JOB_MAX_RESULT;
+
+    job->state = JOB_STATE_QUEUED;
+
+    if (job_workers < JOB_WORKERS) {
+        job_workers++;
+        scePthreadCreate(&thread, NULL, (void *)job_worker, NULL, "job_worker");
+    }
+
+    resp.id = job->id;
+
+    scePthreadMutexUnlock(&job_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_JOB_SUBMIT_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int job_status_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_job_status_packet *sp;
+    struct cmd_job_status_response resp;
+    struct job *job;
+
+    sp = (struct cmd_job_status_packet *)packet->data;
+
+    if (!sp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    scePthreadMutexLock(&job_mutex);
+
+    job = job_find(find_client(fd), sp->id);
+    if (!job) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    resp.state = job->capture.cancel ? JOB_STATE_CANCELLED : job->state;
+    resp.cmd = job->cmd;
+    resp.length = job->capture.outlength;
+
+    scePthreadMutexUnlock(&job_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_JOB_STATUS_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int job_cancel_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_job_cancel_packet *cp;
+    struct job *job;
+
+    cp = (struct cmd_job_cancel_packet *)packet->data;
+
+    if (!cp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    scePthreadMutexLock(&job_mutex);
+
+    job = job_find(find_client(fd), cp->id);
+    if (!job) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    // a running job keeps its slot until its worker stops and releases it
+    if (job->state == JOB_STATE_RUNNING) {
+        job->capture.cancel = 1;
+    }
+    else {
+        job_release(job);
+    }
+
+    scePthreadMutexUnlock(&job_mutex);
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    return 0;
+}
+
+int job_fetch_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_job_fetch_packet *fp;
+    struct net_response reply;
+    struct job *job;
+    uint32_t length;
+    uint32_t chunk;
+
+    fp = (struct cmd_job_fetch_packet *)packet->data;
+
+    if (!fp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    scePthreadMutexLock(&job_mutex);
+
+    job = job_find(find_client(fd), fp->id);
+    if (!job) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    // the result only stops moving once the worker is done with it
+    if (job->state != JOB_STATE_DONE && job->state != JOB_STATE_FAILED) {
+        scePthreadMutexUnlock(&job_mutex);
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    length = 0;
+    if (fp->offset < job->capture.outlength) {
+        length = fp->length;
+        if (length > job->capture.outlength - fp->offset) {
+            length = job->capture.outlength - fp->offset;
+        }
+    }
+
+    // a finished job is only ever released from this client's own thread
+    scePthreadMutexUnlock(&job_mutex);
+
+    net_response_init(&reply, CMD_SUCCESS);
+    net_response_add(&reply, &length, sizeof(uint32_t));
+    if (net_response_send(fd, &reply) < 0) {
+        return 1;
+    }
+
+    // a large result goes out in quanta like any other bulk reply
+    for (uint32_t sent = 0; sent < length; sent += chunk) {
+        qos_quantum(fd);
+
+        chunk = length - sent > NET_MAX_LENGTH ? NET_MAX_LENGTH : length - sent;
+        if (net_send_data(fd, job->capture.out + fp->offset + sent, chunk) < 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include "json.h"
+#include "server.h"
+
+// a small response leaves as one writev of the head, the only chunk and the last chunk
+void json_flush(struct json_writer *w, int last) {
+    struct iovec iov[5];
+    char size[16];
+    int count;
+
+    if (w->failed) {
+        w->used = 0;
+        return;
+    }
+
+    count = 0;
+
+    if (w->headlength) {
+        iov[count].iov_base = w->head;
+        iov[count++].iov_len = w->headlength;
+        w->headlength = 0;
+    }
+
+    if (w->used) {
+        if (w->chunked) {
+            iov[count].iov_base = size;
+            iov[count++].iov_len = snprintf(size, sizeof(size), "%x\r\n", w->used);
+        }
+
+        iov[count].iov_base = w->buffer;
+        iov[count++].iov_len = w->used;
+
+        if (w->chunked) {
+            iov[count].iov_base = "\r\n";
+            iov[count++].iov_len = 2;
+        }
+    }
+
+    if (last && w->chunked) {
+        iov[count].iov_base = "0\r\n\r\n";
+        iov[count++].iov_len = 5;
+    }
+
+    if (count && net_send_datav(w->req->fd, iov, count) < 0) {
+        w->failed = 1;
+    }
+
+    w->used = 0;
+}
+
+// any other text body can be streamed through the same writer with json_write
+void json_begin_type(struct json_writer *w, struct http_request *req, int status, const char *type) {
+    w->req = req;
+    w->chunked = !req->http10;
+    w->failed = 0;
+    w->depth = 0;
+    w->key = 0;
+    w->used = 0;
+
+    // without chunks the end of the body is the end of the connection
+    if (!w->chunked) {
+        req->keepalive = 0;
+    }
+
+    w->headlength = snprintf(w->head, sizeof(w->head),
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Connection: %s\r\n"
+        "%s\r\n",
+        status, http_reason(status), type, req->keepalive ? "keep-alive" : "close", w->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+}
+
+void json_begin(struct json_writer *w, struct http_request *req, int status) {
+    json_begin_type(w, req, status, "application/json");
+}
+
+void json_end(struct json_writer *w) {
+    json_flush(w, 1);
+}
+
+void json_write(struct json_writer *w, const char *data, uint32_t length) {
+    uint32_t n;
+
+    while (length) {
+        if (w->used == JSON_BUFFER_SIZE) {
+            json_flush(w, 0);
+        }
+
+        n = JSON_BUFFER_SIZE - w->used;
+        if (n > length) {
+            n = length;
+        }
+
+        memcpy(w->buffer + w->used, data, n);
+        w->used += n;
+        data += n;
+        length -= n;
+    }
+}
+
+void json_putc(struct json_writer *w, char c) {
+    if (w->used == JSON_BUFFER_SIZE) {
+        json_flush(w, 0);
+    }
+
+    w->buffer[w->used++] = c;
+}
+
+// the comma in front of every value but the first one on a level
+void json_value(struct json_writer *w) {
+    if (w->key) {
+        w->key = 0;
+        return;
+    }
+
+    if (w->depth && w->depth <= JSON_MAX_DEPTH) {
+        if (!w->first[w->depth - 1]) {
+            json_putc(w, ',');
+        }
+
+        w->first[w->depth - 1] = 0;
+    }
+}
+
+void json_open(struct json_writer *w, char c) {
+    json_value(w);
+    json_putc(w, c);
+
+    if (w->depth < JSON_MAX_DEPTH) {
+        w->first[w->depth] = 1;
+    }
+
+    w->depth++;
+}
+
+void json_close(struct json_writer *w, char c) {
+    if (w->depth) {
+        w->depth--;
+    }
+
+    json_putc(w, c);
+}
+
+void json_object_begin(struct json_writer *w) {
+    json_open(w, '{');
+}
+
+void json_object_end(struct json_writer *w) {
+    json_close(w, '}');
+}
+
+void json_array_begin(struct json_writer *w) {
+    json_open(w, '[');
+}
+
+void json_array_end(struct json_writer *w) {
+    json_close(w, ']');
+}
+
+void json_escape(struct json_writer *w, const char *s) {
+    const char *hex = "0123456789abcdef";
+
+    for (; *s; s++) {
+        unsigned char c = *s;
+
+        if (c == '"' || c == '\\') {
+            json_putc(w, '\\');
+            json_putc(w, c);
+        }
+        else if (c < 0x20) {
+            json_write(w, "\\u00", 4);
+            json_putc(w, hex[c >> 4]);
+            json_putc(w, hex[c & 15]);
+        }
+        else {
+            json_putc(w, c);
+        }
+    }
+}
+
+void json_key(struct json_writer *w, const char *name) {
+    json_value(w);
+    json_putc(w, '"');
+    json_escape(w, name);
+    json_write(w, "\":", 2);
+    w->key = 1;
+}
+
+void json_string(struct json_writer *w, const char *s) {
+    json_value(w);
+    json_putc(w, '"');
+    json_escape(w, s);
+    json_putc(w, '"');
+}
+
+// for strings written piece by piece with json_write, which does no escaping
+void json_string_begin(struct json_writer *w) {
+    json_value(w);
+    json_putc(w, '"');
+}
+
+void json_string_end(struct json_writer *w) {
+    json_putc(w, '"');
+}
+
+void json_int(struct json_writer *w, int64_t v) {
+    char s[24];
+
+    json_value(w);
+    json_write(w, s, snprintf(s, sizeof(s), "%lld", v));
+}
+
+// addresses stay strings, javascript numbers can not hold 64 bits
+void json_hex(struct json_writer *w, uint64_t v) {
+    char s[24];
+
+    json_value(w);
+    json_write(w, s, snprintf(s, sizeof(s), "\"0x%llX\"", v));
+}
+
+void json_bool(struct json_writer *w, bool v) {
+    json_value(w);
+    json_write(w, v ? "true" : "false", v ? 4 : 5);
+}
+
+void json_message(struct http_request *req, int status, const char *message) {
+    struct json_writer w;
+
+    json_begin(&w, req, status);
+    json_object_begin(&w);
+    json_key(&w, "message");
+    json_string(&w, message);
+    json_object_end(&w);
+    json_end(&w);
+}
+
+void json_success(struct http_request *req) {
+    struct json_writer w;
+
+    json_begin(&w, req, 200);
+    json_object_begin(&w);
+    json_key(&w, "success");
+    json_bool(&w, true);
+    json_object_end(&w);
+    json_end(&w);
+}
@@ -1,4 +1,6 @@
 #include "kdbg.h"
+#include "stats.h"
+#include "trace.h"
 
 void prefault(void *address, size_t size) {
     volatile uint8_t *ptr = (uint8_t *)address;
@@ -38,7 +40,26 @@ int sys_proc_list(struct proc_list_entry *procs, uint64_t *num) {
 
 // custom syscall 108
 int sys_proc_rw(uint64_t pid, uint64_t address, void *data, uint64_t length, uint64_t write) {
-    return syscall(108, pid, address, data, length, write);
+    stats_add(STATS_PROC_RW_CALLS, 1);
+    stats_add(STATS_PROC_RW_BYTES, length);
+
+    trace_begin(TRACE_PROC_RW, length);
+    int r = syscall(108, pid, address, data, length, write, NULL);
+    trace_end(TRACE_PROC_RW);
+
+    return r;
+}
+
+// same as sys_proc_rw but also reports how many bytes were transferred before a fault
+int sys_proc_rw_n(uint64_t pid, uint64_t address, void *data, uint64_t length, uint64_t write, uint64_t *n) {
+    stats_add(STATS_PROC_RW_CALLS, 1);
+    stats_add(STATS_PROC_RW_BYTES, length);
+
+    trace_begin(TRACE_PROC_RW, length);
+    int r = syscall(108, pid, address, data, length, write, n);
+    trace_end(TRACE_PROC_RW);
+
+    return r;
 }
 
 // custom syscall 109
@@ -1,18 +1,20 @@
 #include "kern.h"
+#include "compress.h"
+#include "qos.h"
 
 int kern_base_handle(int fd, struct cmd_packet *packet) {
     uint64_t kernbase;
 
     sys_kern_base(&kernbase);
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &kernbase, sizeof(uint64_t));
+    net_send_response(fd, CMD_SUCCESS, &kernbase, sizeof(uint64_t));
 
     return 0;
 }
 
 int kern_read_handle(int fd, struct cmd_packet *packet) {
     struct cmd_kern_read_packet *rp;
+    struct compress_ctx *ctx;
     void *data;
     uint64_t left;
     uint64_t address;
@@ -20,37 +22,42 @@ int kern_read_handle(int fd, struct cmd_packet *packet) {
     rp = (struct cmd_kern_read_packet *)packet->data;
 
     if (rp) {
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 1;
         }
 
+        ctx = compress_alloc(fd);
+
         net_send_status(fd, CMD_SUCCESS);
 
         left = rp->length;
         address = rp->address;
 
-        while (left > 0) {
+        while (left > 0 && !net_cancelled(fd)) {
+            qos_quantum(fd);
+
             memset(data, NULL, NET_MAX_LENGTH);
 
             if (left > NET_MAX_LENGTH) {
                 sys_kern_rw(address, data, NET_MAX_LENGTH, 0);
-                net_send_data(fd, data, NET_MAX_LENGTH);
+                compress_send_chunk(fd, ctx, data, NET_MAX_LENGTH, COMPRESS_METHOD_LZ4);
 
                 address += NET_MAX_LENGTH;
                 left -= NET_MAX_LENGTH;
             }
             else {
                 sys_kern_rw(address, data, left, 0);
-                net_send_data(fd, data, left);
+                compress_send_chunk(fd, ctx, data, left, COMPRESS_METHOD_LZ4);
 
                 address += left;
                 left -= left;
             }
         }
 
-        free(data);
+        compress_free(ctx);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -67,7 +74,7 @@ int kern_write_handle(int fd, struct cmd_packet *packet) {
     wp = (struct cmd_kern_write_packet *)packet->data;
 
     if(wp) {
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 1;
@@ -79,6 +86,8 @@ int kern_write_handle(int fd, struct cmd_packet *packet) {
         address = wp->address;
 
         while (left > 0) {
+            qos_quantum(fd);
+
             if (left > NET_MAX_LENGTH) {
                 net_recv_data(fd, data, NET_MAX_LENGTH, 1);
                 sys_kern_rw(address, data, NET_MAX_LENGTH, 1);
@@ -97,7 +106,7 @@ int kern_write_handle(int fd, struct cmd_packet *packet) {
 
         net_send_status(fd, CMD_SUCCESS);
 
-        free(data);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -130,8 +139,7 @@ int kern_vm_map_handle(int fd, struct cmd_packet *packet) {
         return 1;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &args.num, sizeof(uint32_t));
+    net_send_response(fd, CMD_SUCCESS, &args.num, sizeof(uint32_t));
     net_send_data(fd, args.maps, size);
 
     free(args.maps);
@@ -150,8 +158,7 @@ int kern_rdmsr_handle(int fd, struct cmd_packet *packet) {
         return 1;
     }
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &args.msr, sizeof(uint64_t));
+    net_send_response(fd, CMD_SUCCESS, &args.msr, sizeof(uint64_t));
 
     return 0;
 }
@@ -159,6 +166,7 @@ int kern_rdmsr_handle(int fd, struct cmd_packet *packet) {
 int kern_phys_read_handle(int fd, struct cmd_packet *packet) {
     struct sys_kern_phys_rw_args args;
     struct cmd_kern_phys_read_packet *rp;
+    struct compress_ctx *ctx;
     void *data;
     uint64_t left;
     uint64_t address;
@@ -166,18 +174,22 @@ int kern_phys_read_handle(int fd, struct cmd_packet *packet) {
     rp = (struct cmd_kern_phys_read_packet *)packet->data;
 
     if (rp) {
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 1;
         }
 
+        ctx = compress_alloc(fd);
+
         net_send_status(fd, CMD_SUCCESS);
 
         left = rp->length;
         address = rp->address;
 
-        while (left > 0) {
+        while (left > 0 && !net_cancelled(fd)) {
+            qos_quantum(fd);
+
             memset(data, NULL, NET_MAX_LENGTH);
 
             if (left > NET_MAX_LENGTH) {
@@ -186,7 +198,7 @@ int kern_phys_read_handle(int fd, struct cmd_packet *packet) {
                 args.length = NET_MAX_LENGTH;
                 args.write = 0;
                 sys_kern_cmd(SYS_KERN_CMD_PHYS_RW, &args);
-                net_send_data(fd, data, NET_MAX_LENGTH);
+                compress_send_chunk(fd, ctx, data, NET_MAX_LENGTH, COMPRESS_METHOD_LZ4);
 
                 address += NET_MAX_LENGTH;
                 left -= NET_MAX_LENGTH;
@@ -197,14 +209,15 @@ int kern_phys_read_handle(int fd, struct cmd_packet *packet) {
                 args.length = left;
                 args.write = 0;
                 sys_kern_cmd(SYS_KERN_CMD_PHYS_RW, &args);
-                net_send_data(fd, data, left);
+                compress_send_chunk(fd, ctx, data, left, COMPRESS_METHOD_LZ4);
 
                 address += left;
                 left -= left;
             }
         }
 
-        free(data);
+        compress_free(ctx);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -222,7 +235,7 @@ int kern_phys_write_handle(int fd, struct cmd_packet *packet) {
     wp = (struct cmd_kern_write_packet *)packet->data;
 
     if(wp) {
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 1;
@@ -234,6 +247,8 @@ int kern_phys_write_handle(int fd, struct cmd_packet *packet) {
         address = wp->address;
 
         while (left > 0) {
+            qos_quantum(fd);
+
             if (left > NET_MAX_LENGTH) {
                 net_recv_data(fd, data, NET_MAX_LENGTH, 1);
                 args.address = address;
@@ -260,7 +275,7 @@ int kern_phys_write_handle(int fd, struct cmd_packet *packet) {
 
         net_send_status(fd, CMD_SUCCESS);
 
-        free(data);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -32,6 +32,20 @@ int _main(void) {
     mkdir("/data/scan_temp/init", 0777);
     mkdir("/data/scan_temp/cur", 0777);
     mkdir("/data/scan_temp/old", 0777);
+    proc_scan_init();
+
+    // memory subscriptions, recorder, snapshots and background jobs
+    stats_init();
+    trace_init();
+    sub_init();
+    record_init();
+    snap_init();
+    state_init();
+    job_init();
+    qos_init();
+    transfer_init();
+    http_init();
+    ws_init();
 
     // start the http server
     ScePthread socketServerThread;
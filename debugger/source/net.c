@@ -1,43 +1,377 @@
 #include <stdarg.h>
 #include "net.h"
+#include "stats.h"
+#include "trace.h"
 
 int net_select(int fd, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
     return syscall(93, fd, readfds, writefds, exceptfds, timeout);
 }
 
-int net_send_data(int fd, void *data, int length) {
+int net_poll(struct pollfd *fds, unsigned int nfds, int timeout) {
+    return syscall(209, fds, nfds, timeout);
+}
+
+int net_writev(int fd, struct iovec *iov, int iovcnt) {
+    return syscall(121, fd, iov, iovcnt);
+}
+
+// deadline in ms per socket, 0 means NET_DEADLINE
+uint32_t net_deadlines[FD_SETSIZE];
+
+void net_set_deadline(int fd, uint32_t deadline) {
+    if (fd >= 0 && fd < FD_SETSIZE) {
+        net_deadlines[fd] = deadline;
+    }
+}
+
+// sleeps until the socket is ready instead of spinning on EWOULDBLOCK
+// stalled is the process time the transfer last made progress, returns 1 once the deadline passed
+int net_wait(int fd, short events, uint64_t *stalled) {
+    struct pollfd pfd;
+    uint64_t now;
+    uint32_t deadline;
+
+    now = sceKernelGetProcessTime();
+    if (!*stalled) {
+        *stalled = now;
+    }
+
+    deadline = NET_DEADLINE;
+    if (fd >= 0 && fd < FD_SETSIZE && net_deadlines[fd]) {
+        deadline = net_deadlines[fd];
+    }
+
+    if (now - *stalled >= (uint64_t)deadline * 1000) {
+        errno = ETIMEDOUT;
+        return 1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    trace_begin(TRACE_NET_WAIT, events);
+    net_poll(&pfd, 1, NET_POLL_WAIT);
+    trace_end(TRACE_NET_WAIT);
+
+    errno = NULL;
+    return 0;
+}
+
+int net_write_data(int fd, void *data, int length) {
     int left = length;
     int offset = 0;
     int sent = 0;
+    uint64_t stalled = 0;
 
     errno = NULL;
 
     while (left > 0) {
+        trace_begin(TRACE_NET_SEND, left);
         if (left > NET_MAX_LENGTH) {
             sent = write(fd, data + offset, NET_MAX_LENGTH);
         }
         else {
             sent = write(fd, data + offset, left);
         }
+        trace_end(TRACE_NET_SEND);
 
         if (sent <= 0) {
-            if (errno && errno != EWOULDBLOCK) {
+            if (errno && errno != EWOULDBLOCK && errno != EINTR) {
                 return sent;
             }
+
+            if (net_wait(fd, POLLOUT, &stalled)) {
+                return -1;
+            }
         }
         else {
             offset += sent;
             left -= sent;
+            stalled = 0;
+            stats_add(STATS_BYTES_OUT, sent);
         }
     }
 
     return offset;
 }
 
+// gathers header and payload into one write, iov is advanced past whatever has been sent
+int net_write_datav(int fd, struct iovec *iov, int iovcnt) {
+    int total = 0;
+    int sent = 0;
+    uint64_t stalled = 0;
+
+    errno = NULL;
+
+    while (iovcnt > 0) {
+        if (!iov->iov_len) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+
+        trace_begin(TRACE_NET_SEND, iov->iov_len);
+        sent = net_writev(fd, iov, iovcnt > NET_MAX_IOV ? NET_MAX_IOV : iovcnt);
+        trace_end(TRACE_NET_SEND);
+
+        if (sent <= 0) {
+            if (errno && errno != EWOULDBLOCK && errno != EINTR) {
+                return sent;
+            }
+
+            if (net_wait(fd, POLLOUT, &stalled)) {
+                return -1;
+            }
+
+            continue;
+        }
+
+        total += sent;
+        stalled = 0;
+        stats_add(STATS_BYTES_OUT, sent);
+
+        // partial writes leave the rest of the current buffer for the next round
+        while (sent > 0) {
+            if ((size_t)sent >= iov->iov_len) {
+                sent -= iov->iov_len;
+                iov++;
+                iovcnt--;
+            }
+            else {
+                iov->iov_base = (uint8_t *)iov->iov_base + sent;
+                iov->iov_len -= sent;
+                sent = 0;
+            }
+        }
+    }
+
+    return total;
+}
+
+struct net_cork *net_corks[FD_SETSIZE];
+
+struct net_cork *net_get_cork(int fd) {
+    if (fd < 0 || fd >= FD_SETSIZE) {
+        return NULL;
+    }
+
+    return net_corks[fd];
+}
+
+void net_cork(int fd, struct net_cork *cork) {
+    if (fd < 0 || fd >= FD_SETSIZE) {
+        return;
+    }
+
+    cork->used = 0;
+    net_corks[fd] = cork;
+}
+
+int net_uncork(int fd) {
+    int r;
+
+    r = net_flush(fd);
+    if (fd >= 0 && fd < FD_SETSIZE) {
+        net_corks[fd] = NULL;
+    }
+
+    return r;
+}
+
+int net_flush(int fd) {
+    struct net_cork *cork;
+    int r;
+
+    cork = net_get_cork(fd);
+    if (!cork || !cork->used) {
+        return 0;
+    }
+
+    r = net_write_data(fd, cork->buffer, cork->used);
+    cork->used = 0;
+
+    return r;
+}
+
+int net_send_data(int fd, void *data, int length) {
+    struct iovec iov;
+
+    iov.iov_base = data;
+    iov.iov_len = length;
+
+    return net_send_datav(fd, &iov, 1);
+}
+
+struct net_capture *net_captures[NET_MAX_VFD];
+
+struct net_capture *net_get_capture(int fd) {
+    if (fd < NET_VFD_BASE || fd >= NET_VFD_BASE + NET_MAX_VFD) {
+        return NULL;
+    }
+
+    return net_captures[fd - NET_VFD_BASE];
+}
+
+// returns the virtual socket, or -1 if all are in use
+int net_capture_open(struct net_capture *cap) {
+    for (int i = 0; i < NET_MAX_VFD; i++) {
+        if (!net_captures[i]) {
+            net_captures[i] = cap;
+            return NET_VFD_BASE + i;
+        }
+    }
+
+    return -1;
+}
+
+void net_capture_close(int fd) {
+    if (net_get_capture(fd)) {
+        net_captures[fd - NET_VFD_BASE] = NULL;
+    }
+}
+
+// long running handlers check this between chunks so a cancelled job stops early
+int net_cancelled(int fd) {
+    struct net_capture *cap;
+
+    cap = net_get_capture(fd);
+
+    return cap && cap->cancel;
+}
+
+int net_capture_write(struct net_capture *cap, struct iovec *iov, int iovcnt) {
+    uint64_t length;
+    uint64_t size;
+    uint8_t *out;
+
+    if (cap->cancel) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    if (cap->outlength + length > cap->outmax) {
+        cap->overflow = 1;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (cap->outlength + length > cap->outcap) {
+        size = cap->outcap ? cap->outcap : NET_CAPTURE_MIN;
+        while (size < cap->outlength + length) {
+            size *= 2;
+        }
+
+        if (size > cap->outmax) {
+            size = cap->outmax;
+        }
+
+        out = (uint8_t *)realloc(cap->out, size);
+        if (!out) {
+            cap->overflow = 1;
+            errno = ENOMEM;
+            return -1;
+        }
+
+        cap->out = out;
+        cap->outcap = size;
+    }
+
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(cap->out + cap->outlength, iov[i].iov_base, iov[i].iov_len);
+        cap->outlength += iov[i].iov_len;
+    }
+
+    return length;
+}
+
+int net_capture_read(struct net_capture *cap, void *data, int length) {
+    if (length > cap->inlength - cap->inpos) {
+        length = cap->inlength - cap->inpos;
+    }
+
+    memcpy(data, cap->in + cap->inpos, length);
+    cap->inpos += length;
+
+    return length;
+}
+
+// returns the number of bytes taken from iov, buffered or sent
+int net_send_datav(int fd, struct iovec *iov, int iovcnt) {
+    struct iovec gather[NET_MAX_IOV + 1];
+    struct net_capture *cap;
+    struct net_cork *cork;
+    uint32_t length;
+    int r;
+
+    cap = net_get_capture(fd);
+    if (cap) {
+        return net_capture_write(cap, iov, iovcnt);
+    }
+
+    cork = net_get_cork(fd);
+    if (!cork) {
+        return net_write_datav(fd, iov, iovcnt);
+    }
+
+    length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    if (cork->used + length <= NET_CORK_SIZE) {
+        for (int i = 0; i < iovcnt; i++) {
+            memcpy(cork->buffer + cork->used, iov[i].iov_base, iov[i].iov_len);
+            cork->used += iov[i].iov_len;
+        }
+
+        return length;
+    }
+
+    if (!cork->used || iovcnt > NET_MAX_IOV) {
+        if (net_flush(fd) < 0) {
+            return -1;
+        }
+
+        return net_write_datav(fd, iov, iovcnt);
+    }
+
+    // whatever is buffered goes out in front of the payload
+    gather[0].iov_base = cork->buffer;
+    gather[0].iov_len = cork->used;
+    memcpy(&gather[1], iov, iovcnt * sizeof(struct iovec));
+
+    r = net_write_datav(fd, gather, iovcnt + 1);
+    if (r < 0) {
+        cork->used = 0;
+        return r;
+    }
+
+    r -= cork->used;
+    cork->used = 0;
+
+    return r;
+}
+
 int net_recv_data(int fd, void *data, int length, int force) {
     int left = length;
     int offset = 0;
     int recv = 0;
+    uint64_t stalled = 0;
+    struct net_capture *cap;
+
+    cap = net_get_capture(fd);
+    if (cap) {
+        return net_capture_read(cap, data, length);
+    }
+
+    // the client may be waiting on a reply before it sends more
+    net_flush(fd);
 
     errno = NULL;
 
@@ -51,9 +385,18 @@ int net_recv_data(int fd, void *data, int length, int force) {
 
         if (recv <= 0) {
             if (force) {
-                if(errno && errno != EWOULDBLOCK) {
+                if(errno && errno != EWOULDBLOCK && errno != EINTR) {
                     return recv;
                 }
+
+                // a closed connection reads 0 without an error
+                if (!recv && !errno) {
+                    return offset;
+                }
+
+                if (net_wait(fd, POLLIN, &stalled)) {
+                    return offset;
+                }
             }
             else {
                 return offset;
@@ -62,6 +405,8 @@ int net_recv_data(int fd, void *data, int length, int force) {
         else {
             offset += recv;
             left -= recv;
+            stalled = 0;
+            stats_add(STATS_BYTES_IN, recv);
         }
     }
 
@@ -74,6 +419,40 @@ int net_send_status(int fd, uint32_t status) {
     return net_send_data(fd, &d, sizeof(uint32_t));
 }
 
+void net_response_init(struct net_response *resp, uint32_t status) {
+    resp->status = status;
+    resp->iov[0].iov_base = &resp->status;
+    resp->iov[0].iov_len = sizeof(uint32_t);
+    resp->count = 1;
+}
+
+int net_response_add(struct net_response *resp, void *data, uint32_t length) {
+    if (resp->count >= NET_MAX_IOV) {
+        return 1;
+    }
+
+    if (length) {
+        resp->iov[resp->count].iov_base = data;
+        resp->iov[resp->count].iov_len = length;
+        resp->count++;
+    }
+
+    return 0;
+}
+
+int net_response_send(int fd, struct net_response *resp) {
+    return net_send_datav(fd, resp->iov, resp->count);
+}
+
+int net_send_response(int fd, uint32_t status, void *data, uint32_t length) {
+    struct net_response resp;
+
+    net_response_init(&resp, status);
+    net_response_add(&resp, data, length);
+
+    return net_response_send(fd, &resp);
+}
+
 int (*vasprintf)(char **ret, const char *format, va_list ap);
 
 int fd_printf(int fd, const char *format, ...) {
@@ -0,0 +1,143 @@
+#include "pool.h"
+#include "server.h"
+
+const uint32_t pool_class_size[POOL_CLASSES] = { 0x100, 0x1000, 0x4000, 0x10000, 0x20000, 0x40000 };
+
+uint32_t pool_class(size_t size) {
+    for (uint32_t i = 0; i < POOL_CLASSES; i++) {
+        if (size <= pool_class_size[i]) {
+            return i;
+        }
+    }
+
+    return POOL_OVERSIZE;
+}
+
+void *pool_get(struct buffer_pool *pool, size_t size) {
+    struct pool_header *header;
+    uint32_t cls;
+    size_t length;
+
+    cls = pool_class(size);
+
+    if (pool && cls != POOL_OVERSIZE && pool->count[cls]) {
+        pool->hits++;
+        stats_add(STATS_POOL_HITS, 1);
+        header = (struct pool_header *)pool->cache[cls][--pool->count[cls]];
+        header->size = size;
+        return (uint8_t *)header + POOL_HEADER_SIZE;
+    }
+
+    if (cls == POOL_OVERSIZE || !pool) {
+        if (pool) {
+            pool->oversize++;
+        }
+
+        stats_add(STATS_POOL_OVERSIZE, 1);
+
+        cls = POOL_OVERSIZE;
+        length = size;
+    }
+    else {
+        pool->misses++;
+        stats_add(STATS_POOL_MISSES, 1);
+        length = pool_class_size[cls];
+    }
+
+    // the whole class is prefaulted so a later, bigger request does not fault either
+    header = (struct pool_header *)pfmalloc(POOL_HEADER_SIZE + length);
+    if (!header) {
+        return NULL;
+    }
+
+    header->magic = POOL_MAGIC;
+    header->cls = cls;
+    header->size = size;
+
+    stats_add(STATS_POOL_BYTES, length);
+
+    return (uint8_t *)header + POOL_HEADER_SIZE;
+}
+
+void pool_put(struct buffer_pool *pool, void *p) {
+    struct pool_header *header;
+
+    if (!p) {
+        return;
+    }
+
+    header = (struct pool_header *)((uint8_t *)p - POOL_HEADER_SIZE);
+    if (header->magic != POOL_MAGIC) {
+        uprintf("pool_put on a buffer not from the pool %p", p);
+        return;
+    }
+
+    if (pool && header->cls != POOL_OVERSIZE && pool->count[header->cls] < POOL_CACHE) {
+        pool->cache[header->cls][pool->count[header->cls]++] = header;
+        return;
+    }
+
+    stats_sub(STATS_POOL_BYTES, header->cls == POOL_OVERSIZE ? header->size : pool_class_size[header->cls]);
+
+    header->magic = 0;
+    free(header);
+}
+
+void pool_destroy(struct buffer_pool *pool) {
+    struct pool_header *header;
+
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        while (pool->count[i]) {
+            header = (struct pool_header *)pool->cache[i][--pool->count[i]];
+            stats_sub(STATS_POOL_BYTES, pool_class_size[i]);
+            header->magic = 0;
+            free(header);
+        }
+    }
+
+    memset(pool, NULL, sizeof(struct buffer_pool));
+}
+
+struct buffer_pool *pool_find(int fd) {
+    struct server_client *svc;
+
+    svc = find_client(fd);
+    if (!svc) {
+        return NULL;
+    }
+
+    return &svc->pool;
+}
+
+// buffers for a command of the client on fd, falls back to plain pfmalloc for other sockets
+void *pool_alloc(int fd, size_t size) {
+    return pool_get(pool_find(fd), size);
+}
+
+void pool_free(int fd, void *p) {
+    pool_put(pool_find(fd), p);
+}
+
+int pool_stats_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_pool_stats_response resp;
+    struct buffer_pool *pool;
+
+    pool = pool_find(fd);
+    if (!pool) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    resp.hits = pool->hits;
+    resp.misses = pool->misses;
+    resp.oversize = pool->oversize;
+    resp.cached = 0;
+
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        resp.cached += pool->count[i] * pool_class_size[i];
+    }
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_POOL_STATS_RESPONSE_SIZE);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "proc.h"
 #include "search.h"
+#include "server.h"
 
 int proc_list_handle(int fd, struct cmd_packet *packet) {
     void *data;
@@ -18,8 +19,7 @@ int proc_list_handle(int fd, struct cmd_packet *packet) {
 
         sys_proc_list(data, &num);
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &num, sizeof(uint32_t));
+        net_send_response(fd, CMD_SUCCESS, &num, sizeof(uint32_t));
         net_send_data(fd, data, length);
 
         free(data);
@@ -30,48 +30,236 @@ int proc_list_handle(int fd, struct cmd_packet *packet) {
     return 1;
 }
 
+int proc_get_vm_map(uint32_t pid, struct proc_vm_map_entry **maps, uint64_t *num) {
+    struct sys_proc_vm_map_args args;
+
+    memset(&args, NULL, sizeof(args));
+
+    if (sys_proc_cmd(pid, SYS_PROC_VM_MAP, &args) || !args.num) {
+        return 1;
+    }
+
+    args.maps = (struct proc_vm_map_entry *)malloc(args.num * sizeof(struct proc_vm_map_entry));
+    if (!args.maps) {
+        return 1;
+    }
+
+    if (sys_proc_cmd(pid, SYS_PROC_VM_MAP, &args)) {
+        free(args.maps);
+        return 1;
+    }
+
+    *maps = args.maps;
+    *num = args.num;
+
+    return 0;
+}
+
+void proc_vm_map_cache_free(struct proc_vm_map_cache *cache) {
+    if (cache->maps) {
+        free(cache->maps);
+    }
+
+    memset(cache, NULL, sizeof(struct proc_vm_map_cache));
+}
+
+// returns the first address after a fault at address that could be readable again
+uint64_t proc_next_readable(uint32_t pid, struct proc_vm_map_cache *cache, uint64_t address) {
+    if (!cache->loaded) {
+        if (proc_get_vm_map(pid, &cache->maps, &cache->num)) {
+            cache->maps = NULL;
+            cache->num = 0;
+        }
+
+        cache->loaded = 1;
+    }
+
+    // entries come sorted by address
+    for (uint64_t i = 0; i < cache->num; i++) {
+        if (address >= cache->maps[i].end || (cache->maps[i].prot & PROT_READ) != PROT_READ) {
+            continue;
+        }
+
+        if (address < cache->maps[i].start) {
+            // skip the whole hole up to the next readable entry
+            return cache->maps[i].start;
+        }
+
+        // readable entry but the page is not backed, step over it
+        return (address + PROC_READ_FAULT_STEP) & ~((uint64_t)PROC_READ_FAULT_STEP - 1);
+    }
+
+    return (uint64_t)-1;
+}
+
+// reads the readable parts of [address, address + length) and zero fills the rest
+// ranges (optional) receives the readable sub-ranges, it must hold PROC_READ_MAX_RANGES(length) entries
+// returns the number of bytes that were actually read
+uint32_t proc_read_valid(uint32_t pid, uint64_t address, uint8_t *data, uint32_t length, struct proc_vm_map_cache *cache, struct cmd_proc_read_range *ranges, uint32_t *count) {
+    uint64_t next;
+    uint64_t n;
+    uint32_t pos;
+    uint32_t skip;
+    uint32_t total;
+
+    pos = 0;
+    total = 0;
+
+    if (count) {
+        *count = 0;
+    }
+
+    while (pos < length) {
+        n = 0;
+        sys_proc_rw_n(pid, address + pos, data + pos, length - pos, 0, &n);
+
+        if (n > length - pos) {
+            n = length - pos;
+        }
+
+        if (n) {
+            if (ranges) {
+                if (*count && ranges[*count - 1].address + ranges[*count - 1].length == address + pos) {
+                    ranges[*count - 1].length += n;
+                }
+                else {
+                    ranges[*count].address = address + pos;
+                    ranges[*count].length = n;
+                    *count += 1;
+                }
+            }
+
+            pos += n;
+            total += n;
+        }
+
+        if (pos >= length) {
+            break;
+        }
+
+        // the read faulted at address + pos
+        next = proc_next_readable(pid, cache, address + pos);
+        if (next <= address + pos || next - (address + pos) > length - pos) {
+            skip = length - pos;
+        }
+        else {
+            skip = next - (address + pos);
+        }
+
+        memset(data + pos, NULL, skip);
+        pos += skip;
+    }
+
+    return total;
+}
+
 int proc_read_handle(int fd, struct cmd_packet *packet) {
     struct cmd_proc_read_packet *rp;
+    struct proc_vm_map_cache cache;
+    struct compress_ctx *ctx;
     void *data;
     uint64_t left;
     uint64_t address;
+    uint32_t length;
 
     rp = (struct cmd_proc_read_packet *)packet->data;
 
     if (rp) {
         // allocate a small buffer
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 0;
         }
 
+        memset(&cache, NULL, sizeof(cache));
+        ctx = compress_alloc(fd);
+
         net_send_status(fd, CMD_SUCCESS);
 
         left = rp->length;
         address = rp->address;
 
-        // send by chunks
-        while (left > 0) {
-            memset(data, NULL, NET_MAX_LENGTH);
+        // send by chunks, unreadable pages are zero filled
+        while (left > 0 && !net_cancelled(fd)) {
+            qos_quantum(fd);
 
-            if (left > NET_MAX_LENGTH) {
-                sys_proc_rw(rp->pid, address, data, NET_MAX_LENGTH, 0);
-                net_send_data(fd, data, NET_MAX_LENGTH);
+            length = left > NET_MAX_LENGTH ? NET_MAX_LENGTH : left;
 
-                address += NET_MAX_LENGTH;
-                left -= NET_MAX_LENGTH;
+            proc_read_valid(rp->pid, address, data, length, &cache, NULL, NULL);
+            compress_send_chunk(fd, ctx, data, length, COMPRESS_METHOD_LZ4);
+
+            address += length;
+            left -= length;
+        }
+
+        compress_free(ctx);
+        proc_vm_map_cache_free(&cache);
+        pool_free(fd, data);
+        return 0;
+    }
+
+    net_send_status(fd, CMD_DATA_NULL);
+    return 1;
+}
+
+int proc_read_valid_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_read_valid_packet *rp;
+    struct cmd_proc_read_range *ranges;
+    struct proc_vm_map_cache cache;
+    uint8_t *data;
+    uint64_t left;
+    uint64_t address;
+    uint32_t length;
+    uint32_t count;
+
+    rp = (struct cmd_proc_read_valid_packet *)packet->data;
+
+    if (rp) {
+        data = (uint8_t *)pool_alloc(fd, NET_MAX_LENGTH);
+        if (!data) {
+            net_send_status(fd, CMD_DATA_NULL);
+            return 1;
+        }
+
+        ranges = (struct cmd_proc_read_range *)pool_alloc(fd, PROC_READ_MAX_RANGES(NET_MAX_LENGTH) * CMD_PROC_READ_RANGE_SIZE);
+        if (!ranges) {
+            pool_free(fd, data);
+            net_send_status(fd, CMD_DATA_NULL);
+            return 1;
+        }
+
+        memset(&cache, NULL, sizeof(cache));
+
+        net_send_status(fd, CMD_SUCCESS);
+
+        left = rp->length;
+        address = rp->address;
+
+        // every NET_MAX_LENGTH chunk is sent as a range count, the ranges and then only the readable bytes
+        while (left > 0 && !net_cancelled(fd)) {
+            qos_quantum(fd);
+
+            length = left > NET_MAX_LENGTH ? NET_MAX_LENGTH : left;
+
+            proc_read_valid(rp->pid, address, data, length, &cache, ranges, &count);
+
+            net_send_data(fd, &count, sizeof(uint32_t));
+            if (count) {
+                net_send_data(fd, ranges, count * CMD_PROC_READ_RANGE_SIZE);
             }
-            else {
-                sys_proc_rw(rp->pid, address, data, left, 0);
-                net_send_data(fd, data, left);
 
-                address += left;
-                left -= left;
+            for (uint32_t i = 0; i < count; i++) {
+                net_send_data(fd, data + (ranges[i].address - address), ranges[i].length);
             }
+
+            address += length;
+            left -= length;
         }
 
-        free(data);
+        proc_vm_map_cache_free(&cache);
+        pool_free(fd, ranges);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -89,7 +277,7 @@ int proc_write_handle(int fd, struct cmd_packet *packet) {
 
     if (wp) {
         // only allocate a small buffer
-        data = pfmalloc(NET_MAX_LENGTH);
+        data = pool_alloc(fd, NET_MAX_LENGTH);
         if (!data) {
             net_send_status(fd, CMD_DATA_NULL);
             return 1;
@@ -102,6 +290,8 @@ int proc_write_handle(int fd, struct cmd_packet *packet) {
 
         // write in chunks
         while (left > 0) {
+            qos_quantum(fd);
+
             if (left > NET_MAX_LENGTH) {
                 net_recv_data(fd, data, NET_MAX_LENGTH, 1);
                 sys_proc_rw(wp->pid, address, data, NET_MAX_LENGTH, 1);
@@ -120,7 +310,7 @@ int proc_write_handle(int fd, struct cmd_packet *packet) {
 
         net_send_status(fd, CMD_SUCCESS);
 
-        free(data);
+        pool_free(fd, data);
         return 0;
     }
 
@@ -193,8 +383,7 @@ int proc_install_handle(int fd, struct cmd_packet *packet) {
 
     resp.rpcstub = args.stubentryaddr;
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &resp, CMD_PROC_INSTALL_RESPONSE_SIZE);
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_INSTALL_RESPONSE_SIZE);
 
     return 0;
 }
@@ -228,8 +417,7 @@ int proc_call_handle(int fd, struct cmd_packet *packet) {
     resp.pid = cp->pid;
     resp.rpc_rax = args.rax;
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &resp, CMD_PROC_CALL_RESPONSE_SIZE);
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_CALL_RESPONSE_SIZE);
 
     return 0;
 }
@@ -265,8 +453,7 @@ int proc_elf_handle(int fd, struct cmd_packet *packet) {
 
         resp.entry = args.entry;
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &resp, CMD_PROC_ELF_RESPONSE_SIZE);
+        net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_ELF_RESPONSE_SIZE);
 
         return 0;
     }
@@ -613,18 +800,12 @@ bool proc_scan_compareValues(cmd_proc_scan_comparetype cmpType, cmd_proc_scan_va
     return false;
 }
 
-struct saved_section {
-    uint64_t start;
-    uint64_t end;
-    int fileId;
-};
-
-struct saved_section_list {
-    struct saved_section *sections;
-    uint64_t count;
-};
-
 struct saved_section_list savedSectionList;
+ScePthreadMutex scan_mutex;
+
+void proc_scan_init() {
+    scePthreadMutexInit(&scan_mutex, NULL, "scanmutex");
+}
 
 bool scan_requires_last_value(uint8_t type) {
     if (type == cmpTypeIncreasedValue ||
@@ -675,7 +856,7 @@ int address_is_in_list(int fileHandle, uint64_t totalResultCount_lastScan, uint6
 }
 
 // not fully working yet
-int proc_scan_handle(int fd, struct cmd_packet *packet) {
+int proc_scan_run(int fd, struct cmd_packet *packet) {
     struct cmd_proc_scan_packet *sp = (struct cmd_proc_scan_packet *)packet->data;
 
     if (!sp) {
@@ -696,6 +877,8 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
     net_send_status(fd, CMD_SUCCESS);
     net_recv_data(fd, data, sp->lenData, 1);
 
+    uint64_t scanStart = sceKernelGetProcessTime();
+
     if (sp->firstScan == 1) {
         struct sys_proc_vm_map_args args;
         memset(&args, NULL, sizeof(struct sys_proc_vm_map_args));
@@ -772,6 +955,14 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
             return 1;
         }
 
+        // reads fall back to the map we already have when they hit a hole
+        struct proc_vm_map_cache mapCache;
+        mapCache.maps = args.maps;
+        mapCache.num = args.num;
+        mapCache.loaded = 1;
+
+        struct cmd_proc_read_range scanRanges[PROC_READ_MAX_RANGES(SCAN_MAX_LENGTH)];
+
         for (size_t i = 1; i < args.num; i++) {
             if (selectedSections[i - 1] == 0) {
                 uprintf("skipping: %s   0x%llX - 0x%llX   %iKB", args.maps[i].name, args.maps[i].start, args.maps[i].end, (args.maps[i].end - args.maps[i].start) / 1024);
@@ -808,6 +999,8 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                 free(selectedSections);
                 free(scanBuffer);
                 free(savedSectionList.sections);
+                savedSectionList.sections = NULL;
+                savedSectionList.count = 0;
 
                 return 1;
             }
@@ -821,6 +1014,8 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                 free(selectedSections);
                 free(scanBuffer);
                 free(savedSectionList.sections);
+                savedSectionList.sections = NULL;
+                savedSectionList.count = 0;
 
                 return 1;
             }
@@ -829,42 +1024,50 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
             uint64_t curAddress = args.maps[i].start;
             uint64_t bytesLeft = sectionLength;
 
+            trace_begin(TRACE_SCAN_SECTION, curAddress);
+
             while (bytesLeft > 0) {
-                memset(scanBuffer, NULL, SCAN_MAX_LENGTH);
+                uint32_t readLength = bytesLeft > SCAN_MAX_LENGTH ? SCAN_MAX_LENGTH : bytesLeft;
+                uint32_t rangeCount;
 
-                if (bytesLeft > SCAN_MAX_LENGTH) {
-                    sys_proc_rw(sp->pid, curAddress, scanBuffer, SCAN_MAX_LENGTH, 0);
-                    write(fileHandleInit, scanBuffer, SCAN_MAX_LENGTH);
-                    write(fileHandleCur, scanBuffer, SCAN_MAX_LENGTH);
+                qos_quantum(fd);
 
-                    for (uint64_t j = 0; j < SCAN_MAX_LENGTH; j += valueLength) {
-                        if (proc_scan_compareValues(sp->compareType, sp->valueType, valueLength, data, scanBuffer + j, pExtraValue))
-                            add_result(&results, curAddress + j);
-                    }
+                // unreadable pages are zero filled in the saved files but never compared
+                proc_read_valid(sp->pid, curAddress, scanBuffer, readLength, &mapCache, scanRanges, &rangeCount);
+                stats_add(STATS_SCAN_BYTES, readLength);
 
-                    curAddress += SCAN_MAX_LENGTH;
-                    bytesLeft -= SCAN_MAX_LENGTH;
-                }
-                else {
-                    sys_proc_rw(sp->pid, curAddress, scanBuffer, bytesLeft, 0);
-                    write(fileHandleInit, scanBuffer, bytesLeft);
-                    write(fileHandleCur, scanBuffer, bytesLeft);
+                trace_begin(TRACE_DISK_WRITE, readLength * 2);
+                write(fileHandleInit, scanBuffer, readLength);
+                write(fileHandleCur, scanBuffer, readLength);
+                trace_end(TRACE_DISK_WRITE);
+
+                for (uint32_t r = 0; r < rangeCount; r++) {
+                    uint64_t rangeStart = scanRanges[r].address - curAddress;
+                    uint64_t rangeEnd = rangeStart + scanRanges[r].length;
 
-                    for (uint64_t j = 0; j < bytesLeft; j += valueLength) {
+                    for (uint64_t j = (rangeStart + valueLength - 1) / valueLength * valueLength; j + valueLength <= rangeEnd; j += valueLength) {
                         if (proc_scan_compareValues(sp->compareType, sp->valueType, valueLength, data, scanBuffer + j, pExtraValue))
                             add_result(&results, curAddress + j);
                     }
-
-                    curAddress += bytesLeft;
-                    bytesLeft -= bytesLeft;
                 }
+
+                curAddress += readLength;
+                bytesLeft -= readLength;
             }
 
             close(fileHandleInit);
             close(fileHandleCur);
+
+            trace_end(TRACE_SCAN_SECTION);
+
+            ws_scan_progress(i, args.num - 1, results.countTotal);
         }
 
         write_pending_results_to_file();
+        ws_scan_progress(args.num - 1, args.num - 1, results.countTotal);
+
+        stats_add(STATS_SCANS, 1);
+        stats_add(STATS_SCAN_TIME, sceKernelGetProcessTime() - scanStart);
 
         net_send_status(fd, CMD_SUCCESS);
         uprintf("########## scan done");
@@ -968,6 +1171,11 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                 return 1;
             }
 
+            struct proc_vm_map_cache mapCache;
+            memset(&mapCache, NULL, sizeof(mapCache));
+
+            struct cmd_proc_read_range scanRanges[PROC_READ_MAX_RANGES(SCAN_MAX_LENGTH)];
+
             for (int sectionIndex = 0; sectionIndex < savedSectionList.count; sectionIndex++) {
                 uprintf("saved section index %i", savedSectionList.sections[sectionIndex].fileId);
 
@@ -988,6 +1196,7 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                     free(resultAddressBuffer);
                     free(scanBuffer);
                     free(fileBuffer);
+                    proc_vm_map_cache_free(&mapCache);
 
                     return 1;
                 }
@@ -1002,6 +1211,7 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                     free(resultAddressBuffer);
                     free(scanBuffer);
                     free(fileBuffer);
+                    proc_vm_map_cache_free(&mapCache);
 
                     return 1;
                 }
@@ -1022,55 +1232,58 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
                 int foundValueInCurrentSection = 0;
                 uint64_t bytesLeft = savedSectionList.sections[sectionIndex].end - savedSectionList.sections[sectionIndex].start;
 
+                trace_begin(TRACE_SCAN_SECTION, curAddress);
+
                 while (bytesLeft > 0) {
-                    memset(scanBuffer, NULL, SCAN_MAX_LENGTH);
-                    memset(fileBuffer, NULL, SCAN_MAX_LENGTH);
+                    uint32_t readLength = bytesLeft > SCAN_MAX_LENGTH ? SCAN_MAX_LENGTH : bytesLeft;
+                    uint32_t rangeCount;
 
-                    if (bytesLeft > SCAN_MAX_LENGTH) {
-                        sys_proc_rw(sp->pid, curAddress, scanBuffer, SCAN_MAX_LENGTH, 0);
-                        write(fileHandleCur, scanBuffer, SCAN_MAX_LENGTH);
+                    qos_quantum(fd);
 
-                        if (scan_requires_last_value(sp->compareType))
-                            read(fileHandleOld, fileBuffer, SCAN_MAX_LENGTH);
+                    proc_read_valid(sp->pid, curAddress, scanBuffer, readLength, &mapCache, scanRanges, &rangeCount);
+                    stats_add(STATS_SCAN_BYTES, readLength);
 
-                        for (uint64_t j = 0; j < SCAN_MAX_LENGTH; j += valueLength) {
-                            if (proc_scan_compareValues(sp->compareType, sp->valueType, valueLength, scan_requires_last_value(sp->compareType) ? (fileBuffer + j) : data, scanBuffer + j, pExtraValue) && address_is_in_list(fileHandle_resultsOld, totalResultCount, curAddress + j)) {
-                                add_result(&results, curAddress + j);
-                                foundValueInCurrentSection = 1;
-                            }
-                        }
+                    trace_begin(TRACE_DISK_WRITE, readLength);
+                    write(fileHandleCur, scanBuffer, readLength);
+                    trace_end(TRACE_DISK_WRITE);
 
-                        curAddress += SCAN_MAX_LENGTH;
-                        bytesLeft -= SCAN_MAX_LENGTH;
+                    if (scan_requires_last_value(sp->compareType)) {
+                        trace_begin(TRACE_DISK_READ, readLength);
+                        read(fileHandleOld, fileBuffer, readLength);
+                        trace_end(TRACE_DISK_READ);
                     }
-                    else {
-                        sys_proc_rw(sp->pid, curAddress, scanBuffer, bytesLeft, 0);
-                        write(fileHandleCur, scanBuffer, bytesLeft);
 
-                        if (scan_requires_last_value(sp->compareType))
-                            read(fileHandleOld, fileBuffer, bytesLeft);
+                    for (uint32_t r = 0; r < rangeCount; r++) {
+                        uint64_t rangeStart = scanRanges[r].address - curAddress;
+                        uint64_t rangeEnd = rangeStart + scanRanges[r].length;
 
-                        for (uint64_t j = 0; j < bytesLeft; j += valueLength) {
+                        for (uint64_t j = (rangeStart + valueLength - 1) / valueLength * valueLength; j + valueLength <= rangeEnd; j += valueLength) {
                             if (proc_scan_compareValues(sp->compareType, sp->valueType, valueLength, scan_requires_last_value(sp->compareType) ? (fileBuffer + j) : data, scanBuffer + j, pExtraValue) && address_is_in_list(fileHandle_resultsOld, totalResultCount, curAddress + j)) {
                                 add_result(&results, curAddress + j);
                                 foundValueInCurrentSection = 1;
                             }
                         }
-
-                        curAddress += bytesLeft;
-                        bytesLeft -= bytesLeft;
                     }
+
+                    curAddress += readLength;
+                    bytesLeft -= readLength;
                 }
 
                 close(fileHandleCur);
                 close(fileHandleOld);
 
+                trace_end(TRACE_SCAN_SECTION);
+
                 if (!foundValueInCurrentSection)
                     savedSectionList.sections[sectionIndex].start = 0;
+
+                ws_scan_progress(sectionIndex + 1, savedSectionList.count, results.countTotal);
             }
 
             write_pending_results_to_file();
+            ws_scan_progress(savedSectionList.count, savedSectionList.count, results.countTotal);
 
+            proc_vm_map_cache_free(&mapCache);
             free(scanBuffer);
             free(fileBuffer);
 
@@ -1080,6 +1293,9 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
 
         close(fileHandle_resultsOld);
 
+        stats_add(STATS_SCANS, 1);
+        stats_add(STATS_SCAN_TIME, sceKernelGetProcessTime() - scanStart);
+
         net_send_status(fd, CMD_SUCCESS);
         uprintf("########## next scan done");
 
@@ -1091,6 +1307,17 @@ int proc_scan_handle(int fd, struct cmd_packet *packet) {
     return 0;
 }
 
+// snapshot diffs against @init, @cur and @old read the section list and files under the same lock
+int proc_scan_handle(int fd, struct cmd_packet *packet) {
+    int r;
+
+    scePthreadMutexLock(&scan_mutex);
+    r = proc_scan_run(fd, packet);
+    scePthreadMutexUnlock(&scan_mutex);
+
+    return r;
+}
+
 int proc_info_handle(int fd, struct cmd_packet *packet) {
     struct cmd_proc_info_packet *ip;
     struct sys_proc_info_args args;
@@ -1107,8 +1334,7 @@ int proc_info_handle(int fd, struct cmd_packet *packet) {
         memcpy(resp.titleid, args.titleid, sizeof(resp.titleid));
         memcpy(resp.contentid, args.contentid, sizeof(resp.contentid));
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &resp, CMD_PROC_INFO_RESPONSE_SIZE);
+        net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_INFO_RESPONSE_SIZE);
         return 0;
     }
 
@@ -1130,8 +1356,7 @@ int proc_alloc_handle(int fd, struct cmd_packet *packet) {
 
         resp.address = args.address;
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &resp, CMD_PROC_ALLOC_RESPONSE_SIZE);
+        net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_ALLOC_RESPONSE_SIZE);
         return 0;
     }
 
@@ -1164,7 +1389,7 @@ int proc_scan_get_results_handle(int fd, struct cmd_packet *packet) {
     if (state == ENDED)
         return 1;
 
-    void *data = pfmalloc(NET_MAX_LENGTH);
+    void *data = pool_alloc(fd, NET_MAX_LENGTH);
     if (!data) {
         net_send_status(fd, CMD_DATA_NULL);
         return 1;
@@ -1174,35 +1399,41 @@ int proc_scan_get_results_handle(int fd, struct cmd_packet *packet) {
     if ((fileHandle = open("/data/scan_temp/results", O_RDONLY, 0)) < 0) {
         net_send_status(fd, CMD_DATA_NULL);
 
-        free(data);
+        pool_free(fd, data);
         return 1;
     }
 
+    struct compress_ctx *ctx = compress_alloc(fd);
+
     net_send_status(fd, CMD_SUCCESS);
 
     uint64_t bytesLeft = sizeof(uint64_t) * results.countTotal;
 
+    // results are sorted so they delta encode well
     while (bytesLeft > 0) {
+        qos_quantum(fd);
+
         memset(data, NULL, NET_MAX_LENGTH);
 
         if (bytesLeft > NET_MAX_LENGTH) {
             read(fileHandle, data, NET_MAX_LENGTH);
 
-            net_send_data(fd, data, NET_MAX_LENGTH);
+            compress_send_chunk(fd, ctx, data, NET_MAX_LENGTH, COMPRESS_METHOD_DELTA);
 
             bytesLeft -= NET_MAX_LENGTH;
         }
         else {
             read(fileHandle, data, bytesLeft);
 
-            net_send_data(fd, data, bytesLeft);
+            compress_send_chunk(fd, ctx, data, bytesLeft, COMPRESS_METHOD_DELTA);
 
             bytesLeft -= bytesLeft;
         }
     }
 
+    compress_free(ctx);
     close(fileHandle);
-    free(data);
+    pool_free(fd, data);
 
     return 0;
 }
@@ -1216,8 +1447,7 @@ int proc_scan_count_results_handle(int fd, struct cmd_packet *packet) {
     if (pack) {
         resp.count = state == STARTED ? results.countTotal : 0;
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &resp, CMD_SCAN_COUNT_RESULTS_RESPONSE_SIZE);
+        net_send_response(fd, CMD_SUCCESS, &resp, CMD_SCAN_COUNT_RESULTS_RESPONSE_SIZE);
         return 0;
     }
 
@@ -1254,8 +1484,7 @@ int proc_prx_load_handle(int fd, struct cmd_packet *packet) {
 
     resp.prx_handle = handle;
 
-    net_send_status(fd, CMD_SUCCESS);
-    net_send_data(fd, &resp, CMD_PROC_PRX_LOAD_RESPONSE_SIZE);
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_PRX_LOAD_RESPONSE_SIZE);
 
     free(data);
     free(data2);
@@ -1307,8 +1536,7 @@ int proc_prx_list_handle(int fd, struct cmd_packet *packet) {
         }
 
         if (args.num == 0) { // if no dynlib data exists, 0 is returned for num
-            net_send_status(fd, CMD_SUCCESS);
-            net_send_data(fd, &args.num, sizeof(uint32_t));
+            net_send_response(fd, CMD_SUCCESS, &args.num, sizeof(uint32_t));
             return 0;
         }
 
@@ -1328,8 +1556,7 @@ int proc_prx_list_handle(int fd, struct cmd_packet *packet) {
             return 1;
         }
 
-        net_send_status(fd, CMD_SUCCESS);
-        net_send_data(fd, &args.num, sizeof(uint32_t));
+        net_send_response(fd, CMD_SUCCESS, &args.num, sizeof(uint32_t));
         net_send_data(fd, args.entries, size);
 
         free(args.entries);
@@ -1388,6 +1615,7 @@ int proc_aob_handle(int fd, struct cmd_packet *packet) {
     net_recv_data(fd, mask_data, aobp->aob_len, 1);
 
     net_send_status(fd, CMD_SUCCESS);
+    net_flush(fd);
 
     // find the index of the first masked byte
     uint32_t first_masked_index = 0;
@@ -1398,37 +1626,49 @@ int proc_aob_handle(int fd, struct cmd_packet *packet) {
         }
     }
 
+    struct proc_vm_map_cache cache;
+    memset(&cache, NULL, sizeof(cache));
+
+    struct cmd_proc_read_range ranges[PROC_READ_MAX_RANGES(PROC_AOB_SCAN_BUFFER_LEN)];
+    uint32_t count;
+
     uint32_t left = aobp->length;
     uint64_t address = aobp->start;
 
-    while (left > 0) {
-        memset(scan_data, NULL, PROC_AOB_SCAN_BUFFER_LEN);
+    while (left > 0 && !net_cancelled(fd)) {
+        qos_quantum(fd);
 
         uint32_t read_size = (left > PROC_AOB_SCAN_BUFFER_LEN) ? PROC_AOB_SCAN_BUFFER_LEN : left;
-        sys_proc_rw(aobp->pid, address, scan_data, read_size, 0);
+        proc_read_valid(aobp->pid, address, scan_data, read_size, &cache, ranges, &count);
 
         // current version will suffer from a problem if the aob overlaps 2 scan segments
         // need to fix this if someone really wants to use this
-        for (uint64_t i = 0; i < read_size; i++) {
-            if (scan_data[i] == aob_data[first_masked_index]) {
-                // we have found the first index of the bytes that is masked
-                bool match_found = true;
-                for (uint32_t j = first_masked_index; j < aobp->aob_len; j++) {
-                    // check each index of the aob
-                    uint32_t scan_idx = i + (j - first_masked_index);
-                    if (scan_idx >= read_size) {
-                        match_found = false;
-                        break;
-                    }
-                    if ((mask_data[j] != 0) && (scan_data[scan_idx] != aob_data[j])) {
-                        match_found = false;
-                        break;
+        // only readable ranges are searched so unmapped pages never match
+        for (uint32_t r = 0; r < count; r++) {
+            uint64_t range_start = ranges[r].address - address;
+            uint64_t range_end = range_start + ranges[r].length;
+
+            for (uint64_t i = range_start; i < range_end; i++) {
+                if (scan_data[i] == aob_data[first_masked_index]) {
+                    // we have found the first index of the bytes that is masked
+                    bool match_found = true;
+                    for (uint32_t j = first_masked_index; j < aobp->aob_len; j++) {
+                        // check each index of the aob
+                        uint64_t scan_idx = i + (j - first_masked_index);
+                        if (scan_idx >= range_end) {
+                            match_found = false;
+                            break;
+                        }
+                        if ((mask_data[j] != 0) && (scan_data[scan_idx] != aob_data[j])) {
+                            match_found = false;
+                            break;
+                        }
                     }
-                }
 
-                if (match_found) {
-                    aob_result = address + i - first_masked_index;
-                    goto found;
+                    if (match_found) {
+                        aob_result = address + i - first_masked_index;
+                        goto found;
+                    }
                 }
             }
         }
@@ -1440,12 +1680,460 @@ int proc_aob_handle(int fd, struct cmd_packet *packet) {
 found:
     net_send_data(fd, &aob_result, sizeof(uint64_t));
 
+    proc_vm_map_cache_free(&cache);
     free(aob_data);
     free(mask_data);
     free(scan_data);
     return 0;
 }
 
+// resolves and reads every path of one process, one vectored read per path level
+void proc_read_paths(uint32_t pid, struct proc_path **paths, int count) {
+    struct proc_readv_entry entries[PROC_PATHS_BATCH];
+    struct sys_proc_readv_args args;
+    uint32_t maxdepth;
+
+    while (count > PROC_PATHS_BATCH) {
+        proc_read_paths(pid, paths, PROC_PATHS_BATCH);
+        paths += PROC_PATHS_BATCH;
+        count -= PROC_PATHS_BATCH;
+    }
+
+    maxdepth = 0;
+    for (int i = 0; i < count; i++) {
+        paths[i]->resolved = paths[i]->address;
+        paths[i]->failed = 0;
+
+        if (paths[i]->depth > maxdepth) {
+            maxdepth = paths[i]->depth;
+        }
+    }
+
+    args.entries = entries;
+    args.num = count;
+
+    for (uint32_t level = 0; level < maxdepth; level++) {
+        for (int i = 0; i < count; i++) {
+            entries[i].address = paths[i]->resolved;
+            entries[i].data = &paths[i]->pointer;
+            entries[i].length = (!paths[i]->failed && paths[i]->depth > level) ? sizeof(uint64_t) : 0;
+            entries[i].n = 0;
+        }
+
+        sys_proc_cmd(pid, SYS_PROC_READV, &args);
+
+        for (int i = 0; i < count; i++) {
+            if (!entries[i].length) {
+                continue;
+            }
+
+            if (entries[i].n != sizeof(uint64_t)) {
+                paths[i]->failed = level + 1;
+                continue;
+            }
+
+            paths[i]->resolved = paths[i]->pointer + paths[i]->offsets[level];
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        entries[i].address = paths[i]->resolved;
+        entries[i].data = paths[i]->data;
+        entries[i].length = paths[i]->failed ? 0 : paths[i]->length;
+        entries[i].n = 0;
+    }
+
+    sys_proc_cmd(pid, SYS_PROC_READV, &args);
+
+    for (int i = 0; i < count; i++) {
+        if (entries[i].n != entries[i].length) {
+            paths[i]->failed = paths[i]->depth + 1;
+        }
+    }
+}
+
+struct proc_ptr_state {
+    struct cmd_proc_ptr_path *path;
+    struct cmd_proc_ptr_result *result;
+    struct proc_path resolve;
+};
+
+int proc_ptr_gather_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_ptr_gather_packet *gp;
+    struct sys_proc_prx_list_args prxargs;
+    struct proc_ptr_state *states;
+    struct proc_path **paths;
+    uint8_t *list;
+    uint8_t *resp;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t status;
+    int needprx;
+    int count;
+
+    gp = (struct cmd_proc_ptr_gather_packet *)packet->data;
+
+    if (!gp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (!gp->count || gp->count > PROC_PTR_MAX_PATHS || gp->length > NET_MAX_LENGTH) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 1;
+    }
+
+    list = (uint8_t *)pfmalloc(gp->length);
+    if (!list) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+    net_recv_data(fd, list, gp->length, 1);
+
+    resp = NULL;
+    paths = NULL;
+    prxargs.entries = NULL;
+
+    states = (struct proc_ptr_state *)malloc(gp->count * sizeof(struct proc_ptr_state));
+    if (!states) {
+        status = CMD_DATA_NULL;
+        goto error;
+    }
+
+    // validate the path list and size the response
+    offset = 0;
+    size = 0;
+    needprx = 0;
+    for (uint32_t i = 0; i < gp->count; i++) {
+        struct cmd_proc_ptr_path *path = (struct cmd_proc_ptr_path *)(list + offset);
+
+        if (offset + CMD_PROC_PTR_PATH_SIZE > gp->length || path->depth > PROC_PTR_MAX_DEPTH) {
+            status = CMD_ERROR;
+            goto error;
+        }
+
+        offset += CMD_PROC_PTR_PATH_SIZE + path->depth * sizeof(int64_t);
+        size += CMD_PROC_PTR_RESULT_SIZE + path->length;
+
+        if (offset > gp->length || path->length > NET_MAX_LENGTH || size > NET_MAX_LENGTH) {
+            status = CMD_TOO_MUCH_DATA;
+            goto error;
+        }
+
+        if (path->prx_handle) {
+            needprx = 1;
+        }
+
+        states[i].path = path;
+    }
+
+    resp = (uint8_t *)pfmalloc(size);
+    paths = (struct proc_path **)malloc(gp->count * sizeof(struct proc_path *));
+    if (!resp || !paths) {
+        status = CMD_DATA_NULL;
+        goto error;
+    }
+
+    memset(resp, NULL, size);
+
+    if (needprx) {
+        memset(&prxargs, NULL, sizeof(prxargs));
+        sys_proc_cmd(gp->pid, SYS_PROC_PRX_LIST, &prxargs);
+
+        if (prxargs.num) {
+            prxargs.entries = (struct prx_list_entry *)malloc(prxargs.num * sizeof(struct prx_list_entry));
+            if (!prxargs.entries || sys_proc_cmd(gp->pid, SYS_PROC_PRX_LIST, &prxargs)) {
+                prxargs.num = 0;
+            }
+        }
+    }
+
+    // resolve the bases, paths in a prx that is not loaded fail at level 0 without a read
+    offset = 0;
+    count = 0;
+    for (uint32_t i = 0; i < gp->count; i++) {
+        struct cmd_proc_ptr_path *path = states[i].path;
+        struct cmd_proc_ptr_result *result = (struct cmd_proc_ptr_result *)(resp + offset);
+        struct proc_path *resolve = &states[i].resolve;
+
+        result->address = path->base;
+        result->failed = PROC_PTR_RESOLVED;
+
+        if (path->prx_handle) {
+            result->failed = 0;
+
+            for (uint64_t j = 0; j < prxargs.num; j++) {
+                if (prxargs.entries[j].handle == path->prx_handle) {
+                    result->address += prxargs.entries[j].text_address;
+                    result->failed = PROC_PTR_RESOLVED;
+                    break;
+                }
+            }
+        }
+
+        states[i].result = result;
+        offset += CMD_PROC_PTR_RESULT_SIZE + path->length;
+
+        if (result->failed != PROC_PTR_RESOLVED) {
+            continue;
+        }
+
+        // final reads go straight into the response
+        resolve->address = result->address;
+        resolve->length = path->length;
+        resolve->depth = path->depth;
+        memcpy(resolve->offsets, path + 1, path->depth * sizeof(int64_t));
+        resolve->data = (uint8_t *)result + CMD_PROC_PTR_RESULT_SIZE;
+        paths[count++] = resolve;
+    }
+
+    proc_read_paths(gp->pid, paths, count);
+
+    for (uint32_t i = 0; i < gp->count; i++) {
+        struct cmd_proc_ptr_result *result = states[i].result;
+        struct proc_path *resolve = &states[i].resolve;
+
+        if (result->failed != PROC_PTR_RESOLVED) {
+            continue;
+        }
+
+        result->address = resolve->resolved;
+        if (resolve->failed) {
+            result->failed = resolve->failed - 1;
+            memset(resolve->data, NULL, resolve->length);
+        }
+    }
+
+    net_send_response(fd, CMD_SUCCESS, resp, size);
+
+    free(prxargs.entries);
+    free(paths);
+    free(resp);
+    free(states);
+    free(list);
+    return 0;
+
+error:
+    net_send_status(fd, status);
+
+    free(prxargs.entries);
+    free(paths);
+    free(resp);
+    free(states);
+    free(list);
+    return 1;
+}
+
+void proc_view_free(struct proc_view *view) {
+    if (view->image) {
+        free(view->image);
+    }
+
+    if (view->next) {
+        free(view->next);
+    }
+
+    if (view->delta) {
+        free(view->delta);
+    }
+
+    memset(view, NULL, sizeof(struct proc_view));
+}
+
+void proc_view_free_all(struct proc_view *views) {
+    for (int i = 0; i < MAX_VIEWS; i++) {
+        if (views[i].id) {
+            proc_view_free(&views[i]);
+        }
+    }
+}
+
+struct proc_view *proc_view_find(int fd, uint32_t id) {
+    struct server_client *svc;
+
+    svc = find_client(fd);
+    if (!svc || id == 0 || id > MAX_VIEWS || svc->views[id - 1].id != id) {
+        return NULL;
+    }
+
+    return &svc->views[id - 1];
+}
+
+// writes every run of changed cache lines as a cmd_proc_view_run followed by the new bytes
+uint32_t proc_view_encode(uint8_t *old, uint8_t *cur, uint32_t length, uint8_t *out, uint32_t *runs) {
+    struct cmd_proc_view_run *run;
+    uint32_t offset;
+    uint32_t start;
+    uint32_t line;
+    uint32_t size;
+
+    offset = 0;
+    size = 0;
+    *runs = 0;
+
+    while (offset < length) {
+        line = (length - offset) > PROC_VIEW_LINE ? PROC_VIEW_LINE : (length - offset);
+        if (!memcmp(old + offset, cur + offset, line)) {
+            offset += line;
+            continue;
+        }
+
+        // extend the run over every following changed line
+        start = offset;
+        while (offset < length) {
+            line = (length - offset) > PROC_VIEW_LINE ? PROC_VIEW_LINE : (length - offset);
+            if (!memcmp(old + offset, cur + offset, line)) {
+                break;
+            }
+
+            offset += line;
+        }
+
+        run = (struct cmd_proc_view_run *)(out + size);
+        run->offset = start;
+        run->length = offset - start;
+        size += CMD_PROC_VIEW_RUN_SIZE;
+
+        memcpy(out + size, cur + start, offset - start);
+        size += offset - start;
+
+        *runs += 1;
+    }
+
+    return size;
+}
+
+int proc_view_open_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_view_open_packet *op;
+    struct cmd_proc_view_open_response resp;
+    struct proc_vm_map_cache cache;
+    struct server_client *svc;
+    struct proc_view *view;
+
+    op = (struct cmd_proc_view_open_packet *)packet->data;
+
+    if (!op) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (!op->length || op->length > PROC_VIEW_MAX_LENGTH) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 0;
+    }
+
+    svc = find_client(fd);
+    if (!svc) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    view = NULL;
+    for (int i = 0; i < MAX_VIEWS; i++) {
+        if (!svc->views[i].id) {
+            view = &svc->views[i];
+            view->id = i + 1;
+            break;
+        }
+    }
+
+    if (!view) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    view->pid = op->pid;
+    view->address = op->address;
+    view->length = op->length;
+    view->image = (uint8_t *)pfmalloc(op->length);
+    view->next = (uint8_t *)pfmalloc(op->length);
+    // worst case is every other line changing
+    view->delta = (uint8_t *)pfmalloc(op->length + (op->length / PROC_VIEW_LINE + 1) * CMD_PROC_VIEW_RUN_SIZE);
+    if (!view->image || !view->next || !view->delta) {
+        proc_view_free(view);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 0;
+    }
+
+    memset(&cache, NULL, sizeof(cache));
+    proc_read_valid(view->pid, view->address, view->image, view->length, &cache, NULL, NULL);
+    proc_vm_map_cache_free(&cache);
+
+    resp.id = view->id;
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_VIEW_OPEN_RESPONSE_SIZE);
+    net_send_data(fd, view->image, view->length);
+
+    return 0;
+}
+
+int proc_view_refresh_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_view_refresh_packet *rp;
+    struct cmd_proc_view_refresh_response resp;
+    struct net_response reply;
+    struct proc_vm_map_cache cache;
+    struct proc_view *view;
+    uint8_t *image;
+    uint32_t runs;
+
+    rp = (struct cmd_proc_view_refresh_packet *)packet->data;
+
+    if (!rp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    view = proc_view_find(fd, rp->id);
+    if (!view) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(&cache, NULL, sizeof(cache));
+    proc_read_valid(view->pid, view->address, view->next, view->length, &cache, NULL, NULL);
+    proc_vm_map_cache_free(&cache);
+
+    resp.length = proc_view_encode(view->image, view->next, view->length, view->delta, &runs);
+    resp.runs = runs;
+
+    // the fresh read is what the client has once this is sent
+    image = view->image;
+    view->image = view->next;
+    view->next = image;
+
+    net_response_init(&reply, CMD_SUCCESS);
+    net_response_add(&reply, &resp, CMD_PROC_VIEW_REFRESH_RESPONSE_SIZE);
+    net_response_add(&reply, view->delta, resp.length);
+    net_response_send(fd, &reply);
+
+    return 0;
+}
+
+int proc_view_close_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_view_close_packet *cp;
+    struct proc_view *view;
+
+    cp = (struct cmd_proc_view_close_packet *)packet->data;
+
+    if (!cp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    view = proc_view_find(fd, cp->id);
+    if (!view) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    proc_view_free(view);
+
+    net_send_status(fd, CMD_SUCCESS);
+    return 0;
+}
+
 int proc_handle(int fd, struct cmd_packet *packet) {
     switch (packet->cmd) {
     case CMD_PROC_LIST:
@@ -1484,6 +2172,46 @@ int proc_handle(int fd, struct cmd_packet *packet) {
         return proc_prx_list_handle(fd, packet);
     case CMD_PROC_AOB:
         return proc_aob_handle(fd, packet);
+    case CMD_PROC_READ_VALID:
+        return proc_read_valid_handle(fd, packet);
+    case CMD_PROC_PTR_GATHER:
+        return proc_ptr_gather_handle(fd, packet);
+    case CMD_PROC_VIEW_OPEN:
+        return proc_view_open_handle(fd, packet);
+    case CMD_PROC_VIEW_REFRESH:
+        return proc_view_refresh_handle(fd, packet);
+    case CMD_PROC_VIEW_CLOSE:
+        return proc_view_close_handle(fd, packet);
+    case CMD_PROC_SUB_ADD:
+        return sub_add_handle(fd, packet);
+    case CMD_PROC_SUB_REMOVE:
+        return sub_remove_handle(fd, packet);
+    case CMD_PROC_RECORD_START:
+        return record_start_handle(fd, packet);
+    case CMD_PROC_RECORD_STOP:
+        return record_stop_handle(fd, packet);
+    case CMD_PROC_RECORD_QUERY:
+        return record_query_handle(fd, packet);
+    case CMD_PROC_TRANSFER:
+        return transfer_handle(fd, packet);
+    case CMD_PROC_TRANSFER_ATTACH:
+        return transfer_attach_handle(fd, packet);
+    case CMD_PROC_DUMP:
+        return proc_dump_handle(fd, packet);
+    case CMD_PROC_HASH:
+        return proc_hash_handle(fd, packet);
+    case CMD_PROC_SNAP_TAKE:
+        return snap_take_handle(fd, packet);
+    case CMD_PROC_SNAP_DIFF:
+        return snap_diff_handle(fd, packet);
+    case CMD_PROC_SNAP_DELETE:
+        return snap_delete_handle(fd, packet);
+    case CMD_PROC_STATE_SAVE:
+        return state_save_handle(fd, packet);
+    case CMD_PROC_STATE_RESTORE:
+        return state_restore_handle(fd, packet);
+    case CMD_PROC_STATE_DELETE:
+        return state_delete_handle(fd, packet);
     }
 
     return 1;
@@ -0,0 +1,322 @@
+#include "qos.h"
+#include "server.h"
+
+struct qos_class_stats qos_stats[QOS_CLASSES];
+struct qos_stream qos_streams[QOS_MAX_STREAMS];
+struct qos_stream *qos_holder;
+uint64_t qos_granted;
+uint32_t qos_turn;
+ScePthreadMutex qos_mutex;
+ScePthreadMutex qos_stats_mutex;
+volatile int qos_interactive;
+
+void qos_init() {
+    memset(qos_stats, NULL, sizeof(qos_stats));
+    memset(qos_streams, NULL, sizeof(qos_streams));
+    qos_holder = NULL;
+    qos_granted = 0;
+    qos_turn = 0;
+    scePthreadMutexInit(&qos_mutex, NULL, "qosmutex");
+    scePthreadMutexInit(&qos_stats_mutex, NULL, "qosstatsmutex");
+    qos_interactive = 0;
+}
+
+// only short commands count as interactive, anything that may block for long (a connect,
+// a call into the process, an attach) would otherwise hold back every bulk stream while it runs
+int qos_classify(int fd, struct cmd_packet *packet) {
+    uint32_t length;
+
+    // jobs have no client
+    if (!find_client(fd)) {
+        return QOS_CLASS_BULK;
+    }
+
+    switch (packet->cmd) {
+        case CMD_PROC_READ:
+        case CMD_PROC_WRITE:
+        case CMD_PROC_READ_VALID:
+            // pid, address, length
+            if (packet->datalen < 16) {
+                return QOS_CLASS_INTERACTIVE;
+            }
+
+            length = *(uint32_t *)((uint8_t *)packet->data + 12);
+            return length > QOS_INTERACTIVE_LENGTH ? QOS_CLASS_BULK : QOS_CLASS_INTERACTIVE;
+        case CMD_KERN_READ:
+        case CMD_KERN_WRITE:
+        case CMD_KERN_PHYS_READ:
+        case CMD_KERN_PHYS_WRITE:
+            // address, length
+            if (packet->datalen < 12) {
+                return QOS_CLASS_INTERACTIVE;
+            }
+
+            length = *(uint32_t *)((uint8_t *)packet->data + 8);
+            return length > QOS_INTERACTIVE_LENGTH ? QOS_CLASS_BULK : QOS_CLASS_INTERACTIVE;
+        case CMD_VERSION:
+        case CMD_COMPRESS:
+        case CMD_POOL_STATS:
+        case CMD_JOB_SUBMIT:
+        case CMD_JOB_STATUS:
+        case CMD_JOB_CANCEL:
+        case CMD_QOS_STATS:
+        case CMD_QOS_WEIGHT:
+        case CMD_SERVER_STATS:
+        case CMD_TRACE_START:
+        case CMD_TRACE_STOP:
+        case CMD_PROC_LIST:
+        case CMD_PROC_MAPS:
+        case CMD_PROC_PROTECT:
+        case CMD_PROC_INFO:
+        case CMD_PROC_SCAN_COUNT_RESULTS:
+        case CMD_PROC_PRX_LIST:
+        case CMD_PROC_PTR_GATHER:
+        case CMD_PROC_VIEW_OPEN:
+        case CMD_PROC_VIEW_REFRESH:
+        case CMD_PROC_VIEW_CLOSE:
+        case CMD_PROC_SUB_REMOVE:
+        case CMD_PROC_RECORD_STOP:
+        case CMD_PROC_SNAP_DELETE:
+        case CMD_PROC_STATE_DELETE:
+        case CMD_DEBUG_BREAKPT:
+        case CMD_DEBUG_WATCHPT:
+        case CMD_DEBUG_THREADS:
+        case CMD_DEBUG_STOPTHR:
+        case CMD_DEBUG_RESUMETHR:
+        case CMD_DEBUG_GETREGS:
+        case CMD_DEBUG_SETREGS:
+        case CMD_DEBUG_GETFPREGS:
+        case CMD_DEBUG_SETFPREGS:
+        case CMD_DEBUG_GETDBGREGS:
+        case CMD_DEBUG_SETDBGREGS:
+        case CMD_DEBUG_STOPGO:
+        case CMD_DEBUG_THRINFO:
+        case CMD_DEBUG_SINGLESTEP:
+        case CMD_KERN_BASE:
+        case CMD_KERN_RDMSR:
+        case CMD_CONSOLE_INFO:
+            return QOS_CLASS_INTERACTIVE;
+    }
+
+    return QOS_CLASS_BULK;
+}
+
+void qos_begin(int fd, int cls) {
+    struct server_client *svc;
+
+    svc = find_client(fd);
+    if (svc) {
+        svc->qos = cls;
+    }
+
+    if (cls == QOS_CLASS_INTERACTIVE) {
+        __sync_fetch_and_add(&qos_interactive, 1);
+    }
+}
+
+// call with qos_mutex held
+struct qos_stream *qos_stream_find(int fd, int claim) {
+    struct qos_stream *slot;
+
+    slot = NULL;
+    for (int i = 0; i < QOS_MAX_STREAMS; i++) {
+        if (qos_streams[i].used && qos_streams[i].fd == fd) {
+            return &qos_streams[i];
+        }
+
+        if (!qos_streams[i].used && !slot) {
+            slot = &qos_streams[i];
+        }
+    }
+
+    if (!claim || !slot) {
+        return NULL;
+    }
+
+    memset(slot, NULL, sizeof(struct qos_stream));
+    slot->used = 1;
+    slot->fd = fd;
+    return slot;
+}
+
+// the stream whose turn it is, a stream gets weight quanta when the turn comes round to it
+// call with qos_mutex held
+struct qos_stream *qos_pick() {
+    struct qos_stream *s;
+
+    for (int i = 0; i <= QOS_MAX_STREAMS; i++) {
+        s = &qos_streams[qos_turn];
+        if (s->used && s->waiting && s->deficit) {
+            return s;
+        }
+
+        // a stream that is passed over starts its next turn afresh
+        s->deficit = 0;
+
+        qos_turn = (qos_turn + 1) % QOS_MAX_STREAMS;
+        s = &qos_streams[qos_turn];
+        if (s->used && s->waiting) {
+            s->deficit = s->weight;
+        }
+    }
+
+    return NULL;
+}
+
+// hands the bulk slot to the next stream if it is free
+// call with qos_mutex held
+void qos_schedule(uint64_t now) {
+    struct qos_stream *s;
+
+    // a holder that does not come back in time (a stalled socket) must not stop every other stream
+    if (qos_holder && now - qos_granted < QOS_MAX_HOLD) {
+        return;
+    }
+
+    qos_holder = NULL;
+
+    s = qos_pick();
+    if (!s) {
+        return;
+    }
+
+    // interactive commands go first, for at most QOS_MAX_DEFER so bulk keeps a share
+    if (qos_interactive > 0 && now - s->since < QOS_MAX_DEFER) {
+        return;
+    }
+
+    s->deficit--;
+    s->waiting = 0;
+    qos_holder = s;
+    qos_granted = now;
+}
+
+void qos_end(int fd, int cls, uint64_t start) {
+    struct qos_class_stats *stats;
+    struct qos_stream *s;
+    uint64_t latency;
+    uint32_t bucket;
+
+    if (cls == QOS_CLASS_INTERACTIVE) {
+        __sync_fetch_and_sub(&qos_interactive, 1);
+    }
+    else {
+        scePthreadMutexLock(&qos_mutex);
+
+        s = qos_stream_find(fd, 0);
+        if (s) {
+            if (qos_holder == s) {
+                qos_holder = NULL;
+            }
+
+            memset(s, NULL, sizeof(struct qos_stream));
+            qos_schedule(sceKernelGetProcessTime());
+        }
+
+        scePthreadMutexUnlock(&qos_mutex);
+    }
+
+    latency = sceKernelGetProcessTime() - start;
+
+    bucket = 0;
+    while (bucket < QOS_BUCKETS - 1 && (latency >> (bucket + 1))) {
+        bucket++;
+    }
+
+    stats = &qos_stats[cls];
+
+    scePthreadMutexLock(&qos_stats_mutex);
+    stats->count++;
+    stats->total += latency;
+    if (latency > stats->max) {
+        stats->max = latency;
+    }
+    stats->buckets[bucket]++;
+    scePthreadMutexUnlock(&qos_stats_mutex);
+}
+
+// bulk handlers call this before every chunk, it returns once the stream holds the bulk slot
+// so an interactive command waits for at most the one quantum in flight
+// jobs run on virtual sockets without a client and always count as bulk
+void qos_quantum(int fd) {
+    struct server_client *svc;
+    struct qos_stream *s;
+
+    svc = find_client(fd);
+    if (svc && svc->qos == QOS_CLASS_INTERACTIVE) {
+        return;
+    }
+
+    scePthreadMutexLock(&qos_mutex);
+
+    // more streams than slots only happens with every client and job busy, the rest go unscheduled
+    s = qos_stream_find(fd, 1);
+    if (!s) {
+        scePthreadMutexUnlock(&qos_mutex);
+        return;
+    }
+
+    // the quantum it held is done
+    if (qos_holder == s) {
+        qos_holder = NULL;
+    }
+
+    s->weight = svc && svc->weight ? svc->weight : QOS_DEFAULT_WEIGHT;
+    s->waiting = 1;
+    s->since = sceKernelGetProcessTime();
+
+    for (;;) {
+        qos_schedule(sceKernelGetProcessTime());
+        if (qos_holder == s) {
+            break;
+        }
+
+        // never sleep with the lock held, the other streams and qos_end need it
+        scePthreadMutexUnlock(&qos_mutex);
+        sceKernelUsleep(QOS_WAIT_SLEEP);
+        scePthreadMutexLock(&qos_mutex);
+    }
+
+    scePthreadMutexUnlock(&qos_mutex);
+}
+
+int qos_weight_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_qos_weight_packet *wp;
+    struct server_client *svc;
+
+    wp = (struct cmd_qos_weight_packet *)packet->data;
+
+    if (!wp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    svc = find_client(fd);
+    if (!svc) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    if (!wp->weight || wp->weight > QOS_MAX_WEIGHT) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    svc->weight = wp->weight;
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    return 0;
+}
+
+int qos_stats_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_qos_stats_response resp;
+
+    scePthreadMutexLock(&qos_stats_mutex);
+    memcpy(resp.classes, qos_stats, sizeof(resp.classes));
+    scePthreadMutexUnlock(&qos_stats_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_QOS_STATS_RESPONSE_SIZE);
+
+    return 0;
+}
@@ -0,0 +1,439 @@
+#include "record.h"
+#include "server.h"
+
+struct recorder rec;
+ScePthreadMutex record_mutex;
+
+void record_init() {
+    memset(&rec, NULL, sizeof(rec));
+    scePthreadMutexInit(&record_mutex, NULL, "recordmutex");
+}
+
+void record_put_varint(struct record_column *col, uint64_t v) {
+    while (v >= 0x80) {
+        col->stream[col->used++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+
+    col->stream[col->used++] = (uint8_t)v;
+}
+
+void record_put_dod(struct record_column *col, uint64_t value) {
+    int64_t delta = (int64_t)(value - col->prev);
+    int64_t dod = delta - col->prevdelta;
+
+    col->prev = value;
+    col->prevdelta = delta;
+
+    // zigzag so small negative changes stay small
+    record_put_varint(col, ((uint64_t)dod << 1) ^ (uint64_t)(dod >> 63));
+}
+
+void record_put_xor(struct record_column *col, uint64_t bits) {
+    uint64_t x = bits ^ col->prev;
+    uint32_t lz = 0;
+    uint32_t tz = 0;
+
+    col->prev = bits;
+
+    if (!x) {
+        col->stream[col->used++] = 0;
+        return;
+    }
+
+    while (!((x >> (56 - lz * 8)) & 0xFF)) {
+        lz++;
+    }
+
+    while (!((x >> (tz * 8)) & 0xFF)) {
+        tz++;
+    }
+
+    col->stream[col->used++] = 0x40 | (lz << 3) | tz;
+    for (uint32_t i = tz; i < 8 - lz; i++) {
+        col->stream[col->used++] = (uint8_t)(x >> (i * 8));
+    }
+}
+
+uint64_t record_channel_raw(struct record_channel *channel) {
+    uint64_t raw = 0;
+
+    memcpy(&raw, channel->value, channel->path.length);
+
+    switch (channel->type) {
+    case valTypeInt8:
+        return (uint64_t)(int64_t)(int8_t)raw;
+    case valTypeInt16:
+        return (uint64_t)(int64_t)(int16_t)raw;
+    case valTypeInt32:
+        return (uint64_t)(int64_t)(int32_t)raw;
+    default:
+        return raw;
+    }
+}
+
+void record_reset_columns() {
+    rec.time.prev = 0;
+    rec.time.prevdelta = 0;
+    rec.time.used = 0;
+
+    for (uint32_t i = 0; i < rec.count; i++) {
+        rec.channels[i].column.prev = 0;
+        rec.channels[i].column.prevdelta = 0;
+        rec.channels[i].column.used = 0;
+    }
+
+    rec.samples = 0;
+}
+
+// moves the open block into the ring, dropping the oldest blocks it overwrites
+void record_seal() {
+    struct record_block_header *header;
+    struct record_block_entry *entry;
+    uint32_t *lengths;
+    uint32_t length;
+    uint8_t *out;
+
+    if (!rec.samples) {
+        return;
+    }
+
+    length = RECORD_BLOCK_HEADER_SIZE + (rec.count + 1) * sizeof(uint32_t) + rec.time.used;
+    for (uint32_t i = 0; i < rec.count; i++) {
+        length += rec.channels[i].column.used;
+    }
+
+    // the next lap starts at 0, the oldest blocks are what is left of the last lap behind writepos
+    if (rec.writepos + length > RECORD_RING_SIZE) {
+        while (rec.num && rec.blocks[rec.head].offset >= rec.writepos) {
+            rec.head = (rec.head + 1) % RECORD_MAX_BLOCKS;
+            rec.num--;
+        }
+
+        rec.writepos = 0;
+    }
+
+    while (rec.num) {
+        entry = &rec.blocks[rec.head];
+        if (rec.num < RECORD_MAX_BLOCKS && (entry->offset >= rec.writepos + length || entry->offset + entry->length <= rec.writepos)) {
+            break;
+        }
+
+        rec.head = (rec.head + 1) % RECORD_MAX_BLOCKS;
+        rec.num--;
+    }
+
+    out = rec.ring + rec.writepos;
+
+    header = (struct record_block_header *)out;
+    header->first = rec.first;
+    header->last = rec.last;
+    header->samples = rec.samples;
+    header->channels = rec.count;
+    out += RECORD_BLOCK_HEADER_SIZE;
+
+    lengths = (uint32_t *)out;
+    out += (rec.count + 1) * sizeof(uint32_t);
+
+    lengths[0] = rec.time.used;
+    memcpy(out, rec.time.stream, rec.time.used);
+    out += rec.time.used;
+
+    for (uint32_t i = 0; i < rec.count; i++) {
+        lengths[i + 1] = rec.channels[i].column.used;
+        memcpy(out, rec.channels[i].column.stream, rec.channels[i].column.used);
+        out += rec.channels[i].column.used;
+    }
+
+    entry = &rec.blocks[(rec.head + rec.num) % RECORD_MAX_BLOCKS];
+    entry->seq = rec.seq++;
+    entry->first = rec.first;
+    entry->last = rec.last;
+    entry->offset = rec.writepos;
+    entry->length = length;
+    rec.num++;
+
+    rec.writepos += length;
+
+    record_reset_columns();
+}
+
+void record_append(uint64_t timestamp) {
+    struct record_channel *channel;
+
+    if (!rec.samples) {
+        rec.first = timestamp;
+    }
+
+    rec.last = timestamp;
+    record_put_dod(&rec.time, timestamp);
+
+    for (uint32_t i = 0; i < rec.count; i++) {
+        channel = &rec.channels[i];
+
+        // a failed read repeats the last value
+        if (channel->path.failed) {
+            rec.failed++;
+        }
+
+        if (channel->type == valTypeFloat || channel->type == valTypeDouble) {
+            record_put_xor(&channel->column, channel->path.failed ? channel->column.prev : record_channel_raw(channel));
+        }
+        else {
+            record_put_dod(&channel->column, channel->path.failed ? channel->column.prev : record_channel_raw(channel));
+        }
+    }
+
+    rec.samples++;
+    rec.total++;
+
+    if (rec.samples == RECORD_BLOCK_SAMPLES) {
+        record_seal();
+    }
+}
+
+void *record_thread(void *arg) {
+    struct proc_path *paths[RECORD_MAX_CHANNELS];
+    uint32_t generation;
+    uint64_t next;
+    uint64_t now;
+
+    scePthreadMutexLock(&record_mutex);
+    generation = rec.generation;
+    for (uint32_t i = 0; i < rec.count; i++) {
+        paths[i] = &rec.channels[i].path;
+    }
+    scePthreadMutexUnlock(&record_mutex);
+
+    next = sceKernelGetProcessTime();
+
+    while (!unload_cmd_sent) {
+        scePthreadMutexLock(&record_mutex);
+
+        if (!rec.running || rec.generation != generation) {
+            scePthreadMutexUnlock(&record_mutex);
+            break;
+        }
+
+        now = sceKernelGetProcessTime();
+        proc_read_paths(rec.pid, paths, rec.count);
+        record_append(now);
+
+        scePthreadMutexUnlock(&record_mutex);
+
+        // keep a fixed rate, skip samples instead of bursting when we fall behind
+        next += rec.period;
+        now = sceKernelGetProcessTime();
+        if (next <= now) {
+            next = now;
+        }
+        else {
+            sceKernelUsleep(next - now);
+        }
+    }
+
+    trace_thread_exit();
+
+    return NULL;
+}
+
+void record_free() {
+    if (rec.staging) {
+        free(rec.staging);
+    }
+
+    if (rec.ring) {
+        free(rec.ring);
+    }
+
+    rec.staging = NULL;
+    rec.ring = NULL;
+}
+
+int record_start_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_record_start_packet *sp;
+    struct cmd_proc_record_channel *channel;
+    struct record_channel *rc;
+    ScePthread thread;
+    uint8_t *list;
+    uint32_t offset;
+    uint32_t stride;
+    size_t size;
+
+    sp = (struct cmd_proc_record_start_packet *)packet->data;
+
+    if (!sp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (!sp->count || sp->count > RECORD_MAX_CHANNELS || sp->length > RECORD_MAX_CHANNELS * (CMD_PROC_RECORD_CHANNEL_SIZE + PROC_PTR_MAX_DEPTH * sizeof(int64_t))) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 1;
+    }
+
+    list = (uint8_t *)pfmalloc(sp->length);
+    if (!list) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+    net_recv_data(fd, list, sp->length, 1);
+
+    scePthreadMutexLock(&record_mutex);
+
+    // a new recording replaces the previous one
+    rec.running = 0;
+    rec.generation++;
+    record_free();
+
+    stride = RECORD_BLOCK_SAMPLES * RECORD_MAX_ENCODED;
+    rec.staging = (uint8_t *)pfmalloc((sp->count + 1) * stride);
+    rec.ring = (uint8_t *)pfmalloc(RECORD_RING_SIZE);
+    if (!rec.staging || !rec.ring) {
+        record_free();
+        scePthreadMutexUnlock(&record_mutex);
+        free(list);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 0;
+    }
+
+    offset = 0;
+    for (uint32_t i = 0; i < sp->count; i++) {
+        channel = (struct cmd_proc_record_channel *)(list + offset);
+
+        if (offset + CMD_PROC_RECORD_CHANNEL_SIZE > sp->length || channel->depth > PROC_PTR_MAX_DEPTH ||
+            offset + CMD_PROC_RECORD_CHANNEL_SIZE + channel->depth * sizeof(int64_t) > sp->length) {
+            record_free();
+            scePthreadMutexUnlock(&record_mutex);
+            free(list);
+            net_send_status(fd, CMD_ERROR);
+            return 0;
+        }
+
+        size = proc_scan_getSizeOfValueType(channel->type);
+        if (!size) {
+            record_free();
+            scePthreadMutexUnlock(&record_mutex);
+            free(list);
+            net_send_status(fd, CMD_ERROR);
+            return 0;
+        }
+
+        rc = &rec.channels[i];
+        memset(rc, NULL, sizeof(struct record_channel));
+        rc->type = channel->type;
+        rc->path.address = channel->address;
+        rc->path.length = size;
+        rc->path.depth = channel->depth;
+        rc->path.data = rc->value;
+        memcpy(rc->path.offsets, list + offset + CMD_PROC_RECORD_CHANNEL_SIZE, channel->depth * sizeof(int64_t));
+        rc->column.stream = rec.staging + (i + 1) * stride;
+
+        offset += CMD_PROC_RECORD_CHANNEL_SIZE + channel->depth * sizeof(int64_t);
+    }
+
+    rec.time.stream = rec.staging;
+    rec.pid = sp->pid;
+    rec.period = sp->period < RECORD_MIN_PERIOD ? RECORD_MIN_PERIOD : sp->period;
+    rec.count = sp->count;
+    rec.writepos = 0;
+    rec.head = 0;
+    rec.num = 0;
+    rec.seq = 0;
+    rec.total = 0;
+    rec.failed = 0;
+    record_reset_columns();
+    rec.running = 1;
+
+    scePthreadCreate(&thread, NULL, (void *)record_thread, NULL, "record_thread");
+
+    scePthreadMutexUnlock(&record_mutex);
+
+    free(list);
+
+    net_send_status(fd, CMD_SUCCESS);
+    return 0;
+}
+
+int record_stop_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_record_stop_response resp;
+
+    // the recorded blocks stay around for queries until the next start
+    scePthreadMutexLock(&record_mutex);
+    rec.running = 0;
+    record_seal();
+    resp.samples = rec.total;
+    resp.failed = rec.failed;
+    scePthreadMutexUnlock(&record_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_RECORD_STOP_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int record_query_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_record_query_packet *qp;
+    struct record_block_entry *entry;
+    uint64_t cursor;
+    uint32_t length;
+    uint8_t *data;
+
+    qp = (struct cmd_proc_record_query_packet *)packet->data;
+
+    if (!qp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    // a block holds at most RECORD_BLOCK_SAMPLES encoded values per column
+    data = (uint8_t *)pfmalloc(RECORD_BLOCK_HEADER_SIZE + (RECORD_MAX_CHANNELS + 1) * (sizeof(uint32_t) + RECORD_BLOCK_SAMPLES * RECORD_MAX_ENCODED));
+    if (!data) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    // copy one block at a time so the sampler is never held up by the network
+    cursor = 0;
+    while (true) {
+        length = 0;
+
+        // one block per quantum, so a long recording does not go out in one go
+        qos_quantum(fd);
+
+        scePthreadMutexLock(&record_mutex);
+
+        if (rec.ring && cursor == 0 && rec.running) {
+            record_seal();
+        }
+
+        for (uint32_t i = 0; rec.ring && i < rec.num; i++) {
+            entry = &rec.blocks[(rec.head + i) % RECORD_MAX_BLOCKS];
+            if (entry->seq < cursor || entry->last < qp->start || entry->first > qp->end) {
+                continue;
+            }
+
+            memcpy(data, rec.ring + entry->offset, entry->length);
+            length = entry->length;
+            cursor = entry->seq + 1;
+            break;
+        }
+
+        scePthreadMutexUnlock(&record_mutex);
+
+        if (net_send_data(fd, &length, sizeof(uint32_t)) < 0 || (length && net_send_data(fd, data, length) < 0)) {
+            free(data);
+            return 1;
+        }
+
+        if (!length) {
+            break;
+        }
+    }
+
+    free(data);
+    return 0;
+}
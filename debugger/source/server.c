@@ -12,6 +12,7 @@ struct server_client *alloc_client() {
     for (int i = 0; i < SERVER_MAXCLIENTS; i++) {
         if (servclients[i].id == 0) {
             servclients[i].id = i + 1;
+            stats_add(STATS_CLIENTS, 1);
             return &servclients[i];
         }
     }
@@ -21,13 +22,31 @@ struct server_client *alloc_client() {
 
 void free_client(struct server_client *svc) {
     svc->id = 0;
+    net_uncork(svc->fd);
     sceNetSocketClose(svc->fd);
 
     if (svc->debugging) {
         debug_cleanup(&svc->dbgctx);
     }
 
+    proc_view_free_all(svc->views);
+    sub_remove_client(svc);
+    job_remove_client(svc);
+    transfer_remove_client(svc);
+    pool_destroy(&svc->pool);
+
     memset(svc, NULL, sizeof(struct server_client));
+    stats_sub(STATS_CLIENTS, 1);
+}
+
+struct server_client *find_client(int fd) {
+    for (int i = 0; i < SERVER_MAXCLIENTS; i++) {
+        if (servclients[i].id != 0 && servclients[i].fd == fd) {
+            return &servclients[i];
+        }
+    }
+
+    return NULL;
 }
 
 struct uart_server_client *alloc_uart_client() {
@@ -73,14 +92,46 @@ int unload_handle(int fd, struct cmd_packet *packet) {
     return 0;
 }
 
-int cmd_handler(int fd, struct cmd_packet *packet) {
-    if (!VALID_CMD(packet->cmd)) {
-        return 1;
-    }
-
+int cmd_dispatch(int fd, struct cmd_packet *packet) {
     if (packet->cmd == CMD_VERSION) {
         return handle_version(fd, packet);
     }
+    if (packet->cmd == CMD_COMPRESS) {
+        return compress_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_POOL_STATS) {
+        return pool_stats_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_JOB_SUBMIT) {
+        return job_submit_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_JOB_STATUS) {
+        return job_status_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_JOB_CANCEL) {
+        return job_cancel_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_JOB_FETCH) {
+        return job_fetch_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_QOS_STATS) {
+        return qos_stats_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_QOS_WEIGHT) {
+        return qos_weight_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_SERVER_STATS) {
+        return stats_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_TRACE_START) {
+        return trace_start_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_TRACE_STOP) {
+        return trace_stop_handle(fd, packet);
+    }
+    if (packet->cmd == CMD_TRACE_DUMP) {
+        return trace_dump_handle(fd, packet);
+    }
     if (packet->cmd == CMD_UNLOAD) {
         return unload_handle(fd, packet);
     }
@@ -100,6 +151,31 @@ int cmd_handler(int fd, struct cmd_packet *packet) {
     return 0;
 }
 
+int cmd_handler(int fd, struct cmd_packet *packet) {
+    uint64_t start;
+    int cls;
+    int r;
+
+    if (!VALID_CMD(packet->cmd)) {
+        return 1;
+    }
+
+    start = sceKernelGetProcessTime();
+    cls = qos_classify(fd, packet);
+
+    trace_begin(TRACE_COMMAND, packet->cmd);
+
+    qos_begin(fd, cls);
+    r = cmd_dispatch(fd, packet);
+    qos_end(fd, cls, start);
+
+    trace_end(TRACE_COMMAND);
+
+    stats_command(packet->cmd, sceKernelGetProcessTime() - start);
+
+    return r;
+}
+
 int check_debug_interrupt() {
     struct debug_interrupt_packet resp;
     struct debug_breakpoint *breakpoint;
@@ -237,6 +313,8 @@ int check_debug_interrupt() {
         uprintf("net_send_data failed %i %i", r, errno);
     }
 
+    ws_debug_interrupt(&resp);
+
     free(lwpinfo);
 
     return 0;
@@ -251,6 +329,10 @@ int handle_socket_client(struct server_client *svc) {
     int r;
 
     fd = svc->fd;
+    data = NULL;
+
+    // replies are gathered and flushed once the handler is done
+    net_cork(fd, &svc->cork);
 
     // setup time val for select
     struct timeval tv;
@@ -323,7 +405,7 @@ int handle_socket_client(struct server_client *svc) {
         length = packet.datalen;
         if (length) {
             // allocate data
-            data = pfmalloc(length);
+            data = pool_get(&svc->pool, length);
             if (!data) {
                 goto error;
             }
@@ -349,9 +431,10 @@ int handle_socket_client(struct server_client *svc) {
 
         // handle the packet
         r = cmd_handler(fd, &packet);
+        net_flush(fd);
 
         if (data) {
-            free(data);
+            pool_put(&svc->pool, data);
             data = NULL;
         }
 
@@ -363,7 +446,13 @@ int handle_socket_client(struct server_client *svc) {
 
 error:
     uprintf("client disconnected");
+
+    if (data) {
+        pool_put(&svc->pool, data);
+    }
+
     free_client(svc);
+    trace_thread_exit();
 
     return 0;
 }
@@ -540,6 +629,9 @@ int start_server() {
 
             ScePthread thread;
             scePthreadCreate(&thread, NULL, (void *)handle_socket_client, (void *)svc, "clienthandler");
+
+            // the data streams of a transfer connect right after each other
+            continue;
         }
 
         // this is the time we sleep in between adding clients
@@ -553,375 +645,6 @@ int start_server() {
     return 0;
 }
 
-void send_web_data(int fd, const char *data, bool success) {
-    int size = strlen(data);
-
-    if (success) {
-        fd_printf(fd, "HTTP/1.1 200 OK\r\n");
-    }
-    else {
-        fd_printf(fd, "HTTP/1.1 400 Bad Request\r\n");
-    }
-
-    fd_printf(fd, "Content-Type: application/json\r\n");
-    fd_printf(fd, "Access-Control-Allow-Origin: *\r\n");
-    fd_printf(fd, "Content-Length: %d\r\n\r\n", size);
-
-    ssize_t bytes_sent;
-    while (size > 0) {
-        bytes_sent = write(fd, data, size);
-        if (bytes_sent < 0) {
-            return;
-        }
-
-        size -= bytes_sent;
-        data += bytes_sent;
-    }
-}
-
-void handle_web_allocate_memory(int fd, char *query) {
-    char *fixedChar = query + 1;
-    char *pidQuery = strtok(fixedChar, "&");
-    char *lengthQuery = strtok(NULL, "&");
-    char *pidParam = pidQuery + 4;
-    char *lengthParam = lengthQuery + 7;
-    // if (!strstr(pidQuery, "pid=") || !strstr(lengthQuery, "length=")) {
-    //     send_web_data(fd, "{\"message\": \"Invalid params.\"}", false);
-    //     return;
-    // }
-    char *pidEnd;
-    char *lengthEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-    uint64_t length = strtoull(lengthParam, &lengthEnd, 16);
-    struct sys_proc_alloc_args args;
-    args.length = length;
-    sys_proc_cmd(pid, SYS_PROC_ALLOC, &args);
-    char responseJson[1000];
-    *(char *)responseJson = 0;
-    snprintf(responseJson, sizeof(responseJson), "{\"success\": true,\"allocated_address\": \"0x%llX\"}", args.address);
-    send_web_data(fd, responseJson, true);
-}
-
-void handle_web_free_meory(int fd, char *query) {
-    char *fixedChar = query + 1;
-    char *pidQuery = strtok(fixedChar, "&");
-    char *addressQuery = strtok(NULL, "&");
-    char *lengthQuery = strtok(NULL, "&");
-    char *pidParam = pidQuery + 4;
-    char *addressParam = addressQuery + 8;
-    char *lengthParam = lengthQuery + 7;
-    // if (!strstr(pidQuery, "pid=") || !strstr(addressQuery, "address=") || !strstr(lengthQuery, "length=")) {
-    //     send_web_data(fd, "{\"message\": \"Invalid params.\"}", false);
-    //     return;
-    // }
-    char *pidEnd;
-    char *addressEnd;
-    char *lengthEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-    uint64_t address = strtoull(addressParam, &addressEnd, 16);
-    uint64_t length = strtoull(lengthParam, &lengthEnd, 16);
-    struct sys_proc_free_args args;
-    args.address = address;
-    args.length = length;
-    sys_proc_cmd(pid, SYS_PROC_FREE, &args);
-    send_web_data(fd, "{\"success\":true}", true);
-}
-
-void handle_web_get_process_info(int fd, char *query) {
-    char *pidParam = query + 5;
-    struct sys_proc_info_args args;
-    char *pidEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-    sys_proc_cmd(pid, SYS_PROC_INFO, &args);
-    
-    char responseJson[1000];
-    *(char *)responseJson = 0;
-    snprintf(responseJson, sizeof(responseJson), "{\"pid\":%i,\"name\":\"%s\",\"path\":\"%s\",\"title_id\":\"%s\",\"content_id\":\"%s\"}", args.pid, args.name, args.path, args.titleid, args.contentid);
-    send_web_data(fd, responseJson, true);
-}
-
-void handle_web_process_maps(int fd, char *query) {
-    char *pidParam = query + 5;
-    char *pidEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-
-    struct sys_proc_vm_map_args args;
-    uint32_t size;
-    memset(&args, NULL, sizeof(args));
-
-    if (sys_proc_cmd(pid, SYS_PROC_VM_MAP, &args)) {
-        send_web_data(fd, "{\"message\":\"SYS_PROC_VM_MAP returned error\"}", false);
-        return;
-    }
-
-    size = args.num * sizeof(struct proc_vm_map_entry);
-    args.maps = (struct proc_vm_map_entry *)pfmalloc(size);
-    if (!args.maps) {
-        free(args.maps);
-        send_web_data(fd, "{\"message\":\"pfmalloc returned error\"}", false);
-        return;
-    }
-
-    if (sys_proc_cmd(pid, SYS_PROC_VM_MAP, &args)) {
-        free(args.maps);
-        send_web_data(fd, "{\"message\":\"SYS_PROC_VM_MAP returned error\"}", false);
-        return;
-    }
-
-    char responseJson[0x100000]; // needs to be even bigger for games like bo3
-    *(char *)responseJson = 0;
-    for (int entryIndex = 0; entryIndex < args.num; entryIndex++) {
-        char tempBuf[1000];
-        snprintf(tempBuf, sizeof(tempBuf), "%s{\"name\":\"%s\",\"start\":\"0x%llX\",\"end\":\"0x%llX\",\"offset\":\"0x%llx\",\"prot\":\"%i\"}", entryIndex == 0 ? "[" : ",", args.maps[entryIndex].name, args.maps[entryIndex].start, args.maps[entryIndex].end, args.maps[entryIndex].offset, args.maps[entryIndex].prot);
-        strcat(responseJson, tempBuf);
-    }
-    strcat(responseJson, "]\n");
-    send_web_data(fd, responseJson, true);
-    free(args.maps);
-}
-
-void handle_web_process_list(int fd) {
-    void *data;
-    uint64_t num;
-    uint32_t length;
-
-    sys_proc_list(NULL, &num);
-
-    if (num > 0) {
-        length = sizeof(struct proc_list_entry) * num;
-        data = pfmalloc(length);
-        if (!data) {
-            return;
-        }
-            
-        sys_proc_list(data, &num);
-        struct proc_list_entry *entries = (struct proc_list_entry *)((struct proc_list_entry **)data);
-        char responseJson[0x20000];
-        *(char *)responseJson = 0;
-        for(int entryIndex = 0; entryIndex < num; entryIndex++) {
-            char tempBuf[1000];
-            snprintf(tempBuf, sizeof(tempBuf), "%s{\"name\":\"%s\",\"pid\":%i }", entryIndex == 0 ? "[" : ",", entries[entryIndex].p_comm, entries[entryIndex].pid);
-            strcat(responseJson, tempBuf);
-        }
-        strcat(responseJson, "]\n");
-        send_web_data(fd, responseJson, true);
-        free(data);
-
-        return;
-    }
-    else {
-        send_web_data(fd, "{\"message\": \"Could not get list of processes.\"}\n", false);
-        return;
-    }
-}
-
-void handle_web_notify(int fd, char *query) {
-    char *fixedChar = query + 1;
-    char *messageTypeQuery = strtok(fixedChar, "&");
-    char *messageQuery = strtok(NULL, "&");
-    char *messageTypeParam = messageTypeQuery + 12;
-    char *messageParam = messageQuery + 8;
-    char *messageTypeEnd;
-    int messageType = (int)strtoull(messageTypeParam, &messageTypeEnd, 10);
-    size_t decodedMessageLength;
-    unsigned char *message = base64_decode((const unsigned char *)messageParam, strlen(messageParam), &decodedMessageLength);
-    void *data = pfmalloc(decodedMessageLength + 1);
-    strcpy(data, (const char *)message);
-    sceSysUtilSendSystemNotificationWithText(messageType, data);
-    free(data);
-    send_web_data(fd, "{\"success\": true}\n", true);
-}
-
-void handle_web_write_memory(int fd, char *query) {
-    char *fixedChar = query + 1;
-    char *pidQuery = strtok(fixedChar, "&");
-    char *addressQuery = strtok(NULL, "&");
-    char *bytesQuery = strtok(NULL, "&");
-    char *pidParam = pidQuery + 4;
-    char *address = addressQuery + 8;
-    char *bytes = bytesQuery + 6;
-    // if (!strstr(pidQuery, "pid=") || !strstr(addressQuery, "address=") || !strstr(bytesQuery, "bytes=")) {
-    //     send_web_data(fd, "{\"message\": \"Invalid params.\"}", false);
-    //     return;
-    // }
-    char *pidEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-    char *memoryEnd;
-    uint64_t memoryAddress = strtoull(address, &memoryEnd, 16);
-    int bytesLength = strlen(bytes) / 2;
-    char *byteData = pfmalloc(bytesLength);
-    for(int i = 0; i < bytesLength; i++) {
-        char tempBuffer[3];
-        char *dummy;
-        strncpy(tempBuffer, bytes + (i * 2), 2);
-        unsigned long long tempChar = strtoull(tempBuffer, &dummy, 16);
-        *(unsigned char *)(byteData + i) = (unsigned char)tempChar;
-    }
-    sys_proc_rw(pid, memoryAddress, byteData, bytesLength, 1);
-
-    free(byteData);
-
-    send_web_data(fd, "{\"success\": true}\n", true);
-}
-
-void handle_web_read_memory(int fd, char *query) {
-    char *fixedChar = query + 1;
-    char *pidQuery = strtok(fixedChar, "&");
-    char *addressQuery = strtok(NULL, "&");
-    char *lengthQuery = strtok(NULL, "&");
-    char *pidParam = pidQuery + 4;
-    char *addressParam = addressQuery + 8;
-    char *lengthParam = lengthQuery + 7;
-    char *pidEnd;
-    uint64_t pid = strtoull(pidParam, &pidEnd, 10);
-    char *addressEnd;
-    uint64_t address = strtoull(addressParam, &addressEnd, 16);
-    char *lengthEnd;
-    uint64_t length = strtoull(lengthParam, &lengthEnd, 16);
-    void *data = pfmalloc(length + 1);
-    if (!data) {
-        send_web_data(fd, "{\"message\":\"pfmalloc returned error\"}", false);
-        return;
-    }
-    memset(data, NULL, length);
-    sys_proc_rw(pid, address, data, length, 0);
-    char bytesString[0x20000];
-    *(char *)bytesString = 0;
-    unsigned char *ptr = data;
-    for(int i = 0; i < length; i++) {
-        char tempBuf[4];
-        snprintf(tempBuf, sizeof(tempBuf), "%s%02X", (i == 0 ? "" : " "), (int)ptr[i]);
-        strcat(bytesString, tempBuf);
-    }
-    char responseJson[0x20000];
-    *(char *)responseJson = 0;
-    snprintf(responseJson, sizeof(responseJson), "{\"bytes\": \"%s\"}", bytesString);
-    send_web_data(fd, responseJson, true);
-    free(data);
-}
-
-void handle_web_client(int fd) {
-    char headerBuffer[4096] = {0};
-    read(fd, headerBuffer, 4096);
-    char *requestHeader = strtok(headerBuffer, "\r\n");
-
-    char *requestHeaderPart = strtok(requestHeader, " ");
-    while (requestHeaderPart != NULL) {
-        if (strstr(requestHeaderPart, "/") != NULL) {
-            break;
-        }
-        
-        requestHeaderPart = strtok(NULL, " ");
-    }
-    char *dummyHost = "localhost:2812";
-    char buffer[1000];
-    snprintf(buffer, sizeof(buffer), "%s%s", dummyHost, requestHeaderPart);
-    int ret;
-    void *pool;
-    size_t mallocSize, useSize;
-    struct SceHttpUriElement element;
-
-    ret = sceHttpUriParse(NULL, buffer, NULL, &mallocSize, 0);
-    if (ret < 0) {
-        return;
-    }
-
-    pool = malloc(mallocSize);
-    if (pool == NULL) {
-        return;
-    }
-
-    ret = sceHttpUriParse(&element, buffer, pool, &useSize, mallocSize);
-    if (ret < 0) {
-        // is it fine if this fails? ~DeathRGH 2022/02/17
-    }
-
-    if (!strcmp(element.path, "/write-memory")) {
-        handle_web_write_memory(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/read-memory")) {
-        handle_web_read_memory(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/allocate-memory")) {
-        handle_web_allocate_memory(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/free-memory")) {
-        handle_web_free_meory(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/notify")) {
-        handle_web_notify(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/process-list")) {
-        handle_web_process_list(fd);
-        return;
-    }
-    if (!strcmp(element.path, "/process-info")) {
-        handle_web_get_process_info(fd, element.query);
-        return;
-    }
-    if (!strcmp(element.path, "/process-maps")) {
-        handle_web_process_maps(fd, element.query);
-        return;
-    }
-    send_web_data(fd, "{\"message\": \"Default Server\"}\n", true);
-}
-
-int start_http() {
-    struct sockaddr_in serverAddress;
-    struct sockaddr_in clientAddress;
-    unsigned int clientAddressLength = sizeof(clientAddress);
-    int server;
-    int clientSocket;
-
-    memset(&serverAddress, 0, sizeof(serverAddress));
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_addr.s_addr = IN_ADDR_ANY;
-    serverAddress.sin_port = sceNetHtons(HTTP_SERVER_PORT);
-
-    server = sceNetSocket("httpserver", AF_INET, SOCK_STREAM, 0);
-    if (server < 0) {
-        return 1;
-    }
-    
-    int flag = 1;
-    sceNetSetsockopt(server, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-
-    int nbFlag = 1;
-    sceNetSetsockopt(server, SOL_SOCKET, SCE_NET_SO_NBIO, &nbFlag, sizeof(nbFlag));
-
-    int bindResponse = sceNetBind(server, (struct sockaddr*)&serverAddress, sizeof(serverAddress));
-    if (bindResponse) {
-        return 1;
-    }
-
-    int listenResponse = sceNetListen(server, SERVER_MAXCLIENTS * 2);
-    if (listenResponse) {
-        return 1;
-    }
-
-    while (true) {
-        if (unload_cmd_sent) {
-            break;
-        }
-        clientSocket = sceNetAccept(server, (struct sockaddr*)&clientAddress, &clientAddressLength);
-        if (clientSocket > -1) {
-            handle_web_client(clientSocket);
-            sceNetSocketClose(clientSocket);
-        }
-    }
-
-    sceNetSocketAbort(0, server);
-    sceNetSocketClose(server);
-    sceKernelUsleep(10000);
-    uprintf("Http server thread has ended!");
-    return 0;
-}
-
 int read_kernel_for_client(struct uart_server_client *svc) {
     char s_Buffer[100];
     int bytesRead = 0;
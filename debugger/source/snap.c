@@ -0,0 +1,781 @@
+#include "snap.h"
+#include "server.h"
+
+struct snapshot snaps[SNAP_MAX];
+ScePthreadMutex snap_mutex;
+
+void snap_init() {
+    memset(snaps, NULL, sizeof(snaps));
+    scePthreadMutexInit(&snap_mutex, NULL, "snapmutex");
+    mkdir(SNAP_DIR, 0777);
+}
+
+// names become directories, scanner names are only valid as a diff source
+int snap_valid_name(const char *name, int scan) {
+    int i;
+
+    if (scan && name[0] == SNAP_SCAN_PREFIX) {
+        name++;
+    }
+
+    for (i = 0; i < SNAP_NAME_LENGTH - 1 && name[i]; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-')) {
+            return 0;
+        }
+    }
+
+    return i > 0 && !name[i];
+}
+
+// a slot is in use from the moment its name is reserved, callers hold snap_mutex
+struct snapshot *snap_find(const char *name) {
+    for (int i = 0; i < SNAP_MAX; i++) {
+        if (snaps[i].name[0] && !strcmp(snaps[i].name, name)) {
+            return &snaps[i];
+        }
+    }
+
+    return NULL;
+}
+
+// pins a finished snapshot for reading, snap_mutex is only held for the lookup
+struct snapshot *snap_get(const char *name) {
+    struct snapshot *snap;
+
+    scePthreadMutexLock(&snap_mutex);
+
+    snap = snap_find(name);
+    if (snap && snap->taking) {
+        snap = NULL;
+    }
+
+    if (snap) {
+        snap->refs++;
+    }
+
+    scePthreadMutexUnlock(&snap_mutex);
+
+    return snap;
+}
+
+void snap_put(struct snapshot *snap) {
+    scePthreadMutexLock(&snap_mutex);
+    snap->refs--;
+    scePthreadMutexUnlock(&snap_mutex);
+}
+
+void snap_free(struct snapshot *snap) {
+    char path[96];
+
+    if (snap->dir[0]) {
+        for (uint32_t i = 0; i < snap->count; i++) {
+            snprintf(path, sizeof(path), "%s/%i", snap->dir, snap->regions[i].fileId);
+            unlink(path);
+        }
+
+        rmdir(snap->dir);
+    }
+
+    if (snap->regions) {
+        free(snap->regions);
+    }
+
+    if (snap->data) {
+        free(snap->data);
+    }
+
+    memset(snap, NULL, sizeof(struct snapshot));
+}
+
+// @init, @cur and @old describe the files the scanner keeps for its sections, callers hold scan_mutex
+int snap_load_scan(const char *name, struct snapshot *snap) {
+    memset(snap, NULL, sizeof(struct snapshot));
+
+    if (!strcmp(name, "@init")) {
+        strcpy(snap->dir, "/data/scan_temp/init");
+    }
+    else if (!strcmp(name, "@cur")) {
+        strcpy(snap->dir, "/data/scan_temp/cur");
+    }
+    else if (!strcmp(name, "@old")) {
+        strcpy(snap->dir, "/data/scan_temp/old");
+    }
+    else {
+        return 1;
+    }
+
+    if (!savedSectionList.sections || !savedSectionList.count) {
+        return 1;
+    }
+
+    snap->regions = (struct snap_region *)malloc(savedSectionList.count * sizeof(struct snap_region));
+    if (!snap->regions) {
+        return 1;
+    }
+
+    for (uint64_t i = 0; i < savedSectionList.count; i++) {
+        struct saved_section *section = &savedSectionList.sections[i];
+        if (!section->start) {
+            continue;
+        }
+
+        snap->regions[snap->count].address = section->start;
+        snap->regions[snap->count].length = section->end - section->start;
+        snap->regions[snap->count].offset = 0;
+        snap->regions[snap->count].fileId = section->fileId;
+        snap->size += section->end - section->start;
+        snap->count++;
+    }
+
+    strcpy(snap->name, name);
+    return 0;
+}
+
+// reads a snapshot region from memory or its file, or live memory when there is no snapshot
+struct snap_reader {
+    struct snapshot *snap;
+    uint32_t pid;
+    struct proc_vm_map_cache *cache;
+    int file;
+    uint32_t index;
+};
+
+void snap_reader_init(struct snap_reader *reader, struct snapshot *snap, uint32_t pid, struct proc_vm_map_cache *cache) {
+    reader->snap = snap;
+    reader->pid = pid;
+    reader->cache = cache;
+    reader->file = -1;
+    reader->index = 0;
+}
+
+void snap_reader_close(struct snap_reader *reader) {
+    if (reader->file >= 0) {
+        close(reader->file);
+        reader->file = -1;
+    }
+}
+
+// unreadable pages and missing file data read as zero, like the scanner's files
+void snap_read(struct snap_reader *reader, uint32_t index, uint64_t address, uint64_t offset, uint8_t *data, uint32_t length) {
+    struct snapshot *snap = reader->snap;
+    char path[96];
+    int n;
+
+    if (!snap) {
+        proc_read_valid(reader->pid, address, data, length, reader->cache, NULL, NULL);
+        return;
+    }
+
+    if (snap->data) {
+        memcpy(data, snap->data + snap->regions[index].offset + offset, length);
+        return;
+    }
+
+    if (reader->file < 0 || reader->index != index) {
+        snap_reader_close(reader);
+        snprintf(path, sizeof(path), "%s/%i", snap->dir, snap->regions[index].fileId);
+        reader->file = open(path, O_RDONLY, 0);
+        reader->index = index;
+    }
+
+    n = 0;
+    if (reader->file >= 0) {
+        lseek(reader->file, offset, SEEK_SET);
+        n = read(reader->file, data, length);
+        if (n < 0) {
+            n = 0;
+        }
+    }
+
+    if ((uint32_t)n < length) {
+        memset(data + n, NULL, length - n);
+    }
+}
+
+// copies a single region into memory or its file in SNAP_CHUNK reads
+int snap_take_region(int fd, struct snapshot *snap, uint32_t index, uint8_t *buffer, struct proc_vm_map_cache *cache) {
+    struct snap_region *region = &snap->regions[index];
+    char path[96];
+    uint64_t offset;
+    uint32_t chunk;
+    int file;
+
+    file = -1;
+    if (!snap->data) {
+        snprintf(path, sizeof(path), "%s/%i", snap->dir, region->fileId);
+        if ((file = open(path, O_CREAT | O_RDWR | O_TRUNC, 0777)) < 0) {
+            return 1;
+        }
+    }
+
+    for (offset = 0; offset < region->length; offset += chunk) {
+        if (net_cancelled(fd)) {
+            break;
+        }
+
+        qos_quantum(fd);
+
+        chunk = region->length - offset > SNAP_CHUNK ? SNAP_CHUNK : region->length - offset;
+
+        if (snap->data) {
+            proc_read_valid(snap->pid, region->address + offset, snap->data + region->offset + offset, chunk, cache, NULL, NULL);
+        }
+        else {
+            proc_read_valid(snap->pid, region->address + offset, buffer, chunk, cache, NULL, NULL);
+            if (write(file, buffer, chunk) != (int)chunk) {
+                close(file);
+                return 1;
+            }
+        }
+    }
+
+    if (file >= 0) {
+        close(file);
+    }
+
+    return offset < region->length;
+}
+
+int snap_take_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_snap_take_packet *tp;
+    struct cmd_proc_snap_take_response resp;
+    struct cmd_proc_snap_range *ranges;
+    struct proc_vm_map_cache cache;
+    struct snapshot *snap;
+    struct snapshot taken;
+    struct snapshot old;
+    uint8_t *buffer;
+    uint64_t limit;
+    uint32_t count;
+    uint32_t error;
+
+    tp = (struct cmd_proc_snap_take_packet *)packet->data;
+
+    if (!tp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    tp->name[SNAP_NAME_LENGTH - 1] = 0;
+
+    if (!snap_valid_name(tp->name, 0)) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    if (tp->count > SNAP_MAX_REGIONS) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    memset(&cache, NULL, sizeof(cache));
+    count = tp->count;
+
+    if (count) {
+        ranges = (struct cmd_proc_snap_range *)pool_alloc(fd, count * CMD_PROC_SNAP_RANGE_SIZE);
+        if (!ranges) {
+            net_send_status(fd, CMD_DATA_NULL);
+            return 1;
+        }
+
+        if (net_recv_data(fd, ranges, count * CMD_PROC_SNAP_RANGE_SIZE, 1) != (int)(count * CMD_PROC_SNAP_RANGE_SIZE)) {
+            pool_free(fd, ranges);
+            return 1;
+        }
+
+        // empty ranges and ranges wrapping around the address space are never readable
+        for (uint32_t i = 0; i < count; i++) {
+            if (!ranges[i].length || ranges[i].address + ranges[i].length < ranges[i].address) {
+                pool_free(fd, ranges);
+                net_send_status(fd, CMD_INVALID_INDEX);
+                return 0;
+            }
+        }
+    }
+    else {
+        ranges = NULL;
+
+        if (proc_get_vm_map(tp->pid, &cache.maps, &cache.num)) {
+            net_send_status(fd, CMD_ERROR);
+            return 0;
+        }
+
+        cache.loaded = 1;
+
+        for (uint64_t i = 0; i < cache.num; i++) {
+            if ((cache.maps[i].prot & PROT_READ) == PROT_READ) {
+                count++;
+            }
+        }
+
+        if (!count || count > SNAP_MAX_REGIONS) {
+            proc_vm_map_cache_free(&cache);
+            net_send_status(fd, count ? CMD_TOO_MUCH_DATA : CMD_ERROR);
+            return 0;
+        }
+    }
+
+    scePthreadMutexLock(&snap_mutex);
+
+    // taking a snapshot again under the same name replaces it, unless a diff is still reading it
+    memset(&old, NULL, sizeof(old));
+    snap = snap_find(tp->name);
+    if (snap) {
+        if (snap->taking || snap->refs) {
+            scePthreadMutexUnlock(&snap_mutex);
+
+            pool_free(fd, ranges);
+            proc_vm_map_cache_free(&cache);
+
+            net_send_status(fd, CMD_ERROR);
+            return 0;
+        }
+
+        old = *snap;
+        memset(snap, NULL, sizeof(struct snapshot));
+    }
+    else {
+        for (int i = 0; i < SNAP_MAX; i++) {
+            if (!snaps[i].name[0]) {
+                snap = &snaps[i];
+                break;
+            }
+        }
+    }
+
+    // the slot only holds the name while the capture runs outside the lock
+    if (snap) {
+        strcpy(snap->name, tp->name);
+        snap->taking = 1;
+    }
+
+    scePthreadMutexUnlock(&snap_mutex);
+
+    if (old.name[0]) {
+        snap_free(&old);
+    }
+
+    memset(&taken, NULL, sizeof(taken));
+
+    error = CMD_INVALID_INDEX;
+    if (!snap) {
+        goto fail;
+    }
+
+    error = CMD_DATA_NULL;
+    taken.regions = (struct snap_region *)malloc(count * sizeof(struct snap_region));
+    if (!taken.regions) {
+        goto fail;
+    }
+
+    strcpy(taken.name, tp->name);
+    taken.pid = tp->pid;
+
+    limit = (tp->flags & SNAP_FLAG_MEMORY) ? SNAP_MAX_MEMORY : (uint64_t)-1;
+
+    for (uint64_t i = 0; taken.count < count; i++) {
+        struct snap_region *region = &taken.regions[taken.count];
+
+        if (ranges) {
+            region->address = ranges[i].address;
+            region->length = ranges[i].length;
+        }
+        else {
+            if ((cache.maps[i].prot & PROT_READ) != PROT_READ) {
+                continue;
+            }
+
+            region->address = cache.maps[i].start;
+            region->length = cache.maps[i].end - cache.maps[i].start;
+        }
+
+        // checked before the sum so that it cannot wrap past the limit
+        error = CMD_TOO_MUCH_DATA;
+        if (region->length > limit - taken.size) {
+            goto fail;
+        }
+
+        region->offset = taken.size;
+        region->fileId = taken.count;
+        taken.size += region->length;
+        taken.count++;
+    }
+
+    if (tp->flags & SNAP_FLAG_MEMORY) {
+        error = CMD_DATA_NULL;
+        taken.data = (uint8_t *)malloc(taken.size);
+        if (!taken.data) {
+            goto fail;
+        }
+    }
+    else {
+        snprintf(taken.dir, sizeof(taken.dir), "%s/%s", SNAP_DIR, taken.name);
+        mkdir(taken.dir, 0777);
+    }
+
+    error = CMD_DATA_NULL;
+    buffer = (uint8_t *)pool_alloc(fd, SNAP_CHUNK);
+    if (!buffer) {
+        goto fail;
+    }
+
+    error = CMD_ERROR;
+    for (uint32_t i = 0; i < taken.count; i++) {
+        if (snap_take_region(fd, &taken, i, buffer, &cache)) {
+            pool_free(fd, buffer);
+            goto fail;
+        }
+    }
+
+    pool_free(fd, buffer);
+
+    resp.regions = taken.count;
+    resp.size = taken.size;
+
+    scePthreadMutexLock(&snap_mutex);
+    *snap = taken;
+    scePthreadMutexUnlock(&snap_mutex);
+
+    pool_free(fd, ranges);
+    proc_vm_map_cache_free(&cache);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_SNAP_TAKE_RESPONSE_SIZE);
+
+    return 0;
+
+fail:
+    snap_free(&taken);
+
+    if (snap) {
+        scePthreadMutexLock(&snap_mutex);
+        memset(snap, NULL, sizeof(struct snapshot));
+        scePthreadMutexUnlock(&snap_mutex);
+    }
+
+    pool_free(fd, ranges);
+    proc_vm_map_cache_free(&cache);
+
+    net_send_status(fd, error);
+
+    return 0;
+}
+
+// batches records and sends them behind their count
+struct snap_batch {
+    uint8_t *records;
+    uint32_t size;
+    uint32_t count;
+    uint32_t max;
+};
+
+int snap_batch_flush(int fd, struct snap_batch *batch) {
+    struct iovec iov[2];
+
+    if (!batch->count) {
+        return 0;
+    }
+
+    iov[0].iov_base = &batch->count;
+    iov[0].iov_len = sizeof(uint32_t);
+    iov[1].iov_base = batch->records;
+    iov[1].iov_len = batch->count * batch->size;
+
+    batch->count = 0;
+
+    return net_send_datav(fd, iov, 2) < 0;
+}
+
+int snap_batch_add(int fd, struct snap_batch *batch, void *record) {
+    memcpy(batch->records + batch->count * batch->size, record, batch->size);
+
+    if (++batch->count == batch->max) {
+        return snap_batch_flush(fd, batch);
+    }
+
+    return 0;
+}
+
+// byte ranges that differ, ranges less than a word apart are merged into one
+int snap_diff_raw(int fd, struct snap_batch *batch, struct snap_diff_range *pending, uint64_t address, uint8_t *a, uint8_t *b, uint32_t length) {
+    for (uint32_t j = 0; j < length; j += sizeof(uint64_t)) {
+        uint32_t n = length - j < sizeof(uint64_t) ? length - j : sizeof(uint64_t);
+        uint32_t first;
+        uint32_t last;
+
+        if (n == sizeof(uint64_t) && *(uint64_t *)(a + j) == *(uint64_t *)(b + j)) {
+            continue;
+        }
+
+        for (first = 0; first < n && a[j + first] == b[j + first]; first++);
+        if (first == n) {
+            continue;
+        }
+
+        for (last = n; a[j + last - 1] == b[j + last - 1]; last--);
+
+        uint64_t start = address + j + first;
+        uint64_t end = address + j + last;
+
+        if (pending->length && start - (pending->address + pending->length) < sizeof(uint64_t)) {
+            pending->length = end - pending->address;
+            continue;
+        }
+
+        if (pending->length && snap_batch_add(fd, batch, pending)) {
+            return 1;
+        }
+
+        pending->address = start;
+        pending->length = end - start;
+    }
+
+    return 0;
+}
+
+int snap_diff_typed(int fd, struct snap_batch *batch, struct cmd_proc_snap_diff_packet *dp, size_t valueLength, uint64_t address, uint8_t *a, uint8_t *b, uint32_t length) {
+    struct snap_diff_value value;
+
+    for (uint32_t j = 0; j + valueLength <= length; j += valueLength) {
+        if (!proc_scan_compareValues(dp->compareType, dp->valueType, valueLength, a + j, b + j, dp->extra)) {
+            continue;
+        }
+
+        memset(&value, NULL, sizeof(value));
+        value.address = address + j;
+        memcpy(value.old, a + j, valueLength);
+        memcpy(value.new, b + j, valueLength);
+
+        if (snap_batch_add(fd, batch, &value)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// unpins a snapshot, or frees the regions of one loaded from the scanner and lets the scanner run again
+void snap_diff_release(struct snapshot *snap, struct snapshot *scanSnap, int scan) {
+    if (snap && snap != scanSnap) {
+        snap_put(snap);
+    }
+
+    if (scanSnap->regions) {
+        free(scanSnap->regions);
+    }
+
+    if (scan) {
+        scePthreadMutexUnlock(&scan_mutex);
+    }
+}
+
+int snap_diff_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_snap_diff_packet *dp;
+    struct snapshot scanA;
+    struct snapshot scanB;
+    struct snapshot *a;
+    struct snapshot *b;
+    struct snap_reader readerA;
+    struct snap_reader readerB;
+    struct snap_diff_range pending;
+    struct snap_batch batch;
+    struct proc_vm_map_cache cache;
+    uint8_t *dataA;
+    uint8_t *dataB;
+    size_t valueLength;
+    uint32_t chunk;
+    uint32_t end;
+    uint32_t error;
+    int scan;
+
+    dp = (struct cmd_proc_snap_diff_packet *)packet->data;
+
+    if (!dp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    dp->a[SNAP_NAME_LENGTH - 1] = 0;
+    dp->b[SNAP_NAME_LENGTH - 1] = 0;
+
+    // typed diffs only make sense for the comparisons against a previous value
+    valueLength = 0;
+    if (dp->valueType != SNAP_DIFF_RAW) {
+        valueLength = proc_scan_getSizeOfValueType(dp->valueType);
+
+        switch (dp->compareType) {
+        case cmpTypeIncreasedValue:
+        case cmpTypeIncreasedValueBy:
+        case cmpTypeDecreasedValue:
+        case cmpTypeDecreasedValueBy:
+        case cmpTypeChangedValue:
+        case cmpTypeUnchangedValue:
+            break;
+        default:
+            valueLength = 0;
+            break;
+        }
+
+        if (!valueLength) {
+            net_send_status(fd, CMD_INVALID_INDEX);
+            return 0;
+        }
+    }
+
+    if (!snap_valid_name(dp->a, 1) || (dp->b[0] && !snap_valid_name(dp->b, 1))) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    // the scanner replaces its section list and files while it runs, so it waits for the diff
+    scan = dp->a[0] == SNAP_SCAN_PREFIX || dp->b[0] == SNAP_SCAN_PREFIX;
+    if (scan) {
+        scePthreadMutexLock(&scan_mutex);
+    }
+
+    memset(&scanA, NULL, sizeof(scanA));
+    memset(&scanB, NULL, sizeof(scanB));
+
+    a = dp->a[0] == SNAP_SCAN_PREFIX ? (snap_load_scan(dp->a, &scanA) ? NULL : &scanA) : snap_get(dp->a);
+    b = NULL;
+    if (dp->b[0]) {
+        b = dp->b[0] == SNAP_SCAN_PREFIX ? (snap_load_scan(dp->b, &scanB) ? NULL : &scanB) : snap_get(dp->b);
+    }
+
+    error = CMD_INVALID_INDEX;
+    if (!a || (dp->b[0] && !b)) {
+        goto fail;
+    }
+
+    // snapshots are compared region by region, so they have to cover the same ranges
+    if (b) {
+        if (a->count != b->count) {
+            goto fail;
+        }
+
+        for (uint32_t i = 0; i < a->count; i++) {
+            if (a->regions[i].address != b->regions[i].address || a->regions[i].length != b->regions[i].length) {
+                goto fail;
+            }
+        }
+    }
+
+    error = CMD_DATA_NULL;
+    batch.size = valueLength ? SNAP_DIFF_VALUE_SIZE : SNAP_DIFF_RANGE_SIZE;
+    batch.max = SNAP_BATCH / batch.size;
+    batch.count = 0;
+    batch.records = (uint8_t *)pool_alloc(fd, batch.max * batch.size);
+    dataA = (uint8_t *)pool_alloc(fd, SNAP_CHUNK);
+    dataB = (uint8_t *)pool_alloc(fd, SNAP_CHUNK);
+    if (!batch.records || !dataA || !dataB) {
+        pool_free(fd, batch.records);
+        pool_free(fd, dataA);
+        pool_free(fd, dataB);
+        goto fail;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    memset(&cache, NULL, sizeof(cache));
+    snap_reader_init(&readerA, a, a->pid, NULL);
+    snap_reader_init(&readerB, b, b ? b->pid : dp->pid, &cache);
+    memset(&pending, NULL, sizeof(pending));
+
+    for (uint32_t i = 0; i < a->count; i++) {
+        struct snap_region *region = &a->regions[i];
+
+        for (uint64_t offset = 0; offset < region->length; offset += chunk) {
+            if (net_cancelled(fd)) {
+                goto done;
+            }
+
+            qos_quantum(fd);
+
+            chunk = region->length - offset > SNAP_CHUNK ? SNAP_CHUNK : region->length - offset;
+
+            snap_read(&readerA, i, region->address + offset, offset, dataA, chunk);
+            snap_read(&readerB, i, region->address + offset, offset, dataB, chunk);
+
+            if (valueLength) {
+                if (snap_diff_typed(fd, &batch, dp, valueLength, region->address + offset, dataA, dataB, chunk)) {
+                    goto done;
+                }
+            }
+            else if (snap_diff_raw(fd, &batch, &pending, region->address + offset, dataA, dataB, chunk)) {
+                goto done;
+            }
+        }
+    }
+
+    if (!pending.length || !snap_batch_add(fd, &batch, &pending)) {
+        snap_batch_flush(fd, &batch);
+    }
+
+done:
+    end = 0;
+    net_send_data(fd, &end, sizeof(uint32_t));
+
+    snap_reader_close(&readerA);
+    snap_reader_close(&readerB);
+    proc_vm_map_cache_free(&cache);
+
+    pool_free(fd, batch.records);
+    pool_free(fd, dataA);
+    pool_free(fd, dataB);
+
+    snap_diff_release(b, &scanB, 0);
+    snap_diff_release(a, &scanA, scan);
+
+    return 0;
+
+fail:
+    snap_diff_release(b, &scanB, 0);
+    snap_diff_release(a, &scanA, scan);
+
+    net_send_status(fd, error);
+
+    return 0;
+}
+
+int snap_delete_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_snap_delete_packet *dp;
+    struct snapshot *snap;
+    struct snapshot old;
+    uint32_t status;
+
+    dp = (struct cmd_proc_snap_delete_packet *)packet->data;
+
+    if (!dp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    dp->name[SNAP_NAME_LENGTH - 1] = 0;
+    status = CMD_INVALID_INDEX;
+
+    memset(&old, NULL, sizeof(old));
+
+    scePthreadMutexLock(&snap_mutex);
+
+    // a snapshot still being taken or read by a diff stays
+    snap = snap_find(dp->name);
+    if (snap && (snap->taking || snap->refs)) {
+        status = CMD_ERROR;
+    }
+    else if (snap) {
+        old = *snap;
+        memset(snap, NULL, sizeof(struct snapshot));
+        status = CMD_SUCCESS;
+    }
+
+    scePthreadMutexUnlock(&snap_mutex);
+
+    if (old.name[0]) {
+        snap_free(&old);
+    }
+
+    net_send_status(fd, status);
+    return 0;
+}
@@ -0,0 +1,519 @@
+#include "state.h"
+#include "server.h"
+
+ScePthreadMutex state_mutex;
+
+void state_init() {
+    scePthreadMutexInit(&state_mutex, NULL, "statemutex");
+    mkdir("/data/frame4", 0777);
+    mkdir(STATE_DIR, 0777);
+}
+
+// only a process this suspends is resumed, one that was already stopped stays stopped
+struct state_suspend {
+    uint32_t pid;
+    int how;
+};
+
+// ki_stat of the kinfo_proc kern.proc.pid returns, laid out like FreeBSD 9
+int state_proc_stopped(uint32_t pid) {
+    uint8_t info[STATE_KINFO_SIZE];
+    size_t len;
+    int mib[4];
+
+    mib[0] = 1;  // CTL_KERN
+    mib[1] = 14; // KERN_PROC
+    mib[2] = 1;  // KERN_PROC_PID
+    mib[3] = pid;
+
+    len = sizeof(info);
+    memset(info, NULL, sizeof(info));
+    if (syscall(202, mib, 4, info, &len, NULL, 0) || len <= STATE_KINFO_STAT) {
+        return 0;
+    }
+
+    return info[STATE_KINFO_STAT] == STATE_SSTOP;
+}
+
+// an attached process ignores a plain SIGSTOP until the debugger's wait passes it on, so it is
+// stopped the way the debugger stops it and waited for until ptrace requests stop failing with EBUSY
+int state_suspend_traced(struct state_suspend *suspend, int fd) {
+    uint64_t start;
+
+    if (ptrace(PT_GETNUMLWPS, suspend->pid, NULL, 0) != -1) {
+        return 0;
+    }
+
+    if (errno != EBUSY) {
+        return 1;
+    }
+
+    syscall(37, suspend->pid, SIGSTOP);
+
+    start = sceKernelGetProcessTime();
+    while (ptrace(PT_GETNUMLWPS, suspend->pid, NULL, 0) == -1) {
+        if (errno != EBUSY || sceKernelGetProcessTime() - start > STATE_STOP_WAIT) {
+            return 1;
+        }
+
+        // nobody else waits for the process while its own debugger client runs this command
+        if (find_client(fd) == curdbgcli && check_debug_interrupt()) {
+            return 1;
+        }
+
+        sceKernelUsleep(1000);
+    }
+
+    suspend->how = STATE_SUSPEND_TRACE;
+
+    return 0;
+}
+
+int state_suspend(struct state_suspend *suspend, uint32_t pid, int fd) {
+    memset(suspend, NULL, sizeof(struct state_suspend));
+    suspend->pid = pid;
+
+    if (g_debugging && curdbgctx && curdbgctx->pid == pid) {
+        return state_suspend_traced(suspend, fd);
+    }
+
+    if (!state_proc_stopped(pid)) {
+        syscall(37, pid, SIGSTOP);
+        suspend->how = STATE_SUSPEND_SIGNAL;
+    }
+
+    return 0;
+}
+
+void state_resume(struct state_suspend *suspend) {
+    if (suspend->how == STATE_SUSPEND_SIGNAL) {
+        syscall(37, suspend->pid, SIGCONT);
+    }
+    else if (suspend->how == STATE_SUSPEND_TRACE) {
+        // continuing without a signal also drops the SIGSTOP that stopped it
+        ptrace(PT_CONTINUE, suspend->pid, (void *)1, 0);
+    }
+
+    memset(suspend, NULL, sizeof(struct state_suspend));
+}
+
+void state_hash_pages(uint8_t *data, uint32_t length, uint64_t *hashes) {
+    for (uint32_t offset = 0; offset < length; offset += STATE_PAGE) {
+        hashes[offset / STATE_PAGE] = xxh64(data + offset, length - offset < STATE_PAGE ? length - offset : STATE_PAGE, 0);
+    }
+}
+
+int state_save_region(int fd, int file, uint32_t pid, struct state_region *region, uint8_t *buffer, struct proc_vm_map_cache *cache) {
+    uint64_t hashes[STATE_CHUNK / STATE_PAGE];
+    uint64_t offset;
+    uint32_t chunk;
+    uint32_t pages;
+
+    for (offset = 0; offset < region->length; offset += chunk) {
+        if (net_cancelled(fd)) {
+            return 1;
+        }
+
+        qos_quantum(fd);
+
+        chunk = region->length - offset > STATE_CHUNK ? STATE_CHUNK : region->length - offset;
+        pages = (chunk + STATE_PAGE - 1) / STATE_PAGE;
+
+        proc_read_valid(pid, region->address + offset, buffer, chunk, cache, NULL, NULL);
+        state_hash_pages(buffer, chunk, hashes);
+
+        lseek(file, region->data + offset, SEEK_SET);
+        if (write(file, buffer, chunk) != (int)chunk) {
+            return 1;
+        }
+
+        lseek(file, region->hashes + offset / STATE_PAGE * sizeof(uint64_t), SEEK_SET);
+        if (write(file, hashes, pages * sizeof(uint64_t)) != (int)(pages * sizeof(uint64_t))) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int state_save_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_state_save_packet *sp;
+    struct cmd_proc_state_save_response resp;
+    struct proc_vm_map_cache cache;
+    struct state_header header;
+    struct state_region *regions;
+    uint64_t hashes;
+    uint64_t data;
+    uint8_t *buffer;
+    char path[96];
+    char temp[100];
+    uint32_t count;
+    int file;
+    uint32_t error;
+
+    sp = (struct cmd_proc_state_save_packet *)packet->data;
+
+    if (!sp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    sp->name[STATE_NAME_LENGTH - 1] = 0;
+
+    if (!snap_valid_name(sp->name, 0)) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(&cache, NULL, sizeof(cache));
+    if (proc_get_vm_map(sp->pid, &cache.maps, &cache.num)) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    cache.loaded = 1;
+
+    count = 0;
+    for (uint64_t i = 0; i < cache.num; i++) {
+        if ((cache.maps[i].prot & (PROT_READ | PROT_WRITE)) == (PROT_READ | PROT_WRITE)) {
+            count++;
+        }
+    }
+
+    if (!count || count > STATE_MAX_REGIONS) {
+        proc_vm_map_cache_free(&cache);
+        net_send_status(fd, count ? CMD_TOO_MUCH_DATA : CMD_ERROR);
+        return 0;
+    }
+
+    regions = (struct state_region *)malloc(count * sizeof(struct state_region));
+    buffer = (uint8_t *)pool_alloc(fd, STATE_CHUNK);
+    if (!regions || !buffer) {
+        if (regions) {
+            free(regions);
+        }
+
+        pool_free(fd, buffer);
+        proc_vm_map_cache_free(&cache);
+        net_send_status(fd, CMD_DATA_NULL);
+        return 0;
+    }
+
+    // all hashes go in front of the data, so a restore reads them without seeking through the data
+    memset(&header, NULL, sizeof(header));
+    hashes = sizeof(struct state_header) + count * sizeof(struct state_region);
+    data = hashes;
+    for (uint64_t i = 0; i < cache.num; i++) {
+        if ((cache.maps[i].prot & (PROT_READ | PROT_WRITE)) == (PROT_READ | PROT_WRITE)) {
+            data += (cache.maps[i].end - cache.maps[i].start + STATE_PAGE - 1) / STATE_PAGE * sizeof(uint64_t);
+        }
+    }
+
+    for (uint64_t i = 0; i < cache.num; i++) {
+        struct state_region *region = &regions[header.count];
+
+        if ((cache.maps[i].prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE)) {
+            continue;
+        }
+
+        memcpy(region->name, cache.maps[i].name, sizeof(region->name));
+        region->address = cache.maps[i].start;
+        region->length = cache.maps[i].end - cache.maps[i].start;
+        region->hashes = hashes;
+        region->data = data;
+
+        hashes += (region->length + STATE_PAGE - 1) / STATE_PAGE * sizeof(uint64_t);
+        data += region->length;
+        header.size += region->length;
+        header.count++;
+    }
+
+    scePthreadMutexLock(&state_mutex);
+
+    // written next to the old save and renamed over it once complete, so a failed save keeps it
+    error = CMD_ERROR;
+    snprintf(path, sizeof(path), "%s/%s", STATE_DIR, sp->name);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    if ((file = open(temp, O_CREAT | O_RDWR | O_TRUNC, 0777)) < 0) {
+        goto finish;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (state_save_region(fd, file, sp->pid, &regions[i], buffer, &cache)) {
+            goto finish;
+        }
+    }
+
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.pid = sp->pid;
+
+    lseek(file, sizeof(struct state_header), SEEK_SET);
+    if (write(file, regions, header.count * sizeof(struct state_region)) != (int)(header.count * sizeof(struct state_region))) {
+        goto finish;
+    }
+
+    lseek(file, 0, SEEK_SET);
+    if (write(file, &header, sizeof(struct state_header)) != sizeof(struct state_header)) {
+        goto finish;
+    }
+
+    close(file);
+    file = -1;
+
+    if (!rename(temp, path)) {
+        error = CMD_SUCCESS;
+    }
+
+finish:
+    if (file >= 0) {
+        close(file);
+    }
+
+    if (error != CMD_SUCCESS) {
+        unlink(temp);
+    }
+
+    scePthreadMutexUnlock(&state_mutex);
+
+    resp.regions = header.count;
+    resp.size = header.size;
+
+    free(regions);
+    pool_free(fd, buffer);
+    proc_vm_map_cache_free(&cache);
+
+    if (error != CMD_SUCCESS) {
+        net_send_status(fd, error);
+        return 0;
+    }
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_STATE_SAVE_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int state_region_mapped(struct proc_vm_map_cache *cache, struct state_region *region) {
+    for (uint64_t i = 0; i < cache->num; i++) {
+        if (cache->maps[i].start <= region->address && region->address + region->length <= cache->maps[i].end) {
+            return (cache->maps[i].prot & PROT_WRITE) == PROT_WRITE;
+        }
+    }
+
+    return 0;
+}
+
+// only runs of pages whose hash differs from the saved one are read back and written, one write per run
+int state_restore_region(int fd, int file, uint32_t pid, struct state_region *region, int force, uint8_t *current, uint8_t *saved, struct proc_vm_map_cache *cache, struct cmd_proc_state_restore_response *resp) {
+    uint64_t hashes[STATE_CHUNK / STATE_PAGE];
+    uint64_t now[STATE_CHUNK / STATE_PAGE];
+    uint64_t offset;
+    uint32_t chunk;
+    uint32_t pages;
+    uint32_t first;
+    uint32_t last;
+
+    // no qos quantum here, the process stays stopped until the restore is done
+    for (offset = 0; offset < region->length; offset += chunk) {
+        if (net_cancelled(fd)) {
+            return 1;
+        }
+
+        chunk = region->length - offset > STATE_CHUNK ? STATE_CHUNK : region->length - offset;
+        pages = (chunk + STATE_PAGE - 1) / STATE_PAGE;
+
+        lseek(file, region->hashes + offset / STATE_PAGE * sizeof(uint64_t), SEEK_SET);
+        if (read(file, hashes, pages * sizeof(uint64_t)) != (int)(pages * sizeof(uint64_t))) {
+            return 1;
+        }
+
+        if (!force) {
+            proc_read_valid(pid, region->address + offset, current, chunk, cache, NULL, NULL);
+            state_hash_pages(current, chunk, now);
+        }
+
+        resp->pages += pages;
+
+        for (first = 0; first < pages; first = last) {
+            if (!force && now[first] == hashes[first]) {
+                last = first + 1;
+                continue;
+            }
+
+            for (last = first + 1; last < pages && (force || now[last] != hashes[last]); last++);
+
+            uint64_t start = (uint64_t)first * STATE_PAGE;
+            uint64_t length = ((uint64_t)last * STATE_PAGE > chunk ? chunk : (uint64_t)last * STATE_PAGE) - start;
+
+            lseek(file, region->data + offset + start, SEEK_SET);
+            if (read(file, saved, length) != (int)length) {
+                return 1;
+            }
+
+            sys_proc_rw(pid, region->address + offset + start, saved, length, 1);
+            resp->written += last - first;
+        }
+    }
+
+    return 0;
+}
+
+int state_restore_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_state_restore_packet *rp;
+    struct cmd_proc_state_restore_response resp;
+    struct proc_vm_map_cache cache;
+    struct state_suspend suspend;
+    struct state_header header;
+    struct state_region *regions;
+    uint8_t *current;
+    uint8_t *saved;
+    uint64_t start;
+    char path[96];
+    int file;
+    uint32_t error;
+
+    rp = (struct cmd_proc_state_restore_packet *)packet->data;
+
+    if (!rp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    rp->name[STATE_NAME_LENGTH - 1] = 0;
+    rp->filter[sizeof(rp->filter) - 1] = 0;
+
+    if (!snap_valid_name(rp->name, 0)) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(&resp, NULL, sizeof(resp));
+    memset(&cache, NULL, sizeof(cache));
+    regions = NULL;
+    current = NULL;
+    saved = NULL;
+
+    scePthreadMutexLock(&state_mutex);
+
+    error = CMD_INVALID_INDEX;
+    snprintf(path, sizeof(path), "%s/%s", STATE_DIR, rp->name);
+    if ((file = open(path, O_RDONLY, 0)) < 0) {
+        goto finish;
+    }
+
+    error = CMD_ERROR;
+    if (read(file, &header, sizeof(struct state_header)) != sizeof(struct state_header) || header.magic != STATE_MAGIC || header.version != STATE_VERSION || header.count > STATE_MAX_REGIONS) {
+        goto finish;
+    }
+
+    error = CMD_DATA_NULL;
+    regions = (struct state_region *)malloc(header.count * sizeof(struct state_region));
+    current = (uint8_t *)pool_alloc(fd, STATE_CHUNK);
+    saved = (uint8_t *)pool_alloc(fd, STATE_CHUNK);
+    if (!regions || !current || !saved) {
+        goto finish;
+    }
+
+    error = CMD_ERROR;
+    if (read(file, regions, header.count * sizeof(struct state_region)) != (int)(header.count * sizeof(struct state_region))) {
+        goto finish;
+    }
+
+    // the process may have remapped since the save, such regions are skipped
+    if (proc_get_vm_map(rp->pid, &cache.maps, &cache.num)) {
+        goto finish;
+    }
+
+    cache.loaded = 1;
+
+    if (!(rp->flags & STATE_FLAG_RUNNING) && state_suspend(&suspend, rp->pid, fd)) {
+        goto finish;
+    }
+
+    start = sceKernelGetProcessTime();
+    error = CMD_SUCCESS;
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        struct state_region *region = &regions[i];
+
+        region->name[sizeof(region->name) - 1] = 0;
+        if (rp->filter[0] && !strstr(region->name, rp->filter)) {
+            continue;
+        }
+
+        if (region->address + region->length <= rp->start || (rp->end && region->address >= rp->end)) {
+            continue;
+        }
+
+        if (!state_region_mapped(&cache, region)) {
+            resp.skipped++;
+            continue;
+        }
+
+        if (state_restore_region(fd, file, rp->pid, region, rp->flags & STATE_FLAG_FORCE, current, saved, &cache, &resp)) {
+            error = CMD_ERROR;
+            break;
+        }
+
+        resp.regions++;
+    }
+
+    resp.time = sceKernelGetProcessTime() - start;
+
+    if (!(rp->flags & STATE_FLAG_RUNNING)) {
+        state_resume(&suspend);
+    }
+
+finish:
+    if (file >= 0) {
+        close(file);
+    }
+
+    scePthreadMutexUnlock(&state_mutex);
+
+    if (regions) {
+        free(regions);
+    }
+
+    pool_free(fd, current);
+    pool_free(fd, saved);
+    proc_vm_map_cache_free(&cache);
+
+    if (error != CMD_SUCCESS) {
+        net_send_status(fd, error);
+        return 0;
+    }
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_STATE_RESTORE_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int state_delete_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_state_delete_packet *dp;
+    char path[96];
+    uint32_t status;
+
+    dp = (struct cmd_proc_state_delete_packet *)packet->data;
+
+    if (!dp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    dp->name[STATE_NAME_LENGTH - 1] = 0;
+    status = CMD_INVALID_INDEX;
+
+    if (snap_valid_name(dp->name, 0)) {
+        snprintf(path, sizeof(path), "%s/%s", STATE_DIR, dp->name);
+
+        scePthreadMutexLock(&state_mutex);
+        if (!unlink(path)) {
+            status = CMD_SUCCESS;
+        }
+        scePthreadMutexUnlock(&state_mutex);
+    }
+
+    net_send_status(fd, status);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "stats.h"
+#include "server.h"
+
+uint64_t stats_counters[STATS_COUNTERS];
+struct stats_command stats_table[STATS_MAX_COMMANDS];
+ScePthreadMutex stats_mutex;
+uint64_t stats_start;
+
+void stats_init() {
+    memset(stats_counters, NULL, sizeof(stats_counters));
+    memset(stats_table, NULL, sizeof(stats_table));
+    scePthreadMutexInit(&stats_mutex, NULL, "statsmutex");
+    stats_start = sceKernelGetProcessTime();
+}
+
+// log-linear like an HDR histogram, the top STATS_SUB_BITS below the leading bit pick the sub bucket
+uint32_t stats_bucket(uint64_t v) {
+    uint32_t e;
+    uint32_t b;
+
+    if (v < STATS_SUB_BUCKETS) {
+        return v;
+    }
+
+    e = 63 - __builtin_clzll(v);
+    b = (e - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + ((v >> (e - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1));
+
+    return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+uint64_t stats_bucket_low(uint32_t bucket) {
+    if (bucket < STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    return (uint64_t)(STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << (bucket / STATS_SUB_BUCKETS - 1);
+}
+
+// the command space is sparse, so commands get a slot the first time they run
+struct stats_command *stats_find(uint32_t cmd) {
+    uint32_t h;
+
+    h = (cmd * 2654435761u) % STATS_MAX_COMMANDS;
+
+    for (uint32_t i = 0; i < STATS_MAX_COMMANDS; i++) {
+        struct stats_command *s = &stats_table[(h + i) % STATS_MAX_COMMANDS];
+
+        if (s->cmd == cmd) {
+            return s;
+        }
+
+        if (!s->cmd) {
+            s->cmd = cmd;
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+void stats_command(uint32_t cmd, uint64_t elapsed) {
+    struct stats_command *s;
+
+    scePthreadMutexLock(&stats_mutex);
+
+    s = stats_find(cmd);
+    if (s) {
+        s->count++;
+        s->total += elapsed;
+        if (elapsed > s->max) {
+            s->max = elapsed;
+        }
+
+        s->buckets[stats_bucket(elapsed)]++;
+    }
+
+    scePthreadMutexUnlock(&stats_mutex);
+}
+
+uint64_t stats_uptime() {
+    return sceKernelGetProcessTime() - stats_start;
+}
+
+// copies every command that ran at least once
+uint32_t stats_commands(struct stats_command *out, uint32_t max) {
+    uint32_t count;
+
+    count = 0;
+
+    scePthreadMutexLock(&stats_mutex);
+    for (int i = 0; i < STATS_MAX_COMMANDS && count < max; i++) {
+        if (stats_table[i].cmd) {
+            memcpy(&out[count++], &stats_table[i], sizeof(struct stats_command));
+        }
+    }
+    scePthreadMutexUnlock(&stats_mutex);
+
+    return count;
+}
+
+int stats_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_server_stats_response resp;
+    struct stats_command *commands;
+
+    commands = (struct stats_command *)pool_alloc(fd, STATS_MAX_COMMANDS * STATS_COMMAND_SIZE);
+    if (!commands) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    resp.uptime = stats_uptime();
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        resp.counters[i] = stats_counters[i];
+    }
+    resp.buckets = STATS_BUCKETS;
+    resp.commands = stats_commands(commands, STATS_MAX_COMMANDS);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_SERVER_STATS_RESPONSE_SIZE);
+    net_send_data(fd, commands, resp.commands * STATS_COMMAND_SIZE);
+
+    pool_free(fd, commands);
+
+    return 0;
+}
@@ -0,0 +1,382 @@
+#include "sub.h"
+#include "server.h"
+
+struct subscription subs[SUB_MAX];
+struct sub_queue sub_queues[SERVER_MAXCLIENTS];
+uint8_t sub_out[SUB_QUEUE_SIZE];
+ScePthreadMutex sub_mutex;
+int sub_thread_running;
+int sub_sending;        // push socket the sampler is writing to without sub_mutex
+int sub_sending_orphan; // its client went away meanwhile, so the sampler closes it
+
+void sub_init() {
+    memset(subs, NULL, sizeof(subs));
+    memset(sub_queues, NULL, sizeof(sub_queues));
+    scePthreadMutexInit(&sub_mutex, NULL, "submutex");
+    sub_thread_running = 0;
+    sub_sending = 0;
+    sub_sending_orphan = 0;
+}
+
+struct sub_queue *sub_get_queue(struct server_client *svc) {
+    return &sub_queues[svc - servclients];
+}
+
+// connects the push socket of a client that has none yet
+// the connect runs without sub_mutex, a client that firewalls SUB_PORT must not stall the sampler
+int sub_connect(struct server_client *svc) {
+    struct sub_queue *queue;
+    struct sockaddr_in server;
+    int connected;
+    int fd;
+
+    queue = sub_get_queue(svc);
+
+    scePthreadMutexLock(&sub_mutex);
+    connected = queue->fd > 0;
+    scePthreadMutexUnlock(&sub_mutex);
+
+    if (connected) {
+        return 0;
+    }
+
+    server.sin_len = sizeof(server);
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = svc->client.sin_addr.s_addr;
+    server.sin_port = sceNetHtons(SUB_PORT);
+    memset(server.sin_zero, NULL, sizeof(server.sin_zero));
+
+    fd = sceNetSocket("subscription", AF_INET, SOCK_STREAM, 0);
+    if (fd <= 0) {
+        return 1;
+    }
+
+    if (sceNetConnect(fd, (struct sockaddr *)&server, sizeof(server))) {
+        sceNetSocketClose(fd);
+        return 1;
+    }
+
+    configure_socket(fd);
+    net_set_deadline(fd, SUB_DEADLINE);
+
+    scePthreadMutexLock(&sub_mutex);
+    if (queue->fd > 0) {
+        scePthreadMutexUnlock(&sub_mutex);
+        sceNetSocketClose(fd);
+        return 0;
+    }
+
+    queue->fd = fd;
+    queue->used = 0;
+    scePthreadMutexUnlock(&sub_mutex);
+
+    return 0;
+}
+
+// drops the subscriptions of a client and its push socket, called with sub_mutex held
+void sub_close(struct server_client *svc) {
+    struct sub_queue *queue;
+
+    for (int i = 0; i < SUB_MAX; i++) {
+        if (subs[i].id && subs[i].svc == svc) {
+            memset(&subs[i], NULL, sizeof(struct subscription));
+        }
+    }
+
+    queue = sub_get_queue(svc);
+    if (queue->fd > 0) {
+        // the sampler is still writing to it and closes it once it is done
+        if (queue->fd == sub_sending) {
+            sub_sending_orphan = 1;
+        }
+        else {
+            net_set_deadline(queue->fd, 0);
+            sceNetSocketClose(queue->fd);
+        }
+    }
+
+    queue->fd = 0;
+    queue->used = 0;
+}
+
+void sub_remove_client(struct server_client *svc) {
+    scePthreadMutexLock(&sub_mutex);
+    sub_close(svc);
+    scePthreadMutexUnlock(&sub_mutex);
+}
+
+// queues the subscription if its value changed since the last push, called with sub_mutex held
+void sub_push(struct subscription *sub, uint64_t timestamp) {
+    struct sub_queue *queue;
+    struct sub_push_packet push;
+    int state;
+
+    if (sub->path.failed) {
+        if (sub->state == SUB_STATE_FAILED) {
+            return;
+        }
+
+        state = SUB_STATE_FAILED;
+        push.length = 0;
+    }
+    else {
+        if (sub->state == SUB_STATE_VALUE && !memcmp(sub->value, sub->last, sub->path.length)) {
+            return;
+        }
+
+        state = SUB_STATE_VALUE;
+        push.length = sub->path.length;
+    }
+
+    // a full queue leaves the state alone, so the change goes out with a later sample
+    queue = sub_get_queue(sub->svc);
+    if (queue->fd <= 0 || SUB_PUSH_PACKET_SIZE + push.length > SUB_QUEUE_SIZE - queue->used) {
+        return;
+    }
+
+    sub->state = state;
+    memcpy(sub->last, sub->value, push.length);
+
+    push.id = sub->id;
+    push.timestamp = timestamp;
+    push.address = sub->path.resolved;
+
+    memcpy(queue->data + queue->used, &push, SUB_PUSH_PACKET_SIZE);
+    memcpy(queue->data + queue->used + SUB_PUSH_PACKET_SIZE, sub->value, push.length);
+    queue->used += SUB_PUSH_PACKET_SIZE + push.length;
+}
+
+// sends every queue without sub_mutex, the first failed send ends the client's subscriptions
+void sub_flush() {
+    struct sub_queue *queue;
+    uint32_t length;
+    int failed;
+    int fd;
+
+    for (int i = 0; i < SERVER_MAXCLIENTS; i++) {
+        queue = &sub_queues[i];
+
+        scePthreadMutexLock(&sub_mutex);
+
+        if (queue->fd <= 0 || !queue->used) {
+            scePthreadMutexUnlock(&sub_mutex);
+            continue;
+        }
+
+        fd = queue->fd;
+        length = queue->used;
+        memcpy(sub_out, queue->data, length);
+        queue->used = 0;
+        sub_sending = fd;
+
+        scePthreadMutexUnlock(&sub_mutex);
+
+        failed = net_send_data(fd, sub_out, length) < 0;
+
+        scePthreadMutexLock(&sub_mutex);
+
+        sub_sending = 0;
+        if (sub_sending_orphan) {
+            sub_sending_orphan = 0;
+            net_set_deadline(fd, 0);
+            sceNetSocketClose(fd);
+        }
+        else if (failed) {
+            sub_close(&servclients[i]);
+        }
+
+        scePthreadMutexUnlock(&sub_mutex);
+    }
+}
+
+void *sub_thread(void *arg) {
+    struct subscription *due[SUB_MAX];
+    struct subscription *batch[SUB_MAX];
+    struct proc_path *paths[SUB_MAX];
+    uint64_t now;
+    uint64_t next;
+    int active;
+    int count;
+    int num;
+
+    while (!unload_cmd_sent) {
+        scePthreadMutexLock(&sub_mutex);
+
+        now = sceKernelGetProcessTime();
+        next = now + SUB_IDLE_SLEEP;
+        active = 0;
+        count = 0;
+
+        for (int i = 0; i < SUB_MAX; i++) {
+            if (!subs[i].id) {
+                continue;
+            }
+
+            active++;
+
+            if (subs[i].due <= now) {
+                due[count++] = &subs[i];
+
+                // keep a steady clock but never burst to catch up
+                subs[i].due += subs[i].period;
+                if (subs[i].due <= now) {
+                    subs[i].due = now + subs[i].period;
+                }
+            }
+
+            if (subs[i].due < next) {
+                next = subs[i].due;
+            }
+        }
+
+        if (!active) {
+            sub_thread_running = 0;
+            scePthreadMutexUnlock(&sub_mutex);
+            trace_thread_exit();
+            break;
+        }
+
+        // coalesce the due subscriptions by process
+        for (int i = 0; i < count; i++) {
+            if (!due[i]) {
+                continue;
+            }
+
+            num = 0;
+            uint32_t pid = due[i]->pid;
+            for (int j = i; j < count; j++) {
+                if (due[j] && due[j]->pid == pid) {
+                    paths[num] = &due[j]->path;
+                    batch[num++] = due[j];
+                    due[j] = NULL;
+                }
+            }
+
+            proc_read_paths(pid, paths, num);
+
+            for (int j = 0; j < num; j++) {
+                sub_push(batch[j], now);
+            }
+        }
+
+        scePthreadMutexUnlock(&sub_mutex);
+
+        sub_flush();
+
+        now = sceKernelGetProcessTime();
+        if (next > now) {
+            sceKernelUsleep(next - now);
+        }
+    }
+
+    return NULL;
+}
+
+int sub_add_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_sub_add_packet *ap;
+    struct cmd_proc_sub_add_response resp;
+    struct server_client *svc;
+    struct subscription *sub;
+    int64_t offsets[PROC_PTR_MAX_DEPTH];
+    ScePthread thread;
+
+    ap = (struct cmd_proc_sub_add_packet *)packet->data;
+
+    if (!ap) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (!ap->length || ap->length > SUB_MAX_LENGTH || ap->depth > PROC_PTR_MAX_DEPTH) {
+        net_send_status(fd, CMD_TOO_MUCH_DATA);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    if (ap->depth && net_recv_data(fd, offsets, ap->depth * sizeof(int64_t), 1) != (int)(ap->depth * sizeof(int64_t))) {
+        return 1;
+    }
+
+    svc = find_client(fd);
+    if (!svc || sub_connect(svc)) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    scePthreadMutexLock(&sub_mutex);
+
+    // the sampler closes the push socket when a send fails, which may have happened since
+    if (sub_get_queue(svc)->fd <= 0) {
+        scePthreadMutexUnlock(&sub_mutex);
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    sub = NULL;
+    for (int i = 0; i < SUB_MAX; i++) {
+        if (!subs[i].id) {
+            sub = &subs[i];
+            break;
+        }
+    }
+
+    if (!sub) {
+        scePthreadMutexUnlock(&sub_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    memset(sub, NULL, sizeof(struct subscription));
+    sub->id = (sub - subs) + 1;
+    sub->svc = svc;
+    sub->pid = ap->pid;
+    sub->period = ap->period < SUB_MIN_PERIOD ? SUB_MIN_PERIOD : ap->period;
+    sub->path.address = ap->address;
+    sub->path.length = ap->length;
+    sub->path.depth = ap->depth;
+    sub->path.data = sub->value;
+    memcpy(sub->path.offsets, offsets, ap->depth * sizeof(int64_t));
+    sub->due = sceKernelGetProcessTime();
+
+    if (!sub_thread_running) {
+        sub_thread_running = 1;
+        scePthreadCreate(&thread, NULL, (void *)sub_thread, NULL, "sub_thread");
+    }
+
+    resp.id = sub->id;
+
+    scePthreadMutexUnlock(&sub_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_SUB_ADD_RESPONSE_SIZE);
+
+    return 0;
+}
+
+int sub_remove_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_sub_remove_packet *rp;
+    struct server_client *svc;
+    uint32_t status;
+
+    rp = (struct cmd_proc_sub_remove_packet *)packet->data;
+
+    if (!rp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    svc = find_client(fd);
+    status = CMD_INVALID_INDEX;
+
+    scePthreadMutexLock(&sub_mutex);
+
+    if (rp->id > 0 && rp->id <= SUB_MAX && subs[rp->id - 1].id == rp->id && subs[rp->id - 1].svc == svc) {
+        memset(&subs[rp->id - 1], NULL, sizeof(struct subscription));
+        status = CMD_SUCCESS;
+    }
+
+    scePthreadMutexUnlock(&sub_mutex);
+
+    net_send_status(fd, status);
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include "trace.h"
+#include "server.h"
+
+volatile int trace_enabled;
+struct trace_ring trace_rings[TRACE_MAX_THREADS];
+struct trace_event *trace_storage;
+uint64_t trace_since;
+
+const char *trace_names[TRACE_NAMES] = {
+    "command",
+    "proc_rw",
+    "net_send",
+    "net_wait",
+    "disk_read",
+    "disk_write",
+    "scan_section",
+    "dump_fill",
+    "compress"
+};
+
+void trace_init() {
+    memset(trace_rings, NULL, sizeof(trace_rings));
+    trace_storage = NULL;
+    trace_enabled = 0;
+    trace_since = 0;
+}
+
+struct trace_ring *trace_ring_self() {
+    ScePthread self = scePthreadSelf();
+
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (trace_rings[i].owner == self) {
+            return &trace_rings[i];
+        }
+    }
+
+    // threads claim a ring with their first event and keep it until they end
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (!trace_rings[i].owner && __sync_bool_compare_and_swap(&trace_rings[i].owner, NULL, self)) {
+            return &trace_rings[i];
+        }
+    }
+
+    return NULL;
+}
+
+void trace_event(uint16_t name, uint8_t phase, uint64_t arg) {
+    struct trace_ring *ring;
+    struct trace_event *event;
+
+    ring = trace_ring_self();
+    if (!ring) {
+        return;
+    }
+
+    event = &ring->events[ring->head % TRACE_RING_EVENTS];
+    event->timestamp = sceKernelGetProcessTime();
+    event->arg = arg;
+    event->name = name;
+    event->phase = phase;
+
+    // the event has to be complete before a reader can see the new head
+    __asm__ volatile("" ::: "memory");
+    ring->head++;
+}
+
+// threads that come and go give their ring back, what is in it stays until the next owner laps it
+void trace_thread_exit() {
+    ScePthread self = scePthreadSelf();
+
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (trace_rings[i].owner == self) {
+            trace_rings[i].owner = NULL;
+        }
+    }
+}
+
+// copies the events of a ring recorded since tracing started, oldest first
+uint32_t trace_copy(struct trace_ring *ring, struct trace_event *out) {
+    uint64_t head;
+    uint64_t tail;
+    uint64_t end;
+    uint32_t count;
+    uint32_t skip;
+
+    if (!ring->events) {
+        return 0;
+    }
+
+    head = ring->head;
+    tail = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+
+    count = 0;
+    for (uint64_t i = tail; i < head; i++) {
+        out[count++] = ring->events[i % TRACE_RING_EVENTS];
+    }
+
+    __asm__ volatile("" ::: "memory");
+
+    // whatever the owner overwrote while we copied is torn, and so is the slot it writes next
+    end = ring->head;
+    skip = 0;
+    if (end >= TRACE_RING_EVENTS && end - TRACE_RING_EVENTS + 1 > tail) {
+        skip = end - TRACE_RING_EVENTS + 1 - tail;
+        if (skip > count) {
+            skip = count;
+        }
+    }
+
+    while (skip < count && out[skip].timestamp < trace_since) {
+        skip++;
+    }
+
+    for (uint32_t i = skip; i < count; i++) {
+        out[i - skip] = out[i];
+    }
+
+    return count - skip;
+}
+
+void trace_chrome(void *ctx, void (*write)(void *ctx, const char *data, uint32_t length), struct trace_event *buffer) {
+    char line[256];
+    uint32_t count;
+    int first;
+
+    write(ctx, "{\"traceEvents\":[", 16);
+    write(ctx, line, snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"frame4\"}}"));
+
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        count = trace_copy(&trace_rings[i], buffer);
+        if (!count) {
+            continue;
+        }
+
+        write(ctx, line, snprintf(line, sizeof(line), ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"thread %i\"}}", i, i));
+
+        first = 1;
+        for (uint32_t j = 0; j < count; j++) {
+            struct trace_event *e = &buffer[j];
+
+            // an end without its begin was cut off by the ring, chrome would close the wrong slice
+            if (first && e->phase == TRACE_END) {
+                continue;
+            }
+
+            first = 0;
+
+            if (e->phase == TRACE_BEGIN) {
+                write(ctx, line, snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%llu,\"pid\":1,\"tid\":%i,\"args\":{\"arg\":\"0x%llX\"}}",
+                    e->name < TRACE_NAMES ? trace_names[e->name] : "unknown", e->timestamp, i, e->arg));
+            }
+            else {
+                write(ctx, line, snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%llu,\"pid\":1,\"tid\":%i}",
+                    e->name < TRACE_NAMES ? trace_names[e->name] : "unknown", e->timestamp, i));
+            }
+        }
+    }
+
+    write(ctx, "]}", 2);
+}
+
+int trace_start_handle(int fd, struct cmd_packet *packet) {
+    // the rings are allocated once, threads may still be writing into them after a stop
+    if (!trace_storage) {
+        trace_storage = (struct trace_event *)pfmalloc(TRACE_MAX_THREADS * TRACE_RING_EVENTS * TRACE_EVENT_SIZE);
+        if (!trace_storage) {
+            net_send_status(fd, CMD_DATA_NULL);
+            return 1;
+        }
+
+        for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+            trace_rings[i].events = trace_storage + i * TRACE_RING_EVENTS;
+        }
+    }
+
+    // older events are skipped by the dump instead of clearing rings other threads own
+    trace_since = sceKernelGetProcessTime();
+    trace_enabled = 1;
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    return 0;
+}
+
+int trace_stop_handle(int fd, struct cmd_packet *packet) {
+    trace_enabled = 0;
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    return 0;
+}
+
+struct trace_chunk {
+    int fd;
+    int failed;
+    uint32_t used;
+    char buffer[TRACE_CHUNK];
+};
+
+void trace_chunk_flush(struct trace_chunk *chunk) {
+    if (!chunk->used || chunk->failed) {
+        return;
+    }
+
+    if (net_send_data(chunk->fd, &chunk->used, sizeof(uint32_t)) < 0 || net_send_data(chunk->fd, chunk->buffer, chunk->used) < 0) {
+        chunk->failed = 1;
+    }
+
+    chunk->used = 0;
+}
+
+void trace_chunk_write(void *ctx, const char *data, uint32_t length) {
+    struct trace_chunk *chunk = (struct trace_chunk *)ctx;
+
+    if (chunk->used + length > TRACE_CHUNK) {
+        trace_chunk_flush(chunk);
+    }
+
+    if (length > TRACE_CHUNK) {
+        return;
+    }
+
+    memcpy(chunk->buffer + chunk->used, data, length);
+    chunk->used += length;
+}
+
+int trace_dump_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_trace_dump_packet *dp;
+    struct trace_thread_header header;
+    struct trace_event *buffer;
+    struct trace_chunk *chunk;
+    uint32_t end;
+
+    dp = (struct cmd_trace_dump_packet *)packet->data;
+
+    if (!dp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    if (dp->format != TRACE_FORMAT_BINARY && dp->format != TRACE_FORMAT_CHROME) {
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 1;
+    }
+
+    buffer = (struct trace_event *)pool_alloc(fd, TRACE_RING_EVENTS * TRACE_EVENT_SIZE + sizeof(struct trace_chunk));
+    if (!buffer) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    if (dp->format == TRACE_FORMAT_CHROME) {
+        chunk = (struct trace_chunk *)(buffer + TRACE_RING_EVENTS);
+        chunk->fd = fd;
+        chunk->failed = 0;
+        chunk->used = 0;
+
+        trace_chrome(chunk, trace_chunk_write, buffer);
+        trace_chunk_flush(chunk);
+
+        end = 0;
+        net_send_data(fd, &end, sizeof(uint32_t));
+    }
+    else {
+        for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+            header.tid = i;
+            header.count = trace_copy(&trace_rings[i], buffer);
+            if (!header.count) {
+                continue;
+            }
+
+            net_send_data(fd, &header, TRACE_THREAD_HEADER_SIZE);
+            net_send_data(fd, buffer, header.count * TRACE_EVENT_SIZE);
+        }
+
+        header.tid = 0;
+        header.count = 0;
+        net_send_data(fd, &header, TRACE_THREAD_HEADER_SIZE);
+    }
+
+    pool_free(fd, buffer);
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "transfer.h"
+#include "server.h"
+
+struct transfer transfers[TRANSFER_MAX];
+ScePthreadMutex transfer_mutex;
+uint32_t transfer_next_id;
+
+void transfer_init() {
+    memset(transfers, NULL, sizeof(transfers));
+    scePthreadMutexInit(&transfer_mutex, NULL, "transfermutex");
+    transfer_next_id = 0;
+}
+
+// a transfer lives until every chunk was handed out and its last stream is done
+// call with transfer_mutex held
+void transfer_release(struct transfer *t) {
+    if (t->streams || (t->next < t->chunks && !t->cancel)) {
+        return;
+    }
+
+    memset(t, NULL, sizeof(struct transfer));
+}
+
+void transfer_remove_client(struct server_client *svc) {
+    scePthreadMutexLock(&transfer_mutex);
+
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        if (transfers[i].id && transfers[i].svc == svc) {
+            transfers[i].cancel = 1;
+            transfers[i].svc = NULL;
+            transfer_release(&transfers[i]);
+        }
+    }
+
+    scePthreadMutexUnlock(&transfer_mutex);
+}
+
+int transfer_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_transfer_packet *tp;
+    struct cmd_proc_transfer_response resp;
+    struct server_client *svc;
+    struct transfer *t;
+
+    tp = (struct cmd_proc_transfer_packet *)packet->data;
+
+    if (!tp) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    svc = find_client(fd);
+    if (!svc || !tp->length) {
+        net_send_status(fd, CMD_ERROR);
+        return 0;
+    }
+
+    scePthreadMutexLock(&transfer_mutex);
+
+    t = NULL;
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        if (!transfers[i].id) {
+            t = &transfers[i];
+            break;
+        }
+    }
+
+    if (!t) {
+        scePthreadMutexUnlock(&transfer_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    t->id = ++transfer_next_id;
+    t->svc = svc;
+    t->pid = tp->pid;
+    t->address = tp->address;
+    t->length = tp->length;
+    t->chunks = (tp->length + TRANSFER_CHUNK - 1) / TRANSFER_CHUNK;
+    t->next = 0;
+    t->streams = 0;
+    t->cancel = 0;
+
+    resp.id = t->id;
+    resp.chunks = t->chunks;
+
+    scePthreadMutexUnlock(&transfer_mutex);
+
+    net_send_response(fd, CMD_SUCCESS, &resp, CMD_PROC_TRANSFER_RESPONSE_SIZE);
+
+    return 0;
+}
+
+// the connection that attaches works the transfer until no chunks are left
+int transfer_attach_handle(int fd, struct cmd_packet *packet) {
+    struct cmd_proc_transfer_attach_packet *ap;
+    struct proc_transfer_chunk chunk;
+    struct proc_vm_map_cache cache;
+    struct compress_ctx *ctx;
+    struct transfer *t;
+    uint8_t *data;
+    uint64_t address;
+
+    ap = (struct cmd_proc_transfer_attach_packet *)packet->data;
+
+    if (!ap) {
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    scePthreadMutexLock(&transfer_mutex);
+
+    t = NULL;
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        if (transfers[i].id && transfers[i].id == ap->id && !transfers[i].cancel) {
+            t = &transfers[i];
+            break;
+        }
+    }
+
+    if (!t || t->streams >= TRANSFER_MAX_STREAMS) {
+        scePthreadMutexUnlock(&transfer_mutex);
+        net_send_status(fd, CMD_INVALID_INDEX);
+        return 0;
+    }
+
+    t->streams++;
+
+    scePthreadMutexUnlock(&transfer_mutex);
+
+    data = (uint8_t *)pool_alloc(fd, TRANSFER_CHUNK);
+    if (!data) {
+        scePthreadMutexLock(&transfer_mutex);
+        t->streams--;
+        transfer_release(t);
+        scePthreadMutexUnlock(&transfer_mutex);
+
+        net_send_status(fd, CMD_DATA_NULL);
+        return 1;
+    }
+
+    memset(&cache, NULL, sizeof(cache));
+    ctx = compress_alloc(fd);
+
+    net_send_status(fd, CMD_SUCCESS);
+
+    while (1) {
+        scePthreadMutexLock(&transfer_mutex);
+
+        if (t->cancel || t->next >= t->chunks) {
+            scePthreadMutexUnlock(&transfer_mutex);
+            break;
+        }
+
+        chunk.seq = t->next++;
+
+        scePthreadMutexUnlock(&transfer_mutex);
+
+        address = t->address + chunk.seq * TRANSFER_CHUNK;
+        chunk.length = TRANSFER_CHUNK;
+        if (chunk.seq == t->chunks - 1) {
+            chunk.length = t->length - chunk.seq * TRANSFER_CHUNK;
+        }
+
+        qos_quantum(fd);
+
+        proc_read_valid(t->pid, address, data, chunk.length, &cache, NULL, NULL);
+
+        if (net_send_data(fd, &chunk, PROC_TRANSFER_CHUNK_SIZE) < 0 || compress_send_chunk(fd, ctx, data, chunk.length, COMPRESS_METHOD_LZ4) < 0) {
+            // the chunk is lost with this stream, so the whole transfer is
+            scePthreadMutexLock(&transfer_mutex);
+            t->cancel = 1;
+            scePthreadMutexUnlock(&transfer_mutex);
+            break;
+        }
+    }
+
+    // a client that only got TRANSFER_END on every stream has every chunk
+    scePthreadMutexLock(&transfer_mutex);
+    chunk.seq = t->cancel ? TRANSFER_CANCELLED : TRANSFER_END;
+    scePthreadMutexUnlock(&transfer_mutex);
+
+    chunk.length = 0;
+    net_send_data(fd, &chunk, PROC_TRANSFER_CHUNK_SIZE);
+
+    compress_free(ctx);
+    proc_vm_map_cache_free(&cache);
+    pool_free(fd, data);
+
+    scePthreadMutexLock(&transfer_mutex);
+    t->streams--;
+    transfer_release(t);
+    scePthreadMutexUnlock(&transfer_mutex);
+
+    return 0;
+}
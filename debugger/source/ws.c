@@ -0,0 +1,742 @@
+#include "ws.h"
+#include "server.h"
+
+struct ws_client ws_clients[WS_MAX_CLIENTS];
+ScePthreadMutex ws_mutex;
+int ws_thread_running;
+uint64_t ws_progress_last;
+struct ws_events ws_events;
+ScePthreadMutex ws_event_mutex;
+
+void ws_init() {
+    memset(ws_clients, NULL, sizeof(ws_clients));
+    memset(&ws_events, NULL, sizeof(ws_events));
+    scePthreadMutexInit(&ws_mutex, NULL, "wsmutex");
+    scePthreadMutexInit(&ws_event_mutex, NULL, "wseventmutex");
+    ws_thread_running = 0;
+    ws_progress_last = 0;
+}
+
+uint32_t ws_rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+void ws_sha1_block(uint32_t *h, const uint8_t *block) {
+    uint32_t w[80];
+    uint32_t a, b, c, d, e, f, k, t;
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+
+    for (int i = 16; i < 80; i++) {
+        w[i] = ws_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    a = h[0];
+    b = h[1];
+    c = h[2];
+    d = h[3];
+    e = h[4];
+
+    for (int i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        t = ws_rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ws_rol(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+// only the handshake needs it, Sec-WebSocket-Accept is the base64 of a SHA-1
+void ws_sha1(const uint8_t *data, uint32_t length, uint8_t *digest) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t tail[128];
+    uint64_t bits;
+    uint32_t rest;
+    uint32_t size;
+
+    bits = (uint64_t)length * 8;
+
+    while (length >= 64) {
+        ws_sha1_block(h, data);
+        data += 64;
+        length -= 64;
+    }
+
+    rest = length;
+
+    memset(tail, NULL, sizeof(tail));
+    memcpy(tail, data, rest);
+    tail[rest] = 0x80;
+
+    // the length in bits closes the last block, which is a second one if it does not fit
+    size = rest < 56 ? 64 : 128;
+    for (int i = 0; i < 8; i++) {
+        tail[size - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+
+    ws_sha1_block(h, tail);
+    if (size == 128) {
+        ws_sha1_block(h, tail + 64);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = h[i] >> 24;
+        digest[i * 4 + 1] = h[i] >> 16;
+        digest[i * 4 + 2] = h[i] >> 8;
+        digest[i * 4 + 3] = h[i];
+    }
+}
+
+// called with ws_mutex held
+void ws_close(struct ws_client *ws) {
+    net_set_deadline(ws->fd, 0);
+    sceNetSocketClose(ws->fd);
+    memset(ws, NULL, sizeof(struct ws_client));
+    stats_sub(STATS_WS_CLIENTS, 1);
+}
+
+// one unmasked frame, called with ws_mutex held
+int ws_send_frame(struct ws_client *ws, int opcode, struct iovec *iov, int iovcnt) {
+    struct iovec frame[4];
+    uint8_t header[10];
+    uint64_t length;
+    int n;
+
+    length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    header[0] = 0x80 | opcode;
+    if (length < 126) {
+        header[1] = length;
+        n = 2;
+    }
+    else if (length <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = length >> 8;
+        header[3] = length;
+        n = 4;
+    }
+    else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = length >> ((7 - i) * 8);
+        }
+        n = 10;
+    }
+
+    frame[0].iov_base = header;
+    frame[0].iov_len = n;
+    for (int i = 0; i < iovcnt; i++) {
+        frame[i + 1] = iov[i];
+    }
+
+    if (net_send_datav(ws->fd, frame, iovcnt + 1) < 0) {
+        ws_close(ws);
+        return 1;
+    }
+
+    return 0;
+}
+
+// a binary message, the type byte followed by up to two pieces
+int ws_send(struct ws_client *ws, uint8_t type, void *data, uint32_t length, void *extra, uint32_t extraLength) {
+    struct iovec iov[3];
+
+    iov[0].iov_base = &type;
+    iov[0].iov_len = 1;
+    iov[1].iov_base = data;
+    iov[1].iov_len = length;
+    iov[2].iov_base = extra;
+    iov[2].iov_len = extraLength;
+
+    return ws_send_frame(ws, WS_OP_BINARY, iov, extraLength ? 3 : 2);
+}
+
+void ws_send_error(struct ws_client *ws, uint32_t status) {
+    ws_send(ws, WS_MSG_ERROR, &status, sizeof(status), NULL, 0);
+}
+
+int ws_handshake(struct http_request *req) {
+    struct ws_client *ws;
+    uint8_t digest[20];
+    char key[128];
+    char head[256];
+    unsigned char *accept;
+    size_t acceptLength;
+    uint32_t length;
+
+    if (!req->upgrade || !req->wskey || strcmp(req->method, "GET")) {
+        json_message(req, 400, "Expected a WebSocket upgrade");
+        return 1;
+    }
+
+    length = strlen(req->wskey);
+    if (!length || length + strlen(WS_GUID) >= sizeof(key)) {
+        json_message(req, 400, "Bad Sec-WebSocket-Key");
+        return 1;
+    }
+
+    scePthreadMutexLock(&ws_mutex);
+    ws = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (ws_clients[i].state == WS_CLIENT_FREE) {
+            ws = &ws_clients[i];
+            ws->state = WS_CLIENT_RESERVED;
+            break;
+        }
+    }
+    scePthreadMutexUnlock(&ws_mutex);
+
+    if (!ws) {
+        json_message(req, 503, "Too many WebSocket clients");
+        return 1;
+    }
+
+    strcpy(key, req->wskey);
+    strcat(key, WS_GUID);
+    ws_sha1((uint8_t *)key, strlen(key), digest);
+
+    accept = base64_encode(digest, sizeof(digest), &acceptLength);
+    if (!accept) {
+        scePthreadMutexLock(&ws_mutex);
+        ws->state = WS_CLIENT_FREE;
+        scePthreadMutexUnlock(&ws_mutex);
+        json_message(req, 500, "Out of memory");
+        return 1;
+    }
+
+    // base64_encode ends its output with a line feed
+    while (acceptLength && (accept[acceptLength - 1] == '\n' || accept[acceptLength - 1] == '\r')) {
+        acceptLength--;
+    }
+
+    length = snprintf(head, sizeof(head),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %.*s\r\n"
+        "\r\n",
+        (int)acceptLength, accept);
+
+    free(accept);
+
+    if (net_send_data(req->fd, head, length) < 0) {
+        scePthreadMutexLock(&ws_mutex);
+        ws->state = WS_CLIENT_FREE;
+        scePthreadMutexUnlock(&ws_mutex);
+        return 1;
+    }
+
+    ws->fd = req->fd;
+    req->ws = ws;
+    req->keepalive = 0;
+
+    return 0;
+}
+
+int ws_watch_add(struct ws_client *ws, uint8_t *data, uint32_t length) {
+    struct ws_watch_add_message *msg;
+    struct ws_watch *watch;
+
+    if (length < WS_WATCH_ADD_MESSAGE_SIZE) {
+        return CMD_DATA_NULL;
+    }
+
+    msg = (struct ws_watch_add_message *)data;
+
+    if (!msg->length || msg->length > SUB_MAX_LENGTH || msg->depth > PROC_PTR_MAX_DEPTH) {
+        return CMD_TOO_MUCH_DATA;
+    }
+
+    if (length != WS_WATCH_ADD_MESSAGE_SIZE + msg->depth * sizeof(int64_t)) {
+        return CMD_DATA_NULL;
+    }
+
+    // adding an id that is already watched replaces it
+    watch = NULL;
+    for (int i = 0; i < WS_MAX_WATCHES; i++) {
+        if (ws->watches[i].pid && ws->watches[i].id == msg->id) {
+            watch = &ws->watches[i];
+            break;
+        }
+    }
+
+    if (!watch) {
+        for (int i = 0; i < WS_MAX_WATCHES; i++) {
+            if (!ws->watches[i].pid) {
+                watch = &ws->watches[i];
+                break;
+            }
+        }
+    }
+
+    if (!watch) {
+        return CMD_TOO_MUCH_DATA;
+    }
+
+    memset(watch, NULL, sizeof(struct ws_watch));
+    watch->id = msg->id;
+    watch->pid = msg->pid;
+    watch->period = msg->period < SUB_MIN_PERIOD ? SUB_MIN_PERIOD : msg->period;
+    watch->due = sceKernelGetProcessTime();
+    watch->state = SUB_STATE_NONE;
+    watch->path.address = msg->address;
+    watch->path.length = msg->length;
+    watch->path.depth = msg->depth;
+    watch->path.data = watch->value;
+    memcpy(watch->path.offsets, data + WS_WATCH_ADD_MESSAGE_SIZE, msg->depth * sizeof(int64_t));
+
+    return 0;
+}
+
+// returns 1 if the client was closed
+int ws_message(struct ws_client *ws, uint8_t *data, uint32_t length) {
+    uint32_t value;
+    int status;
+
+    if (!length) {
+        return 0;
+    }
+
+    status = 0;
+
+    switch (data[0]) {
+        case WS_MSG_WATCH_ADD:
+            status = ws_watch_add(ws, data + 1, length - 1);
+            break;
+        case WS_MSG_WATCH_REMOVE:
+            if (length != 1 + sizeof(uint32_t)) {
+                status = CMD_DATA_NULL;
+                break;
+            }
+
+            memcpy(&value, data + 1, sizeof(value));
+            for (int i = 0; i < WS_MAX_WATCHES; i++) {
+                if (ws->watches[i].pid && ws->watches[i].id == value) {
+                    memset(&ws->watches[i], NULL, sizeof(struct ws_watch));
+                }
+            }
+            break;
+        case WS_MSG_EVENTS:
+            if (length != 1 + sizeof(uint32_t)) {
+                status = CMD_DATA_NULL;
+                break;
+            }
+
+            memcpy(&ws->events, data + 1, sizeof(ws->events));
+            break;
+        default:
+            status = CMD_ERROR;
+            break;
+    }
+
+    if (status) {
+        ws_send_error(ws, status);
+        return ws->state == WS_CLIENT_FREE;
+    }
+
+    return 0;
+}
+
+// takes every complete frame out of the buffer, returns 1 if the client was closed
+int ws_frames(struct ws_client *ws) {
+    struct iovec iov;
+    uint64_t length;
+    uint32_t header;
+    uint32_t total;
+    uint8_t *mask;
+    uint8_t *payload;
+    int opcode;
+
+    while (ws->used >= 2) {
+        opcode = ws->buffer[0] & 0x0F;
+        length = ws->buffer[1] & 0x7F;
+        header = 2;
+
+        // browsers mask every frame and nothing they send here needs fragments
+        if (!(ws->buffer[0] & 0x80) || !(ws->buffer[1] & 0x80)) {
+            ws_close(ws);
+            return 1;
+        }
+
+        if (length == 126) {
+            if (ws->used < 4) {
+                break;
+            }
+
+            length = (ws->buffer[2] << 8) | ws->buffer[3];
+            header = 4;
+        }
+        else if (length == 127) {
+            if (ws->used < 10) {
+                break;
+            }
+
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | ws->buffer[2 + i];
+            }
+            header = 10;
+        }
+
+        if (length > WS_MAX_MESSAGE) {
+            ws_close(ws);
+            return 1;
+        }
+
+        total = header + 4 + length;
+        if (ws->used < total) {
+            break;
+        }
+
+        mask = ws->buffer + header;
+        payload = mask + 4;
+        for (uint32_t i = 0; i < length; i++) {
+            payload[i] ^= mask[i & 3];
+        }
+
+        iov.iov_base = payload;
+        iov.iov_len = length;
+
+        switch (opcode) {
+            case WS_OP_CLOSE:
+                ws_send_frame(ws, WS_OP_CLOSE, &iov, length >= 2 ? 1 : 0);
+                if (ws->state != WS_CLIENT_FREE) {
+                    ws_close(ws);
+                }
+                return 1;
+            case WS_OP_PING:
+                if (ws_send_frame(ws, WS_OP_PONG, &iov, 1)) {
+                    return 1;
+                }
+                break;
+            case WS_OP_PONG:
+                break;
+            case WS_OP_BINARY:
+                if (ws_message(ws, payload, length)) {
+                    return 1;
+                }
+                break;
+            default:
+                ws_close(ws);
+                return 1;
+        }
+
+        for (uint32_t i = total; i < ws->used; i++) {
+            ws->buffer[i - total] = ws->buffer[i];
+        }
+
+        ws->used -= total;
+    }
+
+    return 0;
+}
+
+// called with ws_mutex held
+void ws_receive(struct ws_client *ws) {
+    int n;
+
+    errno = NULL;
+    n = read(ws->fd, ws->buffer + ws->used, WS_BUFFER_SIZE - ws->used);
+    if (n > 0) {
+        stats_add(STATS_BYTES_IN, n);
+        ws->used += n;
+        ws_frames(ws);
+        return;
+    }
+
+    if (!n || (errno && errno != EWOULDBLOCK && errno != EINTR)) {
+        ws_close(ws);
+    }
+}
+
+// same change detection as sub_push
+void ws_push(struct ws_client *ws, struct ws_watch *watch, uint64_t timestamp) {
+    struct sub_push_packet push;
+
+    if (watch->path.failed) {
+        if (watch->state == SUB_STATE_FAILED) {
+            return;
+        }
+
+        watch->state = SUB_STATE_FAILED;
+        push.length = 0;
+    }
+    else {
+        if (watch->state == SUB_STATE_VALUE && !memcmp(watch->value, watch->last, watch->path.length)) {
+            return;
+        }
+
+        watch->state = SUB_STATE_VALUE;
+        memcpy(watch->last, watch->value, watch->path.length);
+        push.length = watch->path.length;
+    }
+
+    push.id = watch->id;
+    push.timestamp = timestamp;
+    push.address = watch->path.resolved;
+
+    ws_send(ws, WS_MSG_WATCH, &push, SUB_PUSH_PACKET_SIZE, watch->value, push.length);
+}
+
+// samples every due watch, coalesced by process like the subscription thread does
+void ws_sample(uint64_t now, uint64_t *next) {
+    struct ws_watch *due[WS_MAX_CLIENTS * WS_MAX_WATCHES];
+    struct ws_client *owner[WS_MAX_CLIENTS * WS_MAX_WATCHES];
+    struct ws_watch *batch[PROC_PATHS_BATCH];
+    struct ws_client *batchOwner[PROC_PATHS_BATCH];
+    struct proc_path *paths[PROC_PATHS_BATCH];
+    struct ws_watch *watch;
+    int count;
+    int num;
+
+    count = 0;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (ws_clients[i].state != WS_CLIENT_OPEN) {
+            continue;
+        }
+
+        for (int j = 0; j < WS_MAX_WATCHES; j++) {
+            watch = &ws_clients[i].watches[j];
+            if (!watch->pid) {
+                continue;
+            }
+
+            if (watch->due <= now) {
+                owner[count] = &ws_clients[i];
+                due[count++] = watch;
+
+                watch->due += watch->period;
+                if (watch->due <= now) {
+                    watch->due = now + watch->period;
+                }
+            }
+
+            if (watch->due < *next) {
+                *next = watch->due;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!due[i]) {
+            continue;
+        }
+
+        num = 0;
+        uint32_t pid = due[i]->pid;
+        for (int j = i; j < count && num < PROC_PATHS_BATCH; j++) {
+            if (due[j] && due[j]->pid == pid) {
+                paths[num] = &due[j]->path;
+                batchOwner[num] = owner[j];
+                batch[num++] = due[j];
+                due[j] = NULL;
+            }
+        }
+
+        proc_read_paths(pid, paths, num);
+
+        for (int j = 0; j < num; j++) {
+            // a failed send closes the client and clears its watches
+            if (batchOwner[j]->state == WS_CLIENT_OPEN) {
+                ws_push(batchOwner[j], batch[j], now);
+            }
+        }
+    }
+}
+
+// called by ws_thread with ws_mutex held, sends what the scanner and the debugger queued
+void ws_flush() {
+    struct ws_scan_message scan;
+    struct debug_interrupt_packet interrupt;
+    int pending;
+
+    scePthreadMutexLock(&ws_event_mutex);
+    pending = ws_events.scanPending;
+    memcpy(&scan, &ws_events.scan, WS_SCAN_MESSAGE_SIZE);
+    ws_events.scanPending = 0;
+    scePthreadMutexUnlock(&ws_event_mutex);
+
+    if (pending) {
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            if (ws_clients[i].state == WS_CLIENT_OPEN && (ws_clients[i].events & WS_EVENT_SCAN)) {
+                ws_send(&ws_clients[i], WS_MSG_SCAN, &scan, WS_SCAN_MESSAGE_SIZE, NULL, 0);
+            }
+        }
+    }
+
+    for (;;) {
+        scePthreadMutexLock(&ws_event_mutex);
+        if (!ws_events.count) {
+            scePthreadMutexUnlock(&ws_event_mutex);
+            break;
+        }
+
+        memcpy(&interrupt, &ws_events.interrupts[ws_events.head], DEBUG_INTERRUPT_PACKET_SIZE);
+        ws_events.head = (ws_events.head + 1) % WS_EVENT_QUEUE;
+        ws_events.count--;
+        scePthreadMutexUnlock(&ws_event_mutex);
+
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            if (ws_clients[i].state == WS_CLIENT_OPEN && (ws_clients[i].events & WS_EVENT_INTERRUPT)) {
+                ws_send(&ws_clients[i], WS_MSG_INTERRUPT, &interrupt, DEBUG_INTERRUPT_PACKET_SIZE, NULL, 0);
+            }
+        }
+    }
+}
+
+void *ws_thread(void *arg) {
+    struct pollfd pfds[WS_MAX_CLIENTS];
+    struct ws_client *polled[WS_MAX_CLIENTS];
+    uint64_t now;
+    uint64_t next;
+    int timeout;
+    int count;
+
+    while (!unload_cmd_sent) {
+        scePthreadMutexLock(&ws_mutex);
+
+        now = sceKernelGetProcessTime();
+        next = now + NET_POLL_WAIT * 1000;
+
+        ws_sample(now, &next);
+        ws_flush();
+
+        count = 0;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            if (ws_clients[i].state == WS_CLIENT_OPEN) {
+                pfds[count].fd = ws_clients[i].fd;
+                pfds[count].events = POLLIN;
+                pfds[count].revents = 0;
+                polled[count++] = &ws_clients[i];
+            }
+        }
+
+        if (!count) {
+            ws_thread_running = 0;
+            scePthreadMutexUnlock(&ws_mutex);
+            trace_thread_exit();
+            break;
+        }
+
+        scePthreadMutexUnlock(&ws_mutex);
+
+        // client messages wake the thread early, otherwise it sleeps until the next watch is due
+        now = sceKernelGetProcessTime();
+        timeout = next > now ? (next - now + 999) / 1000 : 0;
+
+        if (net_poll(pfds, count, timeout) <= 0) {
+            continue;
+        }
+
+        scePthreadMutexLock(&ws_mutex);
+        for (int i = 0; i < count; i++) {
+            if (pfds[i].revents && polled[i]->state == WS_CLIENT_OPEN && polled[i]->fd == pfds[i].fd) {
+                ws_receive(polled[i]);
+            }
+        }
+        scePthreadMutexUnlock(&ws_mutex);
+    }
+
+    return NULL;
+}
+
+void ws_attach(struct ws_client *ws, void *data, uint32_t length) {
+    ScePthread thread;
+
+    scePthreadMutexLock(&ws_mutex);
+
+    // the HTTP read deadline would drop a quiet client, sends still must not stall the sampler
+    net_set_deadline(ws->fd, WS_DEADLINE);
+    ws->events = 0;
+
+    // anything the browser sent right behind the handshake
+    if (length > WS_BUFFER_SIZE) {
+        length = WS_BUFFER_SIZE;
+    }
+
+    memcpy(ws->buffer, data, length);
+    ws->used = length;
+    ws->state = WS_CLIENT_OPEN;
+    stats_add(STATS_WS_CLIENTS, 1);
+
+    if (ws_frames(ws)) {
+        scePthreadMutexUnlock(&ws_mutex);
+        return;
+    }
+
+    if (!ws_thread_running) {
+        // nothing queued while no client was open is still wanted
+        scePthreadMutexLock(&ws_event_mutex);
+        ws_events.scanPending = 0;
+        ws_events.count = 0;
+        scePthreadMutexUnlock(&ws_event_mutex);
+
+        ws_thread_running = 1;
+        scePthreadCreate(&thread, NULL, (void *)ws_thread, NULL, "ws_thread");
+    }
+
+    scePthreadMutexUnlock(&ws_mutex);
+}
+
+void ws_scan_progress(uint32_t done, uint32_t total, uint64_t results) {
+    uint64_t now;
+
+    // the last section always goes out so a client sees the scan finish
+    now = sceKernelGetProcessTime();
+    if (done < total && now - ws_progress_last < WS_PROGRESS_PERIOD) {
+        return;
+    }
+
+    ws_progress_last = now;
+
+    // ws_thread sends it, a stalled browser must not hold up the scanner
+    scePthreadMutexLock(&ws_event_mutex);
+    ws_events.scan.done = done;
+    ws_events.scan.total = total;
+    ws_events.scan.results = results;
+    ws_events.scanPending = 1;
+    scePthreadMutexUnlock(&ws_event_mutex);
+}
+
+void ws_debug_interrupt(struct debug_interrupt_packet *resp) {
+    // ws_thread sends it, a stalled browser must not hold up the debugger
+    scePthreadMutexLock(&ws_event_mutex);
+    if (ws_events.count == WS_EVENT_QUEUE) {
+        ws_events.head = (ws_events.head + 1) % WS_EVENT_QUEUE;
+        ws_events.count--;
+    }
+
+    memcpy(&ws_events.interrupts[(ws_events.head + ws_events.count) % WS_EVENT_QUEUE], resp, DEBUG_INTERRUPT_PACKET_SIZE);
+    ws_events.count++;
+    scePthreadMutexUnlock(&ws_event_mutex);
+}
@@ -0,0 +1,177 @@
+// shared by the host tests: starts debugger-host and talks to it over loopback
+// the wire constants and packets mirror include/, which needs libPS4 and cannot be included here
+
+#ifndef _TEST_COMMON_H
+#define _TEST_COMMON_H
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCK_SERVER_PORT        2811
+#define HTTP_SERVER_PORT        2812
+#define SUB_PORT                42070
+
+#define PACKET_MAGIC            0xFFAABBCC
+#define CMD_PROC_SCAN           0xBDAA0009
+#define CMD_PROC_SUB_ADD        0xBDAA0018
+#define CMD_PROC_RECORD_START   0xBDAA001A
+#define CMD_PROC_RECORD_STOP    0xBDAA001B
+#define CMD_PROC_RECORD_QUERY   0xBDAA001C
+#define CMD_PROC_STATE_SAVE     0xBDAA0024
+#define CMD_PROC_STATE_RESTORE  0xBDAA0025
+#define CMD_SUCCESS             0x80000000
+
+struct cmd_packet {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t datalen;
+} __attribute__((packed));
+
+struct sub_push_packet {
+    uint32_t id;
+    uint32_t length;
+    uint64_t timestamp;
+    uint64_t address;
+} __attribute__((packed));
+
+static const char *test_name;
+static pid_t server;
+static pid_t target; // a child the test works on, killed along with the server
+
+static void fail(const char *message) {
+    fprintf(stderr, "%s: %s\n", test_name, message);
+    if (server > 0) {
+        kill(server, SIGKILL);
+    }
+    if (target > 0) {
+        kill(target, SIGKILL);
+    }
+    exit(1);
+}
+
+static int read_full(int fd, void *data, size_t length, int timeout) {
+    struct pollfd pfd;
+    size_t done;
+    ssize_t r;
+
+    done = 0;
+    while (done < length) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout) <= 0) {
+            return 1;
+        }
+
+        r = read(fd, (uint8_t *)data + done, length - done);
+        if (r <= 0) {
+            return 1;
+        }
+
+        done += r;
+    }
+
+    return 0;
+}
+
+static void loopback(struct sockaddr_in *addr, int port) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static int connect_server(int port) {
+    struct sockaddr_in addr;
+    int fd;
+
+    // the payload sleeps before it starts listening
+    for (int i = 0; i < 100; i++) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        loopback(&addr, port);
+
+        if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+            return fd;
+        }
+
+        close(fd);
+        usleep(100000);
+    }
+
+    fail("could not connect to the server");
+    return -1;
+}
+
+static void send_command(int fd, uint32_t cmd, void *data, uint32_t length) {
+    struct cmd_packet packet;
+
+    packet.magic = PACKET_MAGIC;
+    packet.cmd = cmd;
+    packet.datalen = length;
+
+    if (write(fd, &packet, sizeof(packet)) != sizeof(packet) || write(fd, data, length) != (ssize_t)length) {
+        fail("could not send a command");
+    }
+}
+
+static uint32_t read_status(int fd) {
+    uint32_t status;
+
+    if (read_full(fd, &status, sizeof(status), 10000)) {
+        fail("no status from the server");
+    }
+
+    return status;
+}
+
+// checks the arguments and starts the debugger-host named on the command line below a fresh root
+static char *test_start(int argc, char **argv, const char *name) {
+    static char root[] = "/tmp/frame4-test-XXXXXX";
+
+    test_name = name;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <debugger-host>\n", argv[0]);
+        exit(2);
+    }
+
+    if (!mkdtemp(root)) {
+        fail("mkdtemp failed");
+    }
+
+    server = fork();
+    if (!server) {
+        setenv("FRAME4_ROOT", root, 1);
+        freopen("/dev/null", "w", stderr);
+        execl(argv[1], argv[1], (char *)NULL);
+        _exit(127);
+    }
+
+    return root;
+}
+
+static void test_finish(void) {
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+
+    if (target > 0) {
+        kill(target, SIGKILL);
+        waitpid(target, NULL, 0);
+    }
+
+    printf("%s: ok\n", test_name);
+}
+
+#endif
@@ -0,0 +1,221 @@
+// runs debugger-host, records values a child keeps changing until the recorder ring wrapped
+// several times and checks that every block a query returns is intact and in order
+// queries seal the open block, so querying at random times gives blocks of varying size
+// usage: test_record <path to debugger-host>
+
+#include "common.h"
+
+#define CHANNELS            16
+#define VALUE_TYPE_UINT64   6
+#define RECORD_SECONDS      10
+
+struct cmd_proc_record_start_packet {
+    uint32_t pid;
+    uint32_t period;
+    uint32_t count;
+    uint32_t length;
+} __attribute__((packed));
+
+struct cmd_proc_record_channel {
+    uint64_t address;
+    uint8_t type;
+    uint32_t depth;
+} __attribute__((packed));
+
+struct cmd_proc_record_query_packet {
+    uint64_t start;
+    uint64_t end;
+} __attribute__((packed));
+
+struct record_block_header {
+    uint64_t first;
+    uint64_t last;
+    uint32_t samples;
+    uint32_t channels;
+} __attribute__((packed));
+
+static volatile uint64_t values[CHANNELS];
+
+// decodes one delta-of-delta column and returns the number of values in it
+static uint32_t decode_column(uint8_t *data, uint32_t length, uint64_t *first, uint64_t *last) {
+    uint64_t prev;
+    int64_t prevdelta;
+    uint64_t v;
+    int64_t dod;
+    uint32_t count;
+    uint32_t used;
+    int shift;
+
+    prev = 0;
+    prevdelta = 0;
+    count = 0;
+    used = 0;
+    while (used < length) {
+        v = 0;
+        shift = 0;
+        do {
+            if (used >= length || shift > 63) {
+                fail("a block holds a broken varint");
+            }
+
+            v |= (uint64_t)(data[used] & 0x7F) << shift;
+            shift += 7;
+        } while (data[used++] & 0x80);
+
+        dod = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        prevdelta += dod;
+        prev += prevdelta;
+
+        if (!count) {
+            *first = prev;
+        }
+
+        *last = prev;
+        count++;
+    }
+
+    return count;
+}
+
+// checks every block of one query, returns how many there were
+static uint32_t query(int fd) {
+    struct cmd_proc_record_query_packet qp;
+    struct record_block_header *header;
+    static uint8_t block[0x20000];
+    uint32_t lengths[CHANNELS + 1];
+    uint64_t previous;
+    uint64_t first;
+    uint64_t last;
+    uint32_t length;
+    uint32_t offset;
+    uint32_t blocks;
+
+    qp.start = 0;
+    qp.end = (uint64_t)-1;
+
+    send_command(fd, CMD_PROC_RECORD_QUERY, &qp, sizeof(qp));
+    if (read_status(fd) != CMD_SUCCESS) {
+        fail("query refused");
+    }
+
+    previous = 0;
+    blocks = 0;
+    for (;;) {
+        if (read_full(fd, &length, sizeof(length), 5000)) {
+            fail("no block length from the server");
+        }
+
+        if (!length) {
+            return blocks;
+        }
+
+        if (length > sizeof(block) || read_full(fd, block, length, 5000)) {
+            fail("no block from the server");
+        }
+
+        offset = sizeof(struct record_block_header) + sizeof(lengths);
+        header = (struct record_block_header *)block;
+        if (length < offset || header->channels != CHANNELS || !header->samples) {
+            fail("a block has a broken header");
+        }
+
+        memcpy(lengths, block + sizeof(struct record_block_header), sizeof(lengths));
+        for (int i = 0; i <= CHANNELS; i++) {
+            if (lengths[i] > length - offset) {
+                fail("a block has broken column lengths");
+            }
+
+            if (decode_column(block + offset, lengths[i], &first, &last) != header->samples) {
+                fail("a column does not hold every sample of its block");
+            }
+
+            if (!i && (first != header->first || last != header->last)) {
+                fail("the timestamps do not match the block header");
+            }
+
+            offset += lengths[i];
+        }
+
+        if (offset != length) {
+            fail("the columns do not fill the block");
+        }
+
+        // blocks come oldest first and never overlap
+        if (header->first <= previous || header->last < header->first) {
+            fail("blocks out of order");
+        }
+
+        previous = header->last;
+        blocks++;
+    }
+}
+
+int main(int argc, char **argv) {
+    struct cmd_proc_record_start_packet sp;
+    struct cmd_proc_record_channel channels[CHANNELS];
+    uint8_t stop[16];
+    uint64_t x;
+    time_t end;
+    int fd;
+
+    test_start(argc, argv, "test_record");
+
+    // values that barely compress, so the ring fills fast
+    target = fork();
+    if (!target) {
+        x = 0x9E3779B97F4A7C15;
+        for (;;) {
+            for (int i = 0; i < CHANNELS; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                values[i] = x;
+            }
+
+            usleep(100);
+        }
+    }
+
+    fd = connect_server(SOCK_SERVER_PORT);
+
+    for (int i = 0; i < CHANNELS; i++) {
+        channels[i].address = (uint64_t)(uintptr_t)&values[i];
+        channels[i].type = VALUE_TYPE_UINT64;
+        channels[i].depth = 0;
+    }
+
+    sp.pid = target;
+    sp.period = 1000;
+    sp.count = CHANNELS;
+    sp.length = sizeof(channels);
+
+    send_command(fd, CMD_PROC_RECORD_START, &sp, sizeof(sp));
+    if (read_status(fd) != CMD_SUCCESS) {
+        fail("recording refused");
+    }
+
+    if (write(fd, channels, sizeof(channels)) != sizeof(channels) || read_status(fd) != CMD_SUCCESS) {
+        fail("could not start the recording");
+    }
+
+    // about 170KB a second against the 128KB ring of the host build
+    srand(getpid());
+    end = time(NULL) + RECORD_SECONDS;
+    while (time(NULL) < end) {
+        usleep(5000 + rand() % 400000);
+        if (!query(fd)) {
+            fail("the recording holds no blocks");
+        }
+    }
+
+    send_command(fd, CMD_PROC_RECORD_STOP, NULL, 0);
+    if (read_status(fd) != CMD_SUCCESS || read_full(fd, stop, sizeof(stop), 1000)) {
+        fail("could not stop the recording");
+    }
+
+    query(fd);
+
+    close(fd);
+    test_finish();
+    return 0;
+}
@@ -0,0 +1,162 @@
+// runs debugger-host, saves and restores a child of this process and checks that a restore
+// leaves a process that was already stopped stopped, and resumes one it stopped itself
+// usage: test_state <path to debugger-host>
+
+#include "common.h"
+
+#define STATE_NAME_LENGTH       32
+
+struct cmd_proc_state_save_packet {
+    uint32_t pid;
+    char name[STATE_NAME_LENGTH];
+} __attribute__((packed));
+
+struct cmd_proc_state_restore_packet {
+    uint32_t pid;
+    char name[STATE_NAME_LENGTH];
+    uint32_t flags;
+    char filter[32];
+    uint64_t start;
+    uint64_t end;
+} __attribute__((packed));
+
+static volatile uint32_t value = 1;
+
+// sends a command and checks the status in front of its response, which is skipped
+static void command(int fd, uint32_t cmd, void *data, uint32_t length, uint32_t response) {
+    uint8_t skip[64];
+
+    send_command(fd, cmd, data, length);
+
+    if (read_status(fd) != CMD_SUCCESS) {
+        fail("command failed");
+    }
+
+    if (read_full(fd, skip, response, 1000)) {
+        fail("no response from the server");
+    }
+}
+
+static char proc_state(pid_t pid) {
+    char path[64];
+    char line[512];
+    char *state;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%i/stat", pid);
+    f = fopen(path, "r");
+    if (!f || !fgets(line, sizeof(line), f)) {
+        fail("could not read the target state");
+    }
+    fclose(f);
+
+    state = strrchr(line, ')');
+    return state ? state[2] : 0;
+}
+
+static void wait_state(pid_t pid, int stopped) {
+    for (int i = 0; i < 100; i++) {
+        if ((proc_state(pid) == 'T') == stopped) {
+            return;
+        }
+
+        usleep(10000);
+    }
+
+    fail(stopped ? "the target did not stop" : "the target did not run");
+}
+
+static void target_value(uint32_t *get, uint32_t set) {
+    struct iovec local;
+    struct iovec remote;
+    ssize_t r;
+
+    local.iov_base = get ? get : &set;
+    local.iov_len = sizeof(uint32_t);
+    remote.iov_base = (void *)&value;
+    remote.iov_len = sizeof(uint32_t);
+
+    r = get ? process_vm_readv(target, &local, 1, &remote, 1, 0) : process_vm_writev(target, &local, 1, &remote, 1, 0);
+    if (r != sizeof(uint32_t)) {
+        fail("could not access the target");
+    }
+}
+
+static void restore(int fd) {
+    struct cmd_proc_state_restore_packet rp;
+
+    memset(&rp, 0, sizeof(rp));
+    rp.pid = target;
+    strcpy(rp.name, "test");
+
+    command(fd, CMD_PROC_STATE_RESTORE, &rp, sizeof(rp), 32);
+}
+
+int main(int argc, char **argv) {
+    struct cmd_proc_state_save_packet sp;
+    char path[128];
+    struct stat st;
+    uint32_t got;
+    char *root;
+    int fd;
+
+    root = test_start(argc, argv, "test_state");
+
+    target = fork();
+    if (!target) {
+        for (;;) {
+            pause();
+        }
+    }
+
+    fd = connect_server(SOCK_SERVER_PORT);
+
+    memset(&sp, 0, sizeof(sp));
+    sp.pid = target;
+    strcpy(sp.name, "test");
+    command(fd, CMD_PROC_STATE_SAVE, &sp, sizeof(sp), 12);
+
+    // the save goes to a temporary file that is renamed once it is complete
+    snprintf(path, sizeof(path), "%s/data/frame4/state/test", root);
+    if (stat(path, &st)) {
+        fail("the save is missing");
+    }
+
+    snprintf(path, sizeof(path), "%s/data/frame4/state/test.tmp", root);
+    if (!stat(path, &st)) {
+        fail("the temporary save was left behind");
+    }
+
+    // a process the user stopped stays stopped
+    kill(target, SIGSTOP);
+    wait_state(target, 1);
+
+    target_value(NULL, 2);
+    restore(fd);
+    target_value(&got, 0);
+    if (got != 1) {
+        fail("the restore did not write the saved value");
+    }
+
+    usleep(100000);
+    if (proc_state(target) != 'T') {
+        fail("the restore resumed a process it did not stop");
+    }
+
+    // a running process is stopped for the restore and runs again afterwards
+    kill(target, SIGCONT);
+    wait_state(target, 0);
+
+    target_value(NULL, 3);
+    restore(fd);
+    target_value(&got, 0);
+    if (got != 1) {
+        fail("the restore did not write the saved value");
+    }
+
+    wait_state(target, 0);
+
+    close(fd);
+    test_finish();
+    return 0;
+}
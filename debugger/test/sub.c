@@ -0,0 +1,116 @@
+// runs debugger-host, subscribes to a value in this process and expects pushes on SUB_PORT
+// a closed push socket must end the subscription, so the next one connects again
+// usage: test_sub <path to debugger-host>
+
+#include "common.h"
+
+struct cmd_proc_sub_add_packet {
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+    uint32_t period;
+    uint32_t depth;
+} __attribute__((packed));
+
+static volatile uint32_t watched = 0x11223344;
+
+static uint32_t subscribe(int fd) {
+    struct cmd_proc_sub_add_packet add;
+    uint32_t id;
+
+    memset(&add, 0, sizeof(add));
+    add.pid = getpid();
+    add.address = (uint64_t)(uintptr_t)&watched;
+    add.length = sizeof(watched);
+    add.period = 10000;
+
+    send_command(fd, CMD_PROC_SUB_ADD, &add, sizeof(add));
+
+    if (read_status(fd) != CMD_SUCCESS || read_status(fd) != CMD_SUCCESS) {
+        fail("subscription refused");
+    }
+
+    if (read_full(fd, &id, sizeof(id), 1000)) {
+        fail("no subscription id");
+    }
+
+    return id;
+}
+
+static int accept_push(int listener) {
+    struct pollfd pfd;
+
+    pfd.fd = listener;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 5000) <= 0) {
+        fail("the server did not connect the push socket");
+    }
+
+    return accept(listener, NULL, NULL);
+}
+
+static void expect_push(int fd, uint32_t id, uint32_t value) {
+    struct sub_push_packet push;
+    uint32_t got;
+
+    if (read_full(fd, &push, sizeof(push), 5000) || read_full(fd, &got, sizeof(got), 1000)) {
+        fail("no push from the server");
+    }
+
+    if (push.id != id || push.length != sizeof(value) || push.address != (uint64_t)(uintptr_t)&watched) {
+        fail("unexpected push");
+    }
+
+    if (got != value) {
+        fail("push carries the wrong value");
+    }
+}
+
+int main(int argc, char **argv) {
+    struct sockaddr_in addr;
+    uint32_t id;
+    int listener;
+    int push;
+    int fd;
+    int one;
+
+    // the server connects back to the client address on SUB_PORT
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    loopback(&addr, SUB_PORT);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, 4)) {
+        fail("could not listen on SUB_PORT");
+    }
+
+    test_start(argc, argv, "test_sub");
+
+    fd = connect_server(SOCK_SERVER_PORT);
+
+    id = subscribe(fd);
+    push = accept_push(listener);
+
+    // the first sample is always pushed, then only changes
+    expect_push(push, id, 0x11223344);
+
+    watched = 0x55667788;
+    expect_push(push, id, 0x55667788);
+
+    // the next pushes fail, which has to close the push socket and drop the subscription
+    close(push);
+
+    for (int i = 0; i < 20; i++) {
+        watched = i;
+        usleep(50000);
+    }
+
+    // a new subscription opens a new push socket
+    id = subscribe(fd);
+    push = accept_push(listener);
+    expect_push(push, id, watched);
+
+    close(push);
+    close(fd);
+    test_finish();
+    return 0;
+}
@@ -0,0 +1,253 @@
+// runs debugger-host, upgrades GET /ws and expects WS_MSG_WATCH pushes for a value in this process
+// and a WS_MSG_SCAN event for a scan started on the binary protocol, then fills the client table
+// usage: test_ws <path to debugger-host>
+
+#include "common.h"
+
+#define WS_OP_BINARY        0x2
+#define WS_MSG_WATCH_ADD    1
+#define WS_MSG_EVENTS       3
+#define WS_MSG_WATCH        0x81
+#define WS_MSG_SCAN         0x82
+#define WS_EVENT_SCAN       (1 << 0)
+#define WATCH_ID            7
+#define WS_MAX_CLIENTS      8
+
+struct cmd_proc_scan_packet {
+    uint32_t pid;
+    uint32_t firstScan;
+    uint8_t valueType;
+    uint8_t compareType;
+    uint32_t lenData;
+} __attribute__((packed));
+
+struct ws_watch_add_message {
+    uint32_t id;
+    uint32_t pid;
+    uint64_t address;
+    uint32_t length;
+    uint32_t period;
+    uint32_t depth;
+} __attribute__((packed));
+
+struct ws_scan_message {
+    uint32_t done;
+    uint32_t total;
+    uint64_t results;
+} __attribute__((packed));
+
+static volatile uint32_t watched = 0x11223344;
+
+// one masked binary frame, the way a browser sends it
+static void send_message(int fd, void *data, uint8_t length) {
+    uint8_t frame[2 + 4 + 255];
+    uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+    frame[0] = 0x80 | WS_OP_BINARY;
+    frame[1] = 0x80 | length;
+    memcpy(frame + 2, mask, 4);
+    for (int i = 0; i < length; i++) {
+        frame[6 + i] = ((uint8_t *)data)[i] ^ mask[i & 3];
+    }
+
+    if (write(fd, frame, 6 + length) != 6 + length) {
+        fail("could not send a frame");
+    }
+}
+
+static void expect_push(int fd, uint32_t value) {
+    struct sub_push_packet push;
+    uint8_t message[1 + sizeof(push) + sizeof(value)];
+    uint8_t header[2];
+    uint32_t got;
+
+    if (read_full(fd, header, 2, 5000)) {
+        fail("no frame from the server");
+    }
+
+    if (header[0] != (0x80 | WS_OP_BINARY) || header[1] != sizeof(message)) {
+        fail("unexpected frame header");
+    }
+
+    if (read_full(fd, message, sizeof(message), 1000)) {
+        fail("truncated frame");
+    }
+
+    memcpy(&push, message + 1, sizeof(push));
+    memcpy(&got, message + 1 + sizeof(push), sizeof(got));
+
+    if (message[0] != WS_MSG_WATCH || push.id != WATCH_ID || push.length != sizeof(value) || push.address != (uint64_t)(uintptr_t)&watched) {
+        fail("unexpected push");
+    }
+
+    if (got != value) {
+        fail("push carries the wrong value");
+    }
+}
+
+// skips watch pushes until a scan event for a finished scan shows up
+static void expect_scan_done(int fd) {
+    struct ws_scan_message scan;
+    uint8_t message[125];
+    uint8_t header[2];
+
+    for (int i = 0; i < 100; i++) {
+        if (read_full(fd, header, 2, 5000)) {
+            fail("no scan event from the server");
+        }
+
+        if (header[0] != (0x80 | WS_OP_BINARY) || header[1] > sizeof(message)) {
+            fail("unexpected frame header");
+        }
+
+        if (read_full(fd, message, header[1], 1000)) {
+            fail("truncated frame");
+        }
+
+        if (message[0] != WS_MSG_SCAN) {
+            continue;
+        }
+
+        if (header[1] != 1 + sizeof(scan)) {
+            fail("unexpected scan event");
+        }
+
+        memcpy(&scan, message + 1, sizeof(scan));
+        if (scan.done == scan.total) {
+            return;
+        }
+    }
+
+    fail("the scan did not finish");
+}
+
+// a first scan with no section selected, the event still reports the scan finishing
+static void scan(void) {
+    struct cmd_proc_scan_packet sp;
+    uint8_t sections[1024];
+    uint32_t value;
+    int fd;
+
+    fd = connect_server(SOCK_SERVER_PORT);
+
+    memset(&sp, 0, sizeof(sp));
+    sp.pid = getpid();
+    sp.firstScan = 1;
+    sp.valueType = 4;
+    sp.lenData = sizeof(value);
+    value = 0x11223344;
+
+    send_command(fd, CMD_PROC_SCAN, &sp, sizeof(sp));
+    if (read_status(fd) != CMD_SUCCESS) {
+        fail("scan refused");
+    }
+
+    if (write(fd, &value, sizeof(value)) != sizeof(value)) {
+        fail("could not send the scan value");
+    }
+
+    if (read_status(fd) != CMD_SUCCESS) {
+        fail("no map for the scan");
+    }
+
+    // more than the number of sections, the rest is dropped with the connection
+    memset(sections, 0, sizeof(sections));
+    if (write(fd, sections, sizeof(sections)) != sizeof(sections)) {
+        fail("could not send the scan sections");
+    }
+
+    close(fd);
+}
+
+// upgrades GET /ws on a new connection and returns it with the response head
+static int open_ws(char *response, size_t size) {
+    size_t used;
+    int fd;
+
+    fd = connect_server(HTTP_SERVER_PORT);
+
+    dprintf(fd,
+        "GET /ws HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n");
+
+    // read the head byte by byte so nothing behind it is consumed
+    used = 0;
+    while (used < size - 1 && (used < 4 || memcmp(response + used - 4, "\r\n\r\n", 4))) {
+        if (read_full(fd, response + used, 1, 5000)) {
+            fail("no handshake response");
+        }
+        used++;
+    }
+    response[used] = 0;
+
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    struct ws_watch_add_message add;
+    uint8_t message[1 + sizeof(add)];
+    int others[WS_MAX_CLIENTS];
+    char response[512];
+    uint32_t events;
+    int fd;
+
+    test_start(argc, argv, "test_ws");
+
+    fd = open_ws(response, sizeof(response));
+    if (strncmp(response, "HTTP/1.1 101", 12) || !strstr(response, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n")) {
+        fail("bad handshake response");
+    }
+
+    memset(&add, 0, sizeof(add));
+    add.id = WATCH_ID;
+    add.pid = getpid();
+    add.address = (uint64_t)(uintptr_t)&watched;
+    add.length = sizeof(watched);
+    add.period = 10000;
+
+    message[0] = WS_MSG_WATCH_ADD;
+    memcpy(message + 1, &add, sizeof(add));
+    send_message(fd, message, sizeof(message));
+
+    // the first sample is always pushed, then only changes
+    expect_push(fd, 0x11223344);
+
+    watched = 0x55667788;
+    expect_push(fd, 0x55667788);
+
+    // scan events are sent by the websocket thread, not the scanner
+    events = WS_EVENT_SCAN;
+    message[0] = WS_MSG_EVENTS;
+    memcpy(message + 1, &events, sizeof(events));
+    send_message(fd, message, 1 + sizeof(events));
+
+    usleep(100000);
+    scan();
+    expect_scan_done(fd);
+
+    // a full client table turns the next upgrade away
+    for (int i = 0; i < WS_MAX_CLIENTS - 1; i++) {
+        others[i] = open_ws(response, sizeof(response));
+        if (strncmp(response, "HTTP/1.1 101", 12)) {
+            fail("bad handshake response");
+        }
+    }
+
+    others[WS_MAX_CLIENTS - 1] = open_ws(response, sizeof(response));
+    if (strncmp(response, "HTTP/1.1 503 Service Unavailable\r\n", 34)) {
+        fail("a full client table was not answered with 503 Service Unavailable");
+    }
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        close(others[i]);
+    }
+
+    close(fd);
+    test_finish();
+    return 0;
+}
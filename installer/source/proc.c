@@ -1,22 +1,73 @@
 #include "proc.h"
 #include "kfirmware.h"
 
+// small lookup caches so the hot syscalls do not walk allproc every time
+// a cached proc is only trusted while it is still linked on allproc, once a process exits
+// and gets unlinked its predecessor no longer points back at it
+struct proc_cache_entry {
+    int pid;
+    struct proc *p;
+};
+
+struct proc_name_cache_entry {
+    char name[32];
+    struct proc *p;
+};
+
+struct proc_cache_entry proc_pid_cache[PROC_CACHE_SIZE];
+struct proc_name_cache_entry proc_name_cache[PROC_NAME_CACHE_SIZE];
+int proc_name_cache_next;
+
+// exit moves a proc from allproc over to zombproc, so a zombie is still linked but no longer ours
+int proc_is_linked(struct proc *p) {
+    return p->p_back && *p->p_back == p && p->p_state != PRS_ZOMBIE;
+}
+
 struct proc *proc_find_by_name(const char *name) {
     int pcomm_offset = 0x454;
     if (cached_firmware == 505) {
         pcomm_offset = 0x44C;
     }
 
+    struct proc_name_cache_entry *entry = NULL;
     struct proc *p;
+    uint64_t len;
 
     if (!name) {
         return NULL;
     }
 
+    len = strlen(name);
+    if (len < sizeof(entry->name)) {
+        for (int i = 0; i < PROC_NAME_CACHE_SIZE; i++) {
+            if (proc_name_cache[i].p && !memcmp(proc_name_cache[i].name, name, len + 1)) {
+                entry = &proc_name_cache[i];
+                break;
+            }
+        }
+
+        if (entry) {
+            p = entry->p;
+            if (proc_is_linked(p) && !memcmp((void *)((uint64_t)p + pcomm_offset), name, len)) {
+                return p;
+            }
+        }
+        else {
+            entry = &proc_name_cache[proc_name_cache_next];
+            proc_name_cache_next = (proc_name_cache_next + 1) % PROC_NAME_CACHE_SIZE;
+        }
+    }
+
     p = *allproc;
     uint64_t currentProc = (uint64_t)*allproc;
     do {
-        if (!memcmp((void*)(currentProc + pcomm_offset), name, strlen(name))) {
+        if (!memcmp((void *)(currentProc + pcomm_offset), name, len)) {
+            if (entry) {
+                entry->p = NULL;
+                memcpy(entry->name, name, len + 1);
+                entry->p = p;
+            }
+
             return p;
         }
         currentProc = *(uint64_t *)currentProc;
@@ -26,11 +77,21 @@ struct proc *proc_find_by_name(const char *name) {
 }
 
 struct proc *proc_find_by_pid(int pid) {
+    struct proc_cache_entry *entry;
     struct proc *p;
 
+    entry = &proc_pid_cache[pid & (PROC_CACHE_SIZE - 1)];
+
+    p = entry->p;
+    if (p && entry->pid == pid && p->pid == pid && proc_is_linked(p)) {
+        return p;
+    }
+
     p = *allproc;
     do {
         if (p->pid == pid) {
+            entry->pid = pid;
+            entry->p = p;
             return p;
         }
     } while ((p = p->p_forw));
@@ -24,6 +24,7 @@ struct sys_proc_rw_args {
     void *data;
     uint64_t length;
     uint64_t write;
+    uint64_t *n; // optional, bytes actually transferred
 } __attribute__((packed));
 int sys_proc_rw(struct thread *td, struct sys_proc_rw_args *uap);
 
@@ -38,6 +39,7 @@ int sys_proc_rw(struct thread *td, struct sys_proc_rw_args *uap);
 #define SYS_PROC_INFO       8
 #define SYS_PROC_THRINFO    9
 #define SYS_PROC_PRX_LIST   10
+#define SYS_PROC_READV      11
 struct sys_proc_alloc_args {
     uint64_t address;
     uint64_t length;
@@ -98,6 +100,16 @@ struct sys_proc_prx_list_args {
     struct prx_list_entry *entries;
     uint64_t num;
 } __attribute__((packed));
+struct proc_readv_entry {
+    uint64_t address;
+    void *data;
+    uint64_t length;
+    uint64_t n; // bytes actually read
+} __attribute__((packed));
+struct sys_proc_readv_args {
+    struct proc_readv_entry *entries;
+    uint64_t num;
+} __attribute__((packed));
 struct sys_proc_cmd_args {
     uint64_t pid;
     uint64_t cmd;
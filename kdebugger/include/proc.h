@@ -7,6 +7,9 @@
 
 #define PAGE_SIZE 0x4000
 
+#define PROC_CACHE_SIZE         64 // must be a power of two
+#define PROC_NAME_CACHE_SIZE    8
+
 struct proc_vm_map_entry {
     char name[32];
     uint64_t start;
@@ -15,6 +18,7 @@ struct proc_vm_map_entry {
     uint16_t prot;
 } __attribute__((packed));
 
+int proc_is_linked(struct proc *p);
 struct proc *proc_find_by_name(const char *name);
 struct proc *proc_find_by_pid(int pid);
 int proc_get_vm_map(struct proc *p, struct proc_vm_map_entry **entries, uint64_t *num_entries);
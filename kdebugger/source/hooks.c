@@ -61,13 +61,19 @@ finish:
 
 int sys_proc_rw(struct thread *td, struct sys_proc_rw_args *uap) {
     struct proc *p;
+    uint64_t n;
     int r;
 
     r = 1;
+    n = 0;
 
     p = proc_find_by_pid(uap->pid);
     if (p) {
-        r = proc_rw_mem(p, (void *)uap->address, uap->length, uap->data, 0, uap->write);
+        r = proc_rw_mem(p, (void *)uap->address, uap->length, uap->data, &n, uap->write);
+    }
+
+    if (uap->n) {
+        *uap->n = n;
     }
     
     td->td_retval[0] = r;
@@ -328,6 +334,17 @@ int sys_proc_prx_list_handle(struct proc *p, struct sys_proc_prx_list_args *args
     return 0;
 }
 
+int sys_proc_readv_handle(struct proc *p, struct sys_proc_readv_args *args) {
+    for (uint64_t i = 0; i < args->num; i++) {
+        struct proc_readv_entry *entry = &args->entries[i];
+        uint64_t n = 0;
+        proc_read_mem(p, (void *)entry->address, entry->length, entry->data, &n);
+        entry->n = n;
+    }
+
+    return 0;
+}
+
 int sys_proc_cmd(struct thread *td, struct sys_proc_cmd_args *uap) {
     struct proc *p;
     int r;
@@ -369,6 +386,9 @@ int sys_proc_cmd(struct thread *td, struct sys_proc_cmd_args *uap) {
         case SYS_PROC_PRX_LIST:
             r = sys_proc_prx_list_handle(p, (struct sys_proc_prx_list_args *)uap->data);
             break;
+        case SYS_PROC_READV:
+            r = sys_proc_readv_handle(p, (struct sys_proc_readv_args *)uap->data);
+            break;
         default:
             r = 1;
             break;
@@ -24,6 +24,10 @@
 #define VM_PROT_COPY        0x10
 #define VM_PROT_WANTS_COPY  0x10
 
+#define PRS_NEW             0
+#define PRS_NORMAL          1
+#define PRS_ZOMBIE          2
+
 #define PROT_READ  VM_PROT_READ
 #define PROT_WRITE VM_PROT_WRITE
 #define PROT_EXEC  VM_PROT_EXECUTE
@@ -258,9 +262,11 @@ struct k_dynlib_info {
 
 TYPE_BEGIN(struct proc_505, 0x800); // XXX: random, don't use directly without fixing it
 TYPE_FIELD(struct proc_505 *p_forw, 0);
+TYPE_FIELD(struct proc_505 **p_back, 8);
 TYPE_FIELD(TAILQ_HEAD(, thread) p_threads, 0x10);
 TYPE_FIELD(struct ucred *p_ucred, 0x40);
 TYPE_FIELD(struct filedesc *p_fd, 0x48);
+TYPE_FIELD(int p_state, 0xAC); // PRS_, right before the pid like in FreeBSD 9
 TYPE_FIELD(int pid, 0xB0);
 TYPE_FIELD(struct vmspace *p_vmspace, 0x168);
 TYPE_FIELD(struct k_dynlib_info *p_dynlib, 0x340);
@@ -272,9 +278,11 @@ TYPE_END();
 
 TYPE_BEGIN(struct proc, 0xB68);
 TYPE_FIELD(struct proc *p_forw, 0);
+TYPE_FIELD(struct proc **p_back, 8); // p_list.le_prev
 TYPE_FIELD(TAILQ_HEAD(, thread) p_threads, 0x10);
 TYPE_FIELD(struct ucred *p_ucred, 0x40);
 TYPE_FIELD(struct filedesc *p_fd, 0x48);
+TYPE_FIELD(int p_state, 0xAC); // PRS_, right before the pid like in FreeBSD 9
 TYPE_FIELD(int pid, 0xB0);
 TYPE_FIELD(struct vmspace *p_vmspace, 0x168);
 TYPE_FIELD(struct k_dynlib_info *p_dynlib, 0x340);